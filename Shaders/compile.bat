@@ -6,4 +6,12 @@ C:/VulkanSDK/1.3.280.0/Bin/glslc.exe testShader.frag -o ../VulkanProject/VulkanP
 C:/VulkanSDK/1.3.280.0/Bin/glslc.exe testShader.vert -o ../VulkanProject/VulkanProject/shaders/testVert.spv
 C:/VulkanSDK/1.3.280.0/Bin/glslc.exe cubeBox.frag -o ../VulkanProject/VulkanProject/shaders/cubeBoxFrag.spv
 C:/VulkanSDK/1.3.280.0/Bin/glslc.exe cubeBox.vert -o ../VulkanProject/VulkanProject/shaders/cubeBoxVert.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe -DDRAW_CONSTANTS_IN_UNIFORM shader.vert -o ../VulkanProject/VulkanProject/shaders/vertUniform.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe -DDRAW_CONSTANTS_IN_UNIFORM skybox.vert -o ../VulkanProject/VulkanProject/shaders/skyboxVertUniform.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe -DDRAW_CONSTANTS_IN_UNIFORM testShader.vert -o ../VulkanProject/VulkanProject/shaders/testVertUniform.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe -DDRAW_CONSTANTS_IN_UNIFORM cubeBox.vert -o ../VulkanProject/VulkanProject/shaders/cubeBoxVertUniform.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe mipgen.comp -o ../VulkanProject/VulkanProject/shaders/mipgen.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe --target-env=vulkan1.1 -DUSE_QUADS mipgen.comp -o ../VulkanProject/VulkanProject/shaders/mipgenQuad.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe hiz.comp -o ../VulkanProject/VulkanProject/shaders/hiz.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe cull.comp -o ../VulkanProject/VulkanProject/shaders/cull.spv
 pause
\ No newline at end of file
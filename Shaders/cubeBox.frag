@@ -1,11 +1,45 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 //layout(location = 0) in vec4 fragColor;
 //layout(location = 1) in vec2 TexCoords;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D depthTexture;
+layout(binding = 0) uniform UniformBufferObject{
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 lightView;
+    mat4 lightProjection;
+    vec3 pos;
+    vec3 lightPos;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowLight;
+    //bindless indices: x the material buffer, y the shadow cascades, z their sampler
+    uvec4 resources;
+} ubo;
+
+//the bindless set, textures and samplers are combined at the lookup. The shadow cascades are one layer each and
+//their sampler compares against the reference depth
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 0) uniform texture2DArray textureArrays[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+layout(set = 1, binding = 1) uniform samplerShadow shadowSamplers[];
+
+const uint BINDLESS_NONE = 0xffffffffu;
+
+struct Material {
+    vec4 tint;
+    uint textureIndex;
+    uint samplerIndex;
+};
+
+layout(set = 1, binding = 2) readonly buffer MaterialBuffer {
+    Material materials[];
+} materialBuffers[];
 
 layout(location = 0) in VS_OUT {
     vec3 FragPos;
@@ -16,14 +50,51 @@ layout(location = 0) in VS_OUT {
     vec2 TexCoords;
 } fs_in;
 
+layout(location = 6) flat in uint MaterialIndex;
+layout(location = 7) in float ViewDepth;
+
+//1 lit, 0 in shadow. Beyond the last cascade everything is lit
+float shadowVisibility(vec3 normal) {
+    int count = int(ubo.shadowLight.w);
+    int cascade = 0;
+    while (cascade < count && ViewDepth > ubo.cascadeSplits[cascade]) {
+        cascade++;
+    }
+    if (cascade >= count) {
+        return 1.0;
+    }
+
+    //a texel along the normal keeps the surface off its own shadow
+    vec3 position = fs_in.FragPos + normal * ubo.cascadeTexelSizes[cascade] * 1.5;
+    vec4 light = ubo.cascadeViewProj[cascade] * vec4(position, 1.0);
+    vec3 coord = light.xyz / light.w;
+    vec2 uv = coord.xy * 0.5 + 0.5;
+
+    //3x3 taps of the bilinear comparison
+    sampler2DArrayShadow shadowMap = sampler2DArrayShadow(textureArrays[ubo.resources.y], shadowSamplers[ubo.resources.z]);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            lit += texture(shadowMap, vec4(uv + vec2(x, y) * texel, float(cascade), coord.z));
+        }
+    }
+    return lit / 9.0;
+}
+
 void main() {
-    vec3 color = fs_in.inColor;
+    //the instances of one draw can have different materials, so the indices aren't uniform
+    Material material = materialBuffers[ubo.resources.x].materials[MaterialIndex];
+    vec3 color = fs_in.inColor * material.tint.rgb;
+    if (material.textureIndex != BINDLESS_NONE) {
+        color *= texture(sampler2D(textures[nonuniformEXT(material.textureIndex)], samplers[nonuniformEXT(material.samplerIndex)]), fs_in.TexCoords).rgb;
+    }
     vec3 ambient = 0.01f * color;
-    vec3 lightDir = normalize(fs_in.LightPos - fs_in.FragPos);
+    vec3 lightDir = normalize(ubo.shadowLight.xyz);
     vec3 normal = normalize(fs_in.Normal);
     
     float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * color;
+    vec3 diffuse = diff * shadowVisibility(normal) * color;
 
     vec3 viewDir = normalize(fs_in.CameraPos - fs_in.FragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);
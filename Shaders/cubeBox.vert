@@ -1,13 +1,20 @@
 #version 450
 
+//the scene's vertex layout, the positions are unpacked by the instance's model matrix. The color is always white
+//and left out of the vertices
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNormal;
+//per instance stream at binding 1
+layout(location = 4) in mat4 instanceModel;
+layout(location = 8) in uint instanceMaterial;
 
 //layout(location = 0) out vec3 fragColor;
 //layout(location = 1) out vec2 TexCoords;
 
+//the normals come as two octahedral components
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
 layout(binding = 0) uniform UniformBufferObject{
     mat4 model;
     mat4 view;
@@ -16,12 +23,35 @@ layout(binding = 0) uniform UniformBufferObject{
     mat4 lightProjection;
     vec3 pos;
     vec3 lightPos;
+    //the sun's shadow cascades
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    //xyz points towards the sun, w is the cascade count
+    vec4 shadowLight;
 } ubo;
 
 layout(binding = 2) uniform second{
     vec3 cameraPos;
 } sh;
 
+//per-draw constants, DrawConstants in drawconstants.h. Push constants unless compiled with DRAW_CONSTANTS_IN_UNIFORM
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint view;
+};
+
+#ifdef DRAW_CONSTANTS_IN_UNIFORM
+layout(binding = 3) uniform DrawUniform {
+    DrawData data;
+} draw;
+#else
+layout(push_constant) uniform DrawPush {
+    DrawData data;
+} draw;
+#endif
+
 layout(location = 0) out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
@@ -31,12 +61,28 @@ layout(location = 0) out VS_OUT {
     vec2 TexCoords;
 } vs_out;
 
+layout(location = 6) flat out uint MaterialIndex;
+//distance in front of the camera, picks the shadow cascade
+layout(location = 7) out float ViewDepth;
+
+vec3 octahedralDecode(vec2 folded) {
+    vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main() {
-    vs_out.FragPos = inPosition;
-    vs_out.Normal = inNormal;
+    mat4 model = draw.data.model * instanceModel;
+    vec3 normal = OCTAHEDRAL_NORMALS ? octahedralDecode(inNormal.xy) : inNormal;
+    vs_out.FragPos = vec3(model * vec4(inPosition, 1.0));
+    vs_out.Normal = mat3(model) * normal;
     vs_out.TexCoords = inTexCoord;
     vs_out.LightPos = ubo.lightPos;//sh.cameraPos;
     vs_out.CameraPos = ubo.pos;
-    vs_out.inColor = inColor;
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vs_out.inColor = vec3(1.0);
+    MaterialIndex = instanceMaterial;
+    ViewDepth = -(ubo.view * vec4(vs_out.FragPos, 1.0)).z;
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
 }
\ No newline at end of file
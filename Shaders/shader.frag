@@ -1,14 +1,46 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(binding = 0) uniform UniformBufferObject{
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 lightView;
+    mat4 lightProjection;
+    vec3 pos;
+    vec3 lightPos;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowLight;
+    //bindless indices: x the material buffer, y the shadow cascades, z their sampler
+    uvec4 resources;
+} ubo;
+
+//the bindless set, textures and samplers are combined at the lookup
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+
+struct Material {
+    vec4 tint;
+    uint textureIndex;
+    uint samplerIndex;
+};
+
+layout(set = 1, binding = 2) readonly buffer MaterialBuffer {
+    Material materials[];
+} materialBuffers[];
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.f);
+    Material material = materialBuffers[ubo.resources.x].materials[fragMaterial];
+    vec3 texColor = texture(sampler2D(textures[material.textureIndex], samplers[material.samplerIndex]), fragTexCoord).rgb;
+    outColor = vec4(fragColor * material.tint.rgb * texColor, 1.f);
     //outColor = vec4(fragTexCoord, 0, 1);
     //outColor = vec4(fragColor, 1.0);
 }
\ No newline at end of file
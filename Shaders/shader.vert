@@ -7,6 +7,7 @@ layout(location = 3) in vec3 inNormal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
 
 layout(binding = 0) uniform UniformBufferObject{
     mat4 model;
@@ -18,8 +19,26 @@ layout(binding = 0) uniform UniformBufferObject{
     vec3 lightPos;
 } ubo;
 
+//per-draw constants, DrawConstants in drawconstants.h. Push constants unless compiled with DRAW_CONSTANTS_IN_UNIFORM
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint view;
+};
+
+#ifdef DRAW_CONSTANTS_IN_UNIFORM
+layout(binding = 3) uniform DrawUniform {
+    DrawData data;
+} draw;
+#else
+layout(push_constant) uniform DrawPush {
+    DrawData data;
+} draw;
+#endif
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition+vec3(0,0,0), 1.0);
+    gl_Position = ubo.proj * ubo.view * draw.data.model * vec4(inPosition+vec3(0,0,0), 1.0);
+    fragMaterial = draw.data.material;
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
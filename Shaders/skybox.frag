@@ -1,4 +1,5 @@
 #version 450 core
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) out vec4 outColor;
 
@@ -6,10 +7,42 @@ layout (location = 0) in vec2 texCoords;
 
 layout (location = 1) in vec3 transColor;
 
-layout (binding = 1) uniform sampler2D skybox;
+layout (location = 2) flat in uint material;
+
+layout(binding = 0) uniform UniformBufferObject{
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 lightView;
+    mat4 lightProjection;
+    vec3 pos;
+    vec3 lightPos;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowLight;
+    //bindless indices: x the material buffer, y the shadow cascades, z their sampler
+    uvec4 resources;
+} ubo;
+
+//the bindless set, textures and samplers are combined at the lookup
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+
+struct Material {
+    vec4 tint;
+    uint textureIndex;
+    uint samplerIndex;
+};
+
+layout(set = 1, binding = 2) readonly buffer MaterialBuffer {
+    Material materials[];
+} materialBuffers[];
 
 void main()
 {    
     //outColor = vec4(transColor,1.0);
-    outColor = texture(skybox, texCoords);
+    //the draw's material, the same for every fragment
+    Material sky = materialBuffers[ubo.resources.x].materials[material];
+    outColor = texture(sampler2D(textures[sky.textureIndex], samplers[sky.samplerIndex]), texCoords);
 }
\ No newline at end of file
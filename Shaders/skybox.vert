@@ -17,11 +17,30 @@ layout(binding = 0) uniform UniformBufferObject{
 
 layout (location = 0) out vec2 texCoords;
 layout (location = 1) out vec3 transColor;
+layout (location = 2) flat out uint material;
+
+//per-draw constants, DrawConstants in drawconstants.h. Push constants unless compiled with DRAW_CONSTANTS_IN_UNIFORM
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint view;
+};
+
+#ifdef DRAW_CONSTANTS_IN_UNIFORM
+layout(binding = 3) uniform DrawUniform {
+    DrawData data;
+} draw;
+#else
+layout(push_constant) uniform DrawPush {
+    DrawData data;
+} draw;
+#endif
 
 void main()
 {
     texCoords = inTexCoord;
     transColor = inColor;
+    material = draw.data.material;
     
 	//mat4 viewMat = mat4(mat3(ubo.model));
 	//gl_Position = ubo.proj * viewMat * vec4(aPos, 1.0);
@@ -3,10 +3,8 @@
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
-layout(binding = 1) uniform sampler2D texSampler;
-
 //layout(location = 0) out vec4 outColor;
 
 void main() {
-    //outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.f);
+    //depth only, the cascades have no color attachment
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #version 450
 
+//draws the scene into one shadow cascade. Same inputs as cubeBox.vert, only the position is used
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNormal;
+layout(location = 4) in mat4 instanceModel;
+layout(location = 8) in uint instanceMaterial;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -16,9 +18,32 @@ layout(binding = 0) uniform UniformBufferObject{
     mat4 lightProjection;
     vec3 pos;
     vec3 lightPos;
+    mat4 cascadeViewProj[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowLight;
 } ubo;
 
+//per-draw constants, DrawConstants in drawconstants.h. Push constants unless compiled with DRAW_CONSTANTS_IN_UNIFORM
+struct DrawData {
+    mat4 model;
+    uint material;
+    uint view;
+};
+
+#ifdef DRAW_CONSTANTS_IN_UNIFORM
+layout(binding = 3) uniform DrawUniform {
+    DrawData data;
+} draw;
+#else
+layout(push_constant) uniform DrawPush {
+    DrawData data;
+} draw;
+#endif
+
 void main()
 {
-    gl_Position = ubo.lightProjection * ubo.lightView * ubo.model * vec4(inPosition, 1.0);
+    fragColor = vec3(1.0);
+    fragTexCoord = inTexCoord;
+    gl_Position = ubo.cascadeViewProj[draw.data.view] * draw.data.model * instanceModel * vec4(inPosition, 1.0);
 }
\ No newline at end of file
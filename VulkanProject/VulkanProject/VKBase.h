@@ -857,6 +857,12 @@ namespace vulkan {
                 this->surface = surface;
         }
 
+        //For a device created outside of graphicsBase, so the wrappers below can use it
+        void Device(VkDevice device) {
+            if (!this->device)
+                this->device = device;
+        }
+
         result_t CreateInstance(VkInstanceCreateFlags flags = 0) {
             if constexpr (ENABLE_DEBUG_MESSENGER)
                 AddInstanceLayer("VK_LAYER_KHRONOS_validation");
@@ -1140,6 +1146,13 @@ namespace vulkan {
         void FreeBuffers(arrayRef<commandBuffer> buffers) const {
             FreeBuffers({ &buffers[0].handle, buffers.Count() });
         }
+        //Returns every command buffer allocated from the pool to the initial state at once
+        result_t Reset(VkCommandPoolResetFlags flags = 0) const {
+            VkResult result = vkResetCommandPool(graphicsBase::Base().Device(), handle, flags);
+            if (result)
+                outStream << std::format("[ commandPool ] ERROR\nFailed to reset the command pool!\nError code: {}\n", int32_t(result));
+            return result;
+        }
         void FreeBuffer(uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) const {
             //vkFreeCommandBuffers(graphicsBase::Base().Device(), handle, commandBufferCount, pCommandBuffers);
             //memset(pCommandBuffers, 0, commandBufferCount * sizeof(VkCommandPool));
@@ -0,0 +1,347 @@
+#pragma once
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+// A piece of device memory handed out by DeviceMemoryAllocator. Bind the resource at memory + offset
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    // size requested by the resource and the size of the buddy node that actually backs it
+    VkDeviceSize size = 0;
+    VkDeviceSize nodeSize = 0;
+    // host pointer to offset, only set for host visible memory which is kept mapped for the block's lifetime
+    void* mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    bool dedicated = false;
+    // owning block inside the pool, unused for dedicated allocations
+    void* block = nullptr;
+};
+
+// Resources with linear and optimal tiling must not share a bufferImageGranularity page, so they
+// are sub-allocated from different blocks instead of padding every neighbour
+enum class AllocationKind {
+    Linear,
+    Optimal,
+};
+
+struct AllocatorStats {
+    // memory obtained from the driver, including blocks that are only partly used
+    VkDeviceSize bytesAllocated = 0;
+    // bytes requested by live resources
+    VkDeviceSize bytesUsed = 0;
+    // rounding of live allocations up to their buddy node size
+    VkDeviceSize bytesWasted = 0;
+    uint32_t blockCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    uint32_t allocationCount = 0;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one set of blocks per memory type and
+// resource kind, using a buddy allocator inside every block. Large images get their own dedicated allocation
+class DeviceMemoryAllocator {
+public:
+    static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+    static const VkDeviceSize MIN_NODE_SIZE = 256;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE) {
+        this->device = device;
+        this->preferredBlockSize = preferredBlockSize;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+
+        pools.clear();
+        pools.resize(memProperties.memoryTypeCount * 2);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationKind kind, bool preferDedicated = false) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+        VkDeviceSize blockSize = blockSizeFor(memoryTypeIndex);
+
+        // big render targets gain nothing from sharing a block and would only fragment it
+        if (preferDedicated || requirements.size > blockSize / 4) {
+            return allocateDedicated(requirements.size, memoryTypeIndex);
+        }
+
+        VkDeviceSize alignment = std::max(requirements.alignment, MIN_NODE_SIZE);
+        if (isHostVisible(memoryTypeIndex) && !isHostCoherent(memoryTypeIndex)) {
+            // flushes of neighbouring allocations must not overlap
+            alignment = std::max(alignment, nonCoherentAtomSize);
+        }
+        VkDeviceSize nodeSize = nextPowerOfTwo(std::max(requirements.size, alignment));
+
+        auto& pool = pools[poolIndex(memoryTypeIndex, kind)];
+        for (auto& block : pool) {
+            VkDeviceSize offset;
+            if (block->allocate(nodeSize, offset)) {
+                return makeAllocation(*block, offset, requirements.size, nodeSize, memoryTypeIndex);
+            }
+        }
+
+        pool.push_back(createBlock(blockSize, memoryTypeIndex));
+        VkDeviceSize offset;
+        if (!pool.back()->allocate(nodeSize, offset)) {
+            throw std::runtime_error("failed to sub-allocate device memory!");
+        }
+        return makeAllocation(*pool.back(), offset, requirements.size, nodeSize, memoryTypeIndex);
+    }
+
+    MemoryAllocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        MemoryAllocation allocation = allocate(memRequirements, properties, AllocationKind::Linear);
+        if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind buffer memory!");
+        }
+        return allocation;
+    }
+
+    MemoryAllocation allocateImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling, bool preferDedicated = false) {
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        AllocationKind kind = tiling == VK_IMAGE_TILING_LINEAR ? AllocationKind::Linear : AllocationKind::Optimal;
+        MemoryAllocation allocation = allocate(memRequirements, properties, kind, preferDedicated);
+        if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind image memory!");
+        }
+        return allocation;
+    }
+
+    void free(MemoryAllocation& allocation) {
+        if (allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats.bytesUsed -= allocation.size;
+        stats.allocationCount--;
+
+        if (allocation.dedicated) {
+            if (allocation.mapped) {
+                vkUnmapMemory(device, allocation.memory);
+            }
+            vkFreeMemory(device, allocation.memory, nullptr);
+            stats.bytesAllocated -= allocation.size;
+            stats.dedicatedAllocationCount--;
+        }
+        else {
+            static_cast<Block*>(allocation.block)->free(allocation.offset, allocation.nodeSize);
+            stats.bytesWasted -= allocation.nodeSize - allocation.size;
+        }
+
+        allocation = MemoryAllocation{};
+    }
+
+    AllocatorStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    // every allocation has to be freed before this, blocks are released whether they are empty or not
+    void destroy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& pool : pools) {
+            for (auto& block : pool) {
+                if (block->mapped) {
+                    vkUnmapMemory(device, block->memory);
+                }
+                vkFreeMemory(device, block->memory, nullptr);
+            }
+            pool.clear();
+        }
+        stats = AllocatorStats{};
+    }
+
+private:
+    // buddy allocator over one VkDeviceMemory. Level 0 is the whole block, every level below halves the node size
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        std::vector<std::set<VkDeviceSize>> freeNodes;
+
+        void init(VkDeviceSize blockSize) {
+            size = blockSize;
+            uint32_t levels = 1;
+            for (VkDeviceSize node = blockSize; node > MIN_NODE_SIZE; node >>= 1) {
+                levels++;
+            }
+            freeNodes.assign(levels, {});
+            freeNodes[0].insert(0);
+        }
+
+        uint32_t levelOf(VkDeviceSize nodeSize) const {
+            uint32_t level = 0;
+            for (VkDeviceSize node = size; node > nodeSize; node >>= 1) {
+                level++;
+            }
+            return level;
+        }
+
+        bool allocate(VkDeviceSize nodeSize, VkDeviceSize& offset) {
+            if (nodeSize > size) {
+                return false;
+            }
+            uint32_t target = levelOf(nodeSize);
+
+            // smallest free node that still fits, then split it down to the requested size
+            int level = static_cast<int>(target);
+            while (level >= 0 && freeNodes[level].empty()) {
+                level--;
+            }
+            if (level < 0) {
+                return false;
+            }
+
+            offset = *freeNodes[level].begin();
+            freeNodes[level].erase(freeNodes[level].begin());
+            for (uint32_t l = static_cast<uint32_t>(level); l < target; l++) {
+                VkDeviceSize half = size >> (l + 1);
+                freeNodes[l + 1].insert(offset + half);
+            }
+            return true;
+        }
+
+        void free(VkDeviceSize offset, VkDeviceSize nodeSize) {
+            uint32_t level = levelOf(nodeSize);
+            while (level > 0) {
+                VkDeviceSize buddy = offset ^ nodeSize;
+                auto it = freeNodes[level].find(buddy);
+                if (it == freeNodes[level].end()) {
+                    break;
+                }
+                freeNodes[level].erase(it);
+                offset = std::min(offset, buddy);
+                nodeSize <<= 1;
+                level--;
+            }
+            freeNodes[level].insert(offset);
+        }
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memProperties{};
+    VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE;
+    VkDeviceSize nonCoherentAtomSize = 1;
+    std::vector<std::vector<std::unique_ptr<Block>>> pools;
+    AllocatorStats stats;
+    mutable std::mutex mutex;
+
+    static VkDeviceSize nextPowerOfTwo(VkDeviceSize value) {
+        VkDeviceSize result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    size_t poolIndex(uint32_t memoryTypeIndex, AllocationKind kind) const {
+        return memoryTypeIndex * 2 + (kind == AllocationKind::Optimal ? 1 : 0);
+    }
+
+    bool isHostVisible(uint32_t memoryTypeIndex) const {
+        return memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    }
+
+    bool isHostCoherent(uint32_t memoryTypeIndex) const {
+        return memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    // small heaps (e.g. the 256MB host visible device local window) get proportionally smaller blocks
+    VkDeviceSize blockSizeFor(uint32_t memoryTypeIndex) const {
+        VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+        VkDeviceSize blockSize = preferredBlockSize;
+        while (blockSize > MIN_NODE_SIZE && blockSize > heapSize / 8) {
+            blockSize >>= 1;
+        }
+        return blockSize;
+    }
+
+    VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+
+        *mapped = nullptr;
+        if (isHostVisible(memoryTypeIndex) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(device, memory, nullptr);
+            throw std::runtime_error("failed to map device memory!");
+        }
+        return memory;
+    }
+
+    std::unique_ptr<Block> createBlock(VkDeviceSize blockSize, uint32_t memoryTypeIndex) {
+        auto block = std::make_unique<Block>();
+        block->memory = allocateMemory(blockSize, memoryTypeIndex, &block->mapped);
+        block->init(blockSize);
+
+        stats.bytesAllocated += blockSize;
+        stats.blockCount++;
+        return block;
+    }
+
+    MemoryAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex) {
+        MemoryAllocation allocation{};
+        allocation.memory = allocateMemory(size, memoryTypeIndex, &allocation.mapped);
+        allocation.size = size;
+        allocation.nodeSize = size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.dedicated = true;
+
+        stats.bytesAllocated += size;
+        stats.bytesUsed += size;
+        stats.dedicatedAllocationCount++;
+        stats.allocationCount++;
+        return allocation;
+    }
+
+    MemoryAllocation makeAllocation(Block& block, VkDeviceSize offset, VkDeviceSize size, VkDeviceSize nodeSize, uint32_t memoryTypeIndex) {
+        MemoryAllocation allocation{};
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.nodeSize = nodeSize;
+        allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.block = &block;
+
+        stats.bytesUsed += size;
+        stats.bytesWasted += nodeSize - size;
+        stats.allocationCount++;
+        return allocation;
+    }
+};
+
+#endif
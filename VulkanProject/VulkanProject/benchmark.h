@@ -0,0 +1,161 @@
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Summary of one series of samples. Frame timings are all stored in milliseconds
+struct SampleStats {
+    size_t count = 0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+// nearest-rank percentile, expects the samples to be sorted already
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+inline SampleStats computeStats(std::vector<double> samples) {
+    SampleStats stats{};
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.count = samples.size();
+    stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.p50 = percentile(samples, 50.0);
+    stats.p95 = percentile(samples, 95.0);
+    stats.p99 = percentile(samples, 99.0);
+    return stats;
+}
+
+// Collects named per-frame sample series plus a few scalar metrics and writes them out as JSON,
+// so that CI can compare runs without parsing console output
+class FrameBenchmark {
+public:
+    void setInfo(const std::string& key, const std::string& value) {
+        set(info, key, value);
+    }
+
+    void setMetric(const std::string& key, double value) {
+        set(metrics, key, value);
+    }
+
+    void addSample(const std::string& series, double value) {
+        for (auto& entry : samples) {
+            if (entry.first == series) {
+                entry.second.push_back(value);
+                return;
+            }
+        }
+        samples.push_back({ series, { value } });
+    }
+
+    SampleStats stats(const std::string& series) const {
+        for (const auto& entry : samples) {
+            if (entry.first == series) {
+                return computeStats(entry.second);
+            }
+        }
+        return {};
+    }
+
+    void printSummary(std::ostream& out) const {
+        for (const auto& entry : samples) {
+            SampleStats s = computeStats(entry.second);
+            out << entry.first << ": mean " << s.mean << " p50 " << s.p50 << " p95 " << s.p95 << " p99 " << s.p99 << " (" << s.count << " samples)" << std::endl;
+        }
+    }
+
+    void writeJson(const std::string& path) const {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open benchmark output file!");
+        }
+
+        file << "{\n  \"info\": {";
+        for (size_t i = 0; i < info.size(); i++) {
+            file << (i ? "," : "") << "\n    \"" << escape(info[i].first) << "\": \"" << escape(info[i].second) << "\"";
+        }
+        file << "\n  },\n  \"metrics\": {";
+        for (size_t i = 0; i < metrics.size(); i++) {
+            file << (i ? "," : "") << "\n    \"" << escape(metrics[i].first) << "\": " << number(metrics[i].second);
+        }
+        file << "\n  },\n  \"series\": {";
+        for (size_t i = 0; i < samples.size(); i++) {
+            SampleStats s = computeStats(samples[i].second);
+            file << (i ? "," : "") << "\n    \"" << escape(samples[i].first) << "\": { "
+                << "\"count\": " << s.count
+                << ", \"mean\": " << number(s.mean)
+                << ", \"min\": " << number(s.min)
+                << ", \"max\": " << number(s.max)
+                << ", \"p50\": " << number(s.p50)
+                << ", \"p95\": " << number(s.p95)
+                << ", \"p99\": " << number(s.p99) << " }";
+        }
+        file << "\n  }\n}\n";
+
+        if (!file) {
+            throw std::runtime_error("failed to write benchmark output file!");
+        }
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> info;
+    std::vector<std::pair<std::string, double>> metrics;
+    std::vector<std::pair<std::string, std::vector<double>>> samples;
+
+    template<typename T>
+    static void set(std::vector<std::pair<std::string, T>>& container, const std::string& key, const T& value) {
+        for (auto& entry : container) {
+            if (entry.first == key) {
+                entry.second = value;
+                return;
+            }
+        }
+        container.push_back({ key, value });
+    }
+
+    // JSON has no representation for inf/nan
+    static std::string number(double value) {
+        return std::isfinite(value) ? std::to_string(value) : "null";
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                result += ' ';
+            }
+            else {
+                result += c;
+            }
+        }
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// an index that refers to no descriptor, e.g. a material without a texture
+const uint32_t BINDLESS_NONE = 0xffffffffu;
+
+// bindings of the table's set, the shaders index the arrays
+const uint32_t BINDLESS_TEXTURE_BINDING = 0;
+const uint32_t BINDLESS_SAMPLER_BINDING = 1;
+const uint32_t BINDLESS_BUFFER_BINDING = 2;
+
+struct BindlessLimits {
+    uint32_t textures = 1024;
+    uint32_t samplers = 32;
+    uint32_t buffers = 64;
+};
+
+struct BindlessStats {
+    uint32_t textureCount = 0;
+    uint32_t samplerCount = 0;
+    uint32_t bufferCount = 0;
+    // addSampler calls answered with an existing sampler
+    uint32_t samplersShared = 0;
+};
+
+// One descriptor set for every texture, sampler and storage buffer of the frame (VK_EXT_descriptor_indexing).
+// Resources are added once and referred to by their index in the arrays, so materials hold indices instead of
+// owning descriptor sets and a pass binds the table once however many objects it draws. The bindings are partially
+// bound and update-after-bind, so adding a resource neither needs a new pool nor invalidates recorded command buffers.
+// Samplers are deduplicated by their create info and owned by the table
+class BindlessTable {
+public:
+    // the features init() relies on, to be chained into VkDeviceCreateInfo
+    static VkPhysicalDeviceDescriptorIndexingFeaturesEXT requiredFeatures() {
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        features.descriptorBindingPartiallyBound = VK_TRUE;
+        features.runtimeDescriptorArray = VK_TRUE;
+        return features;
+    }
+
+    static bool isSupported(const VkPhysicalDeviceDescriptorIndexingFeaturesEXT& supported) {
+        return supported.shaderSampledImageArrayNonUniformIndexing && supported.descriptorBindingSampledImageUpdateAfterBind
+            && supported.descriptorBindingStorageBufferUpdateAfterBind && supported.descriptorBindingPartiallyBound
+            && supported.runtimeDescriptorArray;
+    }
+
+    void init(VkDevice device, VkShaderStageFlags stages, const BindlessLimits& limits = BindlessLimits()) {
+        this->device = device;
+        this->limits = limits;
+
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+        bindings[0].binding = BINDLESS_TEXTURE_BINDING;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        bindings[0].descriptorCount = limits.textures;
+        bindings[0].stageFlags = stages;
+        bindings[1].binding = BINDLESS_SAMPLER_BINDING;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        bindings[1].descriptorCount = limits.samplers;
+        bindings[1].stageFlags = stages;
+        bindings[2].binding = BINDLESS_BUFFER_BINDING;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[2].descriptorCount = limits.buffers;
+        bindings[2].stageFlags = stages;
+
+        std::array<VkDescriptorBindingFlagsEXT, 3> bindingFlags;
+        bindingFlags.fill(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT);
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        flagsInfo.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &flagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor set layout!");
+        }
+
+        std::array<VkDescriptorPoolSize, 3> poolSizes{};
+        for (size_t i = 0; i < bindings.size(); i++) {
+            poolSizes[i] = { bindings[i].descriptorType, bindings[i].descriptorCount };
+        }
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+        }
+    }
+
+    // the view has to stay in layout whenever a shader may sample it
+    uint32_t addTexture(VkImageView view, VkImageLayout layout) {
+        if (stats.textureCount >= limits.textures) {
+            throw std::runtime_error("bindless texture table is full!");
+        }
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = view;
+        imageInfo.imageLayout = layout;
+        write(BINDLESS_TEXTURE_BINDING, stats.textureCount, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, nullptr);
+        return stats.textureCount++;
+    }
+
+    // the index of a sampler created with the same info, or of a new one. pNext chains aren't compared
+    uint32_t addSampler(const VkSamplerCreateInfo& info) {
+        for (uint32_t i = 0; i < samplerInfos.size(); i++) {
+            if (sameSampler(samplerInfos[i], info)) {
+                stats.samplersShared++;
+                return i;
+            }
+        }
+        if (stats.samplerCount >= limits.samplers) {
+            throw std::runtime_error("bindless sampler table is full!");
+        }
+        VkSampler sampler;
+        if (vkCreateSampler(device, &info, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+        samplers.push_back(sampler);
+        samplerInfos.push_back(info);
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = sampler;
+        write(BINDLESS_SAMPLER_BINDING, stats.samplerCount, VK_DESCRIPTOR_TYPE_SAMPLER, &imageInfo, nullptr);
+        return stats.samplerCount++;
+    }
+
+    uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE) {
+        if (stats.bufferCount >= limits.buffers) {
+            throw std::runtime_error("bindless buffer table is full!");
+        }
+        VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+        write(BINDLESS_BUFFER_BINDING, stats.bufferCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+        return stats.bufferCount++;
+    }
+
+    VkDescriptorSetLayout getLayout() const {
+        return setLayout;
+    }
+
+    VkDescriptorSet getSet() const {
+        return descriptorSet;
+    }
+
+    const BindlessStats& getStats() const {
+        return stats;
+    }
+
+    void destroy() {
+        for (VkSampler sampler : samplers) {
+            vkDestroySampler(device, sampler, nullptr);
+        }
+        samplers.clear();
+        samplerInfos.clear();
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        stats = BindlessStats();
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    BindlessLimits limits;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    std::vector<VkSampler> samplers;
+    std::vector<VkSamplerCreateInfo> samplerInfos;
+    BindlessStats stats;
+
+    void write(uint32_t binding, uint32_t element, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSet;
+        descriptorWrite.dstBinding = binding;
+        descriptorWrite.dstArrayElement = element;
+        descriptorWrite.descriptorType = type;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = imageInfo;
+        descriptorWrite.pBufferInfo = bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    static bool sameSampler(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b) {
+        return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode
+            && a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW
+            && a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy
+            && a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod
+            && a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+    }
+};
+
+#endif
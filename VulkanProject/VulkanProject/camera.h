@@ -137,6 +137,15 @@ public:
             Zoom = 45.0f;
     }
 
+    // points the camera at a world-space target. Used by scripted camera paths where there is no input to drive the angles
+    void LookAt(glm::vec3 target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(direction.y));
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef COMMANDRECORDER_H
+#define COMMANDRECORDER_H
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "threadpool.h"
+#include "VKBase.h"
+
+// One piece of a render pass recorded into its own secondary command buffer
+struct SecondaryRecordTask {
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    // instead of renderPass with dynamic rendering: the formats of the attachments it draws into
+    const VkCommandBufferInheritanceRenderingInfoKHR* rendering = nullptr;
+    // records the draws; dynamic state and descriptor sets are not inherited from the primary and have to be set here
+    std::function<void(VkCommandBuffer)> record;
+};
+
+// Records secondary command buffers on the thread pool. Every range parallelFor can hand out owns one command pool
+// per frame in flight, so a pool is never touched by two threads at once and resetting a frame's pools recycles all
+// of its buffers in one call. The caller stitches the results into its primary buffer with vkCmdExecuteCommands
+class ParallelCommandRecorder {
+public:
+    void init(ThreadPool* pool, uint32_t queueFamilyIndex, uint32_t frameCount) {
+        this->pool = pool;
+        slotCount = static_cast<uint32_t>(pool->size()) + 1;
+        slots.resize(frameCount * slotCount);
+        for (auto& slot : slots) {
+            if (slot.commandPool.Create(queueFamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create recording command pool!");
+            }
+        }
+    }
+
+    // returns one secondary buffer per task, in task order. Only call once the frame's fence has signaled
+    std::vector<VkCommandBuffer> record(uint32_t frame, const std::vector<SecondaryRecordTask>& tasks) {
+        for (uint32_t s = 0; s < slotCount; s++) {
+            Slot& slot = slots[frame * slotCount + s];
+            if (slot.used > 0) {
+                if (slot.commandPool.Reset() != VK_SUCCESS) {
+                    throw std::runtime_error("failed to reset recording command pool!");
+                }
+                slot.used = 0;
+            }
+        }
+
+        std::vector<VkCommandBuffer> results(tasks.size());
+        pool->parallelFor(tasks.size(), 1, [&](size_t begin, size_t end, size_t rangeIndex) {
+            Slot& slot = slots[frame * slotCount + rangeIndex];
+            for (size_t i = begin; i < end; i++) {
+                vulkan::commandBuffer& buffer = acquire(slot);
+
+                VkCommandBufferInheritanceInfo inheritanceInfo{};
+                inheritanceInfo.pNext = tasks[i].rendering;
+                inheritanceInfo.renderPass = tasks[i].renderPass;
+                inheritanceInfo.subpass = tasks[i].subpass;
+                inheritanceInfo.framebuffer = tasks[i].framebuffer;
+                if (buffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, inheritanceInfo) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to begin recording secondary command buffer!");
+                }
+                tasks[i].record(buffer);
+                if (buffer.End() != VK_SUCCESS) {
+                    throw std::runtime_error("failed to record secondary command buffer!");
+                }
+                results[i] = buffer;
+            }
+        });
+        return results;
+    }
+
+    // the pools destroy themselves through graphicsBase, so this has to run before the device is destroyed
+    void destroy() {
+        slots.clear();
+    }
+
+private:
+    struct Slot {
+        vulkan::commandPool commandPool;
+        std::vector<vulkan::commandBuffer> buffers;
+        size_t used = 0;
+    };
+
+    ThreadPool* pool = nullptr;
+    uint32_t slotCount = 0;
+    // frame-major: slots[frame * slotCount + rangeIndex]
+    std::vector<Slot> slots;
+
+    // buffers are allocated on first use and kept; resetting the pool makes them reusable
+    vulkan::commandBuffer& acquire(Slot& slot) {
+        if (slot.used == slot.buffers.size()) {
+            slot.buffers.emplace_back();
+            if (slot.commandPool.AllocateBuffers(slot.buffers.back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+        }
+        return slot.buffers[slot.used++];
+    }
+};
+
+#endif
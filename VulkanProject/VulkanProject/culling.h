@@ -0,0 +1,293 @@
+#pragma once
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <vector>
+
+// glm only pulls in the intrinsics with GLM_FORCE_INTRINSICS, which would also change its own types, so the culler
+// picks the widest instruction set the compiler targets by itself (/arch:AVX or -mavx for the 8 wide path)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE
+#endif
+
+#include "threadpool.h"
+
+// xyz of a plane points into the frustum and w is its distance from the origin, p is on the inner side when
+// dot(xyz, p) + w >= 0
+struct FrustumPlanes {
+    glm::vec4 planes[6];
+};
+
+// left, right, bottom, top, near and far planes of a view projection with clip space depth in [0, 1]
+inline FrustumPlanes extractFrustumPlanes(const glm::mat4& viewProj) {
+    // glm is column major, the planes are sums of the rows
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    }
+    FrustumPlanes frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+    // normalized so w + dot is a distance that can be compared with a radius
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+struct FrustumCullStats {
+    uint32_t objectCount = 0;
+    uint32_t visibleCount = 0;
+    // parallelFor ranges of the last cull, 1 when the caller culled alone
+    uint32_t rangeCount = 0;
+    double ms = 0.0;
+};
+
+// World space bounding spheres kept as separate x, y, z and radius arrays, so one load brings in the same component
+// of LANES objects and the six plane tests run on all of them at once. The arrays are padded to whole groups with
+// spheres that can't pass a test, so the SIMD loops have no scalar tail. Large scenes are split into ranges over the
+// thread pool, every range compacts its survivors into its own list and the lists are joined in range order
+class FrustumCuller {
+public:
+#if defined(CULLING_AVX)
+    static const uint32_t LANES = 8;
+#elif defined(CULLING_SSE)
+    static const uint32_t LANES = 4;
+#else
+    static const uint32_t LANES = 1;
+#endif
+    // objects per parallelFor range, smaller scenes are culled on the calling thread
+    static const size_t OBJECTS_PER_RANGE = 8192;
+
+    static const char* instructionSet() {
+#if defined(CULLING_AVX)
+        return "AVX";
+#elif defined(CULLING_SSE)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    uint32_t add(const glm::vec3& center, float radius) {
+        uint32_t index = objectCount++;
+        if (objectCount > centerX.size()) {
+            size_t padded = (objectCount + LANES - 1) / LANES * LANES;
+            centerX.resize(padded, 0.f);
+            centerY.resize(padded, 0.f);
+            centerZ.resize(padded, 0.f);
+            radii.resize(padded, -std::numeric_limits<float>::infinity());
+        }
+        set(index, center, radius);
+        return index;
+    }
+
+    void set(uint32_t index, const glm::vec3& center, float radius) {
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        radii[index] = radius;
+    }
+
+    uint32_t size() const {
+        return objectCount;
+    }
+
+    void clear() {
+        objectCount = 0;
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        radii.clear();
+    }
+
+    // writes the indices of the spheres touching the frustum to visible in ascending order. Without a pool, or with
+    // simd off (for comparisons), everything runs on the calling thread
+    void cull(const glm::mat4& viewProj, std::vector<uint32_t>& visible, ThreadPool* pool = nullptr, bool simd = true) {
+        auto start = std::chrono::high_resolution_clock::now();
+        FrustumPlanes frustum = extractFrustumPlanes(viewProj);
+        visible.clear();
+
+        // ranges are made of whole groups so no group is split between two of them
+        size_t groupCount = (objectCount + LANES - 1) / LANES;
+        size_t groupsPerRange = OBJECTS_PER_RANGE / LANES;
+        size_t rangeCount = pool != nullptr ? pool->rangesFor(groupCount, groupsPerRange) : 1;
+        if (rangeCount <= 1) {
+            cullGroups(frustum, 0, groupCount, visible, simd);
+        }
+        else {
+            rangeVisible.resize(rangeCount);
+            pool->parallelFor(groupCount, groupsPerRange, [&](size_t begin, size_t end, size_t range) {
+                rangeVisible[range].clear();
+                cullGroups(frustum, begin, end, rangeVisible[range], simd);
+            });
+            size_t total = 0;
+            for (size_t range = 0; range < rangeCount; range++) {
+                total += rangeVisible[range].size();
+            }
+            visible.reserve(total);
+            for (size_t range = 0; range < rangeCount; range++) {
+                visible.insert(visible.end(), rangeVisible[range].begin(), rangeVisible[range].end());
+            }
+        }
+
+        stats.objectCount = objectCount;
+        stats.visibleCount = static_cast<uint32_t>(visible.size());
+        stats.rangeCount = static_cast<uint32_t>(std::max<size_t>(rangeCount, 1));
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    const FrustumCullStats& getStats() const {
+        return stats;
+    }
+
+private:
+    uint32_t objectCount = 0;
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radii;
+    // per range output of a parallel cull, kept to reuse the allocations
+    std::vector<std::vector<uint32_t>> rangeVisible;
+    FrustumCullStats stats;
+
+    void cullGroups(const FrustumPlanes& frustum, size_t firstGroup, size_t endGroup, std::vector<uint32_t>& out, bool simd) const {
+        if (!simd || LANES == 1) {
+            size_t end = std::min<size_t>(endGroup * LANES, objectCount);
+            for (size_t i = firstGroup * LANES; i < end; i++) {
+                if (sphereVisible(frustum, i)) {
+                    out.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            return;
+        }
+#if defined(CULLING_AVX)
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++) {
+            planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+        }
+        __m256 zero = _mm256_setzero_ps();
+        for (size_t group = firstGroup; group < endGroup; group++) {
+            size_t i = group * LANES;
+            __m256 x = _mm256_loadu_ps(&centerX[i]);
+            __m256 y = _mm256_loadu_ps(&centerY[i]);
+            __m256 z = _mm256_loadu_ps(&centerZ[i]);
+            __m256 r = _mm256_loadu_ps(&radii[i]);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, planeX[p]), _mm256_mul_ps(y, planeY[p])),
+                    _mm256_add_ps(_mm256_mul_ps(z, planeZ[p]), planeW[p]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), zero, _CMP_GE_OQ));
+            }
+            appendLanes(static_cast<uint32_t>(_mm256_movemask_ps(inside)), static_cast<uint32_t>(i), out);
+        }
+#elif defined(CULLING_SSE)
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++) {
+            planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+        __m128 zero = _mm_setzero_ps();
+        for (size_t group = firstGroup; group < endGroup; group++) {
+            size_t i = group * LANES;
+            __m128 x = _mm_loadu_ps(&centerX[i]);
+            __m128 y = _mm_loadu_ps(&centerY[i]);
+            __m128 z = _mm_loadu_ps(&centerZ[i]);
+            __m128 r = _mm_loadu_ps(&radii[i]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+                    _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+            }
+            appendLanes(static_cast<uint32_t>(_mm_movemask_ps(inside)), static_cast<uint32_t>(i), out);
+        }
+#endif
+    }
+
+    bool sphereVisible(const FrustumPlanes& frustum, size_t i) const {
+        glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+        for (const glm::vec4& plane : frustum.planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w + radii[i] < 0.f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // one bit per lane from movemask, lowest lane first so the output stays sorted
+    static void appendLanes(uint32_t mask, uint32_t first, std::vector<uint32_t>& out) {
+        while (mask != 0) {
+            out.push_back(first + static_cast<uint32_t>(std::countr_zero(mask)));
+            mask &= mask - 1;
+        }
+    }
+};
+
+// Culls objectCount random spheres against a fixed camera with the scalar loop, the SIMD loop and the SIMD loop over
+// the pool, and prints how many objects each tests per millisecond
+inline void benchmarkFrustumCulling(ThreadPool& pool, uint32_t objectCount, std::ostream& out) {
+    FrustumCuller culler;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.f, 100.f);
+    std::uniform_real_distribution<float> radius(0.1f, 2.f);
+    for (uint32_t i = 0; i < objectCount; i++) {
+        culler.add(glm::vec3(position(random), position(random), position(random)), radius(random));
+    }
+
+    glm::mat4 proj = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.f, 0.f, 0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    glm::mat4 viewProj = proj * view;
+
+    struct Variant {
+        const char* name;
+        ThreadPool* pool;
+        bool simd;
+    };
+    const Variant variants[] = {
+        { "scalar", nullptr, false },
+        { FrustumCuller::instructionSet(), nullptr, true },
+        { "threaded", &pool, true },
+    };
+
+    out << "frustum culling benchmark: " << objectCount << " objects, " << FrustumCuller::LANES << " lanes ("
+        << FrustumCuller::instructionSet() << "), " << pool.size() + 1 << " threads" << std::endl;
+    std::vector<uint32_t> visible;
+    for (const Variant& variant : variants) {
+        // warm up the caches and the pool, then take the best of a few runs
+        culler.cull(viewProj, visible, variant.pool, variant.simd);
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 20; run++) {
+            culler.cull(viewProj, visible, variant.pool, variant.simd);
+            best = std::min(best, culler.getStats().ms);
+        }
+        out << "  " << variant.name << ": " << best << " ms, " << objectCount / std::max(best, 1e-6)
+            << " objects/ms, " << culler.getStats().visibleCount << " visible in " << culler.getStats().rangeCount
+            << " ranges" << std::endl;
+    }
+}
+
+#endif
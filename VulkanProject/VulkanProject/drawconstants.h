@@ -0,0 +1,79 @@
+#pragma once
+#ifndef DRAWCONSTANTS_H
+#define DRAWCONSTANTS_H
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "uniformring.h"
+
+// the frame set binding the blocks are read from on the uniform path
+const uint32_t DRAW_CONSTANTS_BINDING = 3;
+
+// what a single draw gets on top of the frame's uniforms, as the vertex shaders declare it
+struct DrawConstants {
+    // applied before the instance transforms
+    glm::mat4 model;
+    // for draws without an instance stream, the instanced ones take it from their instances
+    uint32_t material;
+    // the shadow cascade a caster draw renders into
+    uint32_t view;
+    uint32_t padding[2] = {};
+};
+
+// Per-draw constants for the graphics pipelines. They are push constants when the device has room for the block,
+// which spares a descriptor bind per draw. Otherwise every draw's block is written to the uniform ring ahead of
+// recording and bound at DRAW_CONSTANTS_BINDING of the frame set with a dynamic offset of its own, and the pipelines
+// use the vertex shaders compiled with DRAW_CONSTANTS_IN_UNIFORM. Draws are known by a slot, set() fills it on the
+// main thread and the recorders only read it
+class DrawConstantTable {
+public:
+    void init(VkPhysicalDevice physicalDevice, uint32_t slotCount, bool allowPushConstants = true) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        pushConstants = allowPushConstants && sizeof(DrawConstants) <= properties.limits.maxPushConstantsSize;
+        constants.assign(slotCount, DrawConstants{});
+        uniformOffsets.assign(slotCount, 0);
+    }
+
+    bool usesPushConstants() const {
+        return pushConstants;
+    }
+
+    VkPushConstantRange pushConstantRange() const {
+        return { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants) };
+    }
+
+    void set(uint32_t slot, const DrawConstants& value) {
+        constants[slot] = value;
+    }
+
+    // uniform path only: copies every slot into the ring's current frame, call after its beginFrame
+    void upload(UniformRing& ring) {
+        if (pushConstants) {
+            return;
+        }
+        for (size_t slot = 0; slot < constants.size(); slot++) {
+            uniformOffsets[slot] = ring.push(constants[slot]);
+        }
+    }
+
+    uint32_t uniformOffset(uint32_t slot) const {
+        return uniformOffsets[slot];
+    }
+
+    // push path only, the layout has to come with pushConstantRange()
+    void push(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t slot) const {
+        vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &constants[slot]);
+    }
+
+private:
+    bool pushConstants = true;
+    std::vector<DrawConstants> constants;
+    std::vector<uint32_t> uniformOffsets;
+};
+
+#endif
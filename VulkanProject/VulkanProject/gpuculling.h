@@ -0,0 +1,598 @@
+#pragma once
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "allocator.h"
+#include "pipelinecache.h"
+#include "scene.h"
+
+// what the cull shader counted in one frame
+struct GpuCullStats {
+    uint32_t objectCount = 0;
+    uint32_t frustumCulled = 0;
+    // hidden by the previous frame's pyramid in the early phase
+    uint32_t occlusionCulled = 0;
+    uint32_t earlyVisible = 0;
+    // early phase occlusions the late phase found visible after all, and the ones that stayed hidden
+    uint32_t lateVisible = 0;
+    uint32_t stillOccluded = 0;
+    // of the objects drawn in either phase, at the level of detail each was drawn at
+    uint32_t triangles = 0;
+};
+
+// Two phase GPU culling of a SceneDrawList. The early phase (cull.comp) tests every object against the frustum and
+// the depth pyramid built from the previous frame and writes draw commands for the main pass. After it, the pyramid
+// is rebuilt from this frame's depth (hiz.comp, one dispatch per level, max reduction) and the late phase retests
+// only what the early phase found occluded, for a second pass that loads the main pass's attachments.
+// With a draw count the commands are compacted per batch, otherwise culled commands are kept with no instances.
+// The early phase also picks every object's level of detail from the scene's LOD table, the level of the previous
+// frame lives in a buffer shared by the frames for the hysteresis.
+// Command, count and counter buffers exist per frame in flight; the pyramid is shared and stays in GENERAL layout
+class GpuCuller {
+public:
+    // pyramid levels and hence descriptor sets for the pyramid dispatches
+    static const uint32_t MAX_PYRAMID_LEVELS = 16;
+
+    void init(VkDevice device, DeviceMemoryAllocator* allocator, PipelineCacheStore& pipelineCache, const std::vector<char>& cullCode,
+        const std::vector<char>& pyramidCode, uint32_t frameCount) {
+        this->device = device;
+        this->allocator = allocator;
+
+        std::vector<VkDescriptorSetLayoutBinding> cullBindings(10);
+        for (uint32_t i = 0; i < cullBindings.size(); i++) {
+            cullBindings[i].binding = i;
+            cullBindings[i].descriptorType = i == 7 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            cullBindings[i].descriptorCount = 1;
+            cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        cullSetLayout = createSetLayout(cullBindings);
+
+        std::vector<VkDescriptorSetLayoutBinding> pyramidBindings(2);
+        pyramidBindings[0].binding = 0;
+        pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidBindings[0].descriptorCount = 1;
+        pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pyramidBindings[1] = pyramidBindings[0];
+        pyramidBindings[1].binding = 1;
+        pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pyramidSetLayout = createSetLayout(pyramidBindings);
+
+        createPipeline(pipelineCache, "cull", cullCode, cullSetLayout, sizeof(CullParams), cullPipelineLayout, cullPipeline);
+        createPipeline(pipelineCache, "hiz", pyramidCode, pyramidSetLayout, sizeof(PyramidParams), pyramidPipelineLayout, pyramidPipeline);
+
+        std::array<VkDescriptorPoolSize, 3> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[0].descriptorCount = frameCount * 9;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[1].descriptorCount = frameCount + MAX_PYRAMID_LEVELS;
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[2].descriptorCount = MAX_PYRAMID_LEVELS;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = frameCount + MAX_PYRAMID_LEVELS;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling descriptor pool!");
+        }
+
+        frames.resize(frameCount);
+        for (Frame& frame : frames) {
+            frame.set = allocateSet(cullSetLayout);
+        }
+        pyramidSets.resize(MAX_PYRAMID_LEVELS);
+        for (VkDescriptorSet& set : pyramidSets) {
+            set = allocateSet(pyramidSetLayout);
+        }
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = static_cast<float>(MAX_PYRAMID_LEVELS);
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling sampler!");
+        }
+    }
+
+    // creates the per frame buffers for an uploaded scene, the scene has to stay alive while the culler is used
+    void setScene(const SceneDrawList& scene) {
+        this->scene = &scene;
+        objectCount = scene.objectCount();
+        batchCount = scene.batchCount();
+        compact = scene.supportsDrawCount();
+
+        VkDeviceSize commandSize = objectCount * sizeof(VkDrawIndexedIndirectCommand);
+        VkBufferUsageFlags commandUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        lodState.create(*this, objectCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        lodStateCleared = false;
+        for (Frame& frame : frames) {
+            frame.earlyCommands.create(*this, commandSize, commandUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.lateCommands.create(*this, commandSize, commandUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.drawCounts.create(*this, 2 * batchCount * sizeof(uint32_t), commandUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.retest.create(*this, objectCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            //read back by the CPU once the frame's fence signaled
+            frame.counters.create(*this, sizeof(Counters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+            //binding 7 is the pyramid, written with the size dependent resources
+            std::array<VkDescriptorBufferInfo, 9> bufferInfos = {
+                scene.objectBufferInfo(),
+                scene.commandBufferInfo(),
+                frame.earlyCommands.info(),
+                frame.lateCommands.info(),
+                frame.drawCounts.info(),
+                frame.retest.info(),
+                frame.counters.info(),
+                scene.lodBufferInfo(),
+                lodState.info()
+            };
+            std::array<VkWriteDescriptorSet, 9> writes{};
+            for (uint32_t i = 0; i < writes.size(); i++) {
+                writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[i].dstSet = frame.set;
+                writes[i].dstBinding = i < 7 ? i : i + 1;
+                writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[i].descriptorCount = 1;
+                writes[i].pBufferInfo = &bufferInfos[i];
+            }
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+    }
+
+    // size dependent part: the pyramid, sized to the largest power of two inside the depth buffer, and a depth only
+    // view of depthImage for its first level. The depth image must be in DEPTH_STENCIL_READ_ONLY_OPTIMAL while the
+    // pyramid is recorded
+    void createResources(VkImage depthImage, VkFormat depthFormat, VkExtent2D extent) {
+        depthExtent = extent;
+        pyramidExtent = { previousPowerOfTwo(extent.width), previousPowerOfTwo(extent.height) };
+        pyramidLevels = std::min(static_cast<uint32_t>(std::floor(std::log2(std::max(pyramidExtent.width, pyramidExtent.height)))) + 1, MAX_PYRAMID_LEVELS);
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.extent = { pyramidExtent.width, pyramidExtent.height, 1 };
+        imageInfo.mipLevels = pyramidLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &imageInfo, nullptr, &pyramid) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid!");
+        }
+        pyramidMemory = allocator->allocateImage(pyramid, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL);
+
+        pyramidView = createView(pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels);
+        for (uint32_t level = 0; level < pyramidLevels; level++) {
+            pyramidLevelViews.push_back(createView(pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+        }
+        depthView = createView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+
+        for (uint32_t level = 0; level < pyramidLevels; level++) {
+            VkDescriptorImageInfo sourceInfo{ sampler, level == 0 ? depthView : pyramidLevelViews[level - 1],
+                level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL };
+            VkDescriptorImageInfo destinationInfo{ VK_NULL_HANDLE, pyramidLevelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+            std::array<VkWriteDescriptorSet, 2> writes{};
+            writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[0].dstSet = pyramidSets[level];
+            writes[0].dstBinding = 0;
+            writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[0].descriptorCount = 1;
+            writes[0].pImageInfo = &sourceInfo;
+            writes[1] = writes[0];
+            writes[1].dstBinding = 1;
+            writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[1].pImageInfo = &destinationInfo;
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+
+        VkDescriptorImageInfo pyramidInfo{ sampler, pyramidView, VK_IMAGE_LAYOUT_GENERAL };
+        for (Frame& frame : frames) {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = frame.set;
+            write.dstBinding = 7;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = 1;
+            write.pImageInfo = &pyramidInfo;
+            vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+        }
+
+        //the new pyramid holds nothing until the first frame built it
+        pyramidFresh = true;
+        pyramidValid = false;
+    }
+
+    void destroyResources() {
+        if (pyramid == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyImageView(device, depthView, nullptr);
+        for (VkImageView view : pyramidLevelViews) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        pyramidLevelViews.clear();
+        vkDestroyImageView(device, pyramidView, nullptr);
+        vkDestroyImage(device, pyramid, nullptr);
+        allocator->free(pyramidMemory);
+        pyramid = VK_NULL_HANDLE;
+    }
+
+    // the camera of a frame; proj is a [0, 1] depth perspective, its y may be flipped. Levels of detail are picked so
+    // their error covers at most lodThreshold pixels of a viewport viewportHeight pixels high
+    void setView(uint32_t frame, const glm::mat4& view, const glm::mat4& proj, float viewportHeight, float lodThreshold) {
+        CullParams& params = frames[frame].params;
+        params.view = view;
+        float p00 = proj[0][0];
+        float p11 = std::abs(proj[1][1]);
+        //near and far back from the depth mapping: z' = (far * (z - near)) / (z * (far - near))
+        float zNear = proj[3][2] / proj[2][2];
+        float zFar = proj[3][2] / (proj[2][2] + 1.f);
+        params.projection = glm::vec4(p00, p11, zNear, zFar);
+        //normalized (x, z) and (y, z) normals of the side planes
+        float lengthX = std::sqrt(p00 * p00 + 1.f);
+        float lengthY = std::sqrt(p11 * p11 + 1.f);
+        params.frustum = glm::vec4(p00 / lengthX, 1.f / lengthX, p11 / lengthY, 1.f / lengthY);
+        params.pyramidSize = glm::vec2(pyramidExtent.width, pyramidExtent.height);
+        params.objectCount = objectCount;
+        params.batchCount = batchCount;
+        params.lodScale = 0.5f * viewportHeight * p11;
+        params.lodThreshold = lodThreshold;
+    }
+
+    // early phase, before the main pass
+    void recordEarly(VkCommandBuffer commandBuffer, uint32_t frame) {
+        Frame& target = frames[frame];
+
+        vkCmdFillBuffer(commandBuffer, target.drawCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, target.counters.buffer, 0, VK_WHOLE_SIZE, 0);
+        if (!lodStateCleared) {
+            vkCmdFillBuffer(commandBuffer, lodState.buffer, 0, VK_WHOLE_SIZE, 0);
+            lodStateCleared = true;
+        }
+        //the cleared counts, and the pyramid the previous frame's submission built
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        dispatchCull(commandBuffer, target, pyramidValid ? OCCLUSION : 0);
+        target.submitted = true;
+    }
+
+    // rebuilds the pyramid from this frame's depth, after the main pass
+    void recordPyramid(VkCommandBuffer commandBuffer) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = pyramidFresh ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = pyramid;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels, 0, 1 };
+        //after the early phase's reads and the previous frame's writes
+        barrier.srcAccessMask = pyramidFresh ? 0 : VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+        pyramidFresh = false;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline);
+        VkExtent2D source = depthExtent;
+        for (uint32_t level = 0; level < pyramidLevels; level++) {
+            VkExtent2D destination = { std::max(pyramidExtent.width >> level, 1u), std::max(pyramidExtent.height >> level, 1u) };
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout, 0, 1, &pyramidSets[level], 0, nullptr);
+            PyramidParams params{ static_cast<int32_t>(source.width), static_cast<int32_t>(source.height),
+                static_cast<int32_t>(destination.width), static_cast<int32_t>(destination.height) };
+            vkCmdPushConstants(commandBuffer, pyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidParams), &params);
+            vkCmdDispatch(commandBuffer, (destination.width + 7) / 8, (destination.height + 7) / 8, 1);
+
+            //the next level and the late phase read this one
+            VkMemoryBarrier memoryBarrier{};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &memoryBarrier, 0, nullptr, 0, nullptr);
+            source = destination;
+        }
+        pyramidValid = true;
+    }
+
+    // late phase, after the pyramid
+    void recordLate(VkCommandBuffer commandBuffer, uint32_t frame) {
+        dispatchCull(commandBuffer, frames[frame], LATE | OCCLUSION);
+
+        //counters for collect() once the fence signaled
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // the pipeline, descriptor sets and scene geometry have to be bound already
+    void drawEarly(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t batch) const {
+        scene->drawCulled(commandBuffer, batch, frames[frame].earlyCommands.buffer, frames[frame].drawCounts.buffer, batch * sizeof(uint32_t));
+    }
+
+    void drawLate(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t batch) const {
+        scene->drawCulled(commandBuffer, batch, frames[frame].lateCommands.buffer, frames[frame].drawCounts.buffer, (batchCount + batch) * sizeof(uint32_t));
+    }
+
+    // reads the counters of the frame's last submission, call once its fence signaled. False if it never culled
+    bool collect(uint32_t frame) {
+        Frame& source = frames[frame];
+        if (!source.submitted) {
+            return false;
+        }
+        Counters counters;
+        memcpy(&counters, source.counters.memory.mapped, sizeof(Counters));
+        stats.objectCount = objectCount;
+        stats.frustumCulled = counters.frustumCulled;
+        stats.occlusionCulled = counters.occlusionCulled;
+        stats.earlyVisible = counters.earlyVisible;
+        stats.lateVisible = counters.lateVisible;
+        stats.stillOccluded = counters.stillOccluded;
+        stats.triangles = counters.triangles;
+        return true;
+    }
+
+    const GpuCullStats& getStats() const {
+        return stats;
+    }
+
+    bool compacts() const {
+        return compact;
+    }
+
+    void destroy() {
+        destroyResources();
+        for (Frame& frame : frames) {
+            for (FrameBuffer* buffer : { &frame.earlyCommands, &frame.lateCommands, &frame.drawCounts, &frame.retest, &frame.counters }) {
+                buffer->destroy(*this);
+            }
+        }
+        frames.clear();
+        lodState.destroy(*this);
+        vkDestroySampler(device, sampler, nullptr);
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyPipeline(device, cullPipeline, nullptr);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+        vkDestroyPipeline(device, pyramidPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pyramidPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, pyramidSetLayout, nullptr);
+    }
+
+private:
+    // flags of cull.comp
+    static const uint32_t LATE = 1;
+    static const uint32_t OCCLUSION = 2;
+    static const uint32_t COMPACT = 4;
+
+    // matches the push constant block of cull.comp
+    struct CullParams {
+        glm::mat4 view;
+        glm::vec4 projection;
+        glm::vec4 frustum;
+        glm::vec2 pyramidSize;
+        uint32_t objectCount;
+        uint32_t flags;
+        uint32_t batchCount;
+        float lodScale;
+        float lodThreshold;
+    };
+
+    // matches the push constant block of hiz.comp
+    struct PyramidParams {
+        int32_t srcWidth;
+        int32_t srcHeight;
+        int32_t dstWidth;
+        int32_t dstHeight;
+    };
+
+    // matches the Counters block of cull.comp
+    struct Counters {
+        uint32_t frustumCulled;
+        uint32_t occlusionCulled;
+        uint32_t earlyVisible;
+        uint32_t lateVisible;
+        uint32_t stillOccluded;
+        uint32_t triangles;
+    };
+
+    struct FrameBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        VkDeviceSize size = 0;
+
+        void create(GpuCuller& owner, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+            this->size = std::max<VkDeviceSize>(size, 4);
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = this->size;
+            bufferInfo.usage = usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(owner.device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create culling buffer!");
+            }
+            memory = owner.allocator->allocateBuffer(buffer, properties);
+        }
+
+        void destroy(GpuCuller& owner) {
+            if (buffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(owner.device, buffer, nullptr);
+                owner.allocator->free(memory);
+                buffer = VK_NULL_HANDLE;
+            }
+        }
+
+        VkDescriptorBufferInfo info() const {
+            return { buffer, 0, size };
+        }
+    };
+
+    struct Frame {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        CullParams params{};
+        FrameBuffer earlyCommands;
+        FrameBuffer lateCommands;
+        FrameBuffer drawCounts;
+        FrameBuffer retest;
+        FrameBuffer counters;
+        bool submitted = false;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    const SceneDrawList* scene = nullptr;
+    uint32_t objectCount = 0;
+    uint32_t batchCount = 0;
+    bool compact = false;
+
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pyramidPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkPipeline pyramidPipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    std::vector<Frame> frames;
+    std::vector<VkDescriptorSet> pyramidSets;
+
+    VkExtent2D depthExtent = { 0, 0 };
+    VkExtent2D pyramidExtent = { 0, 0 };
+    uint32_t pyramidLevels = 0;
+    VkImage pyramid = VK_NULL_HANDLE;
+    MemoryAllocation pyramidMemory;
+    VkImageView pyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> pyramidLevelViews;
+    VkImageView depthView = VK_NULL_HANDLE;
+    // still in UNDEFINED layout, and whether a recorded frame built it yet
+    bool pyramidFresh = true;
+    bool pyramidValid = false;
+    FrameBuffer lodState;
+    bool lodStateCleared = false;
+    GpuCullStats stats;
+
+    static uint32_t previousPowerOfTwo(uint32_t value) {
+        uint32_t power = 1;
+        while (power * 2 <= value) {
+            power *= 2;
+        }
+        return power;
+    }
+
+    void dispatchCull(VkCommandBuffer commandBuffer, Frame& frame, uint32_t flags) {
+        frame.params.flags = flags | (compact ? COMPACT : 0);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &frame.params);
+        vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+    }
+
+    VkDescriptorSetLayout createSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling descriptor set layout!");
+        }
+        return layout;
+    }
+
+    VkDescriptorSet allocateSet(VkDescriptorSetLayout layout) {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate culling descriptor set!");
+        }
+        return set;
+    }
+
+    void createPipeline(PipelineCacheStore& pipelineCache, const std::string& key, const std::vector<char>& code,
+        VkDescriptorSetLayout setLayout, uint32_t pushConstantSize, VkPipelineLayout& layout, VkPipeline& pipeline) {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+        pipelineCache.createComputePipeline(key, pipelineInfo, &pipeline);
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+    }
+
+    VkImageView createView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseLevel, uint32_t levelCount) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = { aspect, baseLevel, levelCount, 0, 1 };
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+        return view;
+    }
+};
+
+#endif
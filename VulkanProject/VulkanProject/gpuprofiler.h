@@ -0,0 +1,254 @@
+#pragma once
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct GpuScopeTiming {
+    std::string name;
+    // nesting level, 0 for the frame scope
+    uint32_t depth = 0;
+    double ms = 0.0;
+};
+
+// Named GPU timestamp scopes. Every frame in flight slot owns its own range of queries, and a slot is only read back
+// after its fence was waited on (MAX_FRAMES_IN_FLIGHT frames later), so reading the results never stalls.
+// Scopes may nest; a begin timestamp is written at the top of the pipe and an end timestamp at the bottom
+class GpuProfiler {
+public:
+    static const uint32_t DEFAULT_MAX_SCOPES = 32;
+    static const uint32_t DEFAULT_HISTORY = 120;
+    static const uint32_t NO_SCOPE = 0xffffffffu;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount,
+        uint32_t maxScopes = DEFAULT_MAX_SCOPES, uint32_t historyLength = DEFAULT_HISTORY) {
+        this->device = device;
+        this->maxScopes = maxScopes;
+        this->historyLength = historyLength;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+        if (validBits == 0) {
+            std::cout << "timestamps are not supported on the graphics queue, GPU times will not be reported" << std::endl;
+            return;
+        }
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * maxScopes * frameCount;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+        slots.resize(frameCount);
+    }
+
+    bool isEnabled() const {
+        return queryPool != VK_NULL_HANDLE;
+    }
+
+    // reads back what the slot recorded last time. Call once the slot's fence has signaled and before recording into
+    // it again; returns false if there was nothing to read
+    bool collect(uint32_t frame) {
+        if (!isEnabled() || slots[frame].scopes.empty()) {
+            return false;
+        }
+        Slot& slot = slots[frame];
+        uint32_t queryCount = static_cast<uint32_t>(slot.scopes.size()) * 2;
+        std::vector<uint64_t> timestamps(queryCount);
+        VkResult result = vkGetQueryPoolResults(device, queryPool, firstQuery(frame), queryCount, timestamps.size() * sizeof(uint64_t),
+            timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS) {
+            slot.scopes.clear();
+            return false;
+        }
+
+        latest.clear();
+        for (size_t i = 0; i < slot.scopes.size(); i++) {
+            uint64_t ticks = ((timestamps[i * 2 + 1] & timestampMask) - (timestamps[i * 2] & timestampMask)) & timestampMask;
+            GpuScopeTiming timing{ slot.scopes[i].name, slot.scopes[i].depth, ticks * static_cast<double>(timestampPeriod) / 1e6 };
+            addToHistory(timing);
+            latest.push_back(timing);
+        }
+        slot.scopes.clear();
+        return true;
+    }
+
+    // resets the slot's queries and opens the frame scope. Must be recorded outside of a render pass
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        if (!isEnabled()) {
+            return;
+        }
+        currentFrame = frame;
+        slots[frame].scopes.clear();
+        openScopes.clear();
+        vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery(frame), 2 * maxScopes);
+        beginScope(commandBuffer, "frame");
+    }
+
+    void endFrame(VkCommandBuffer commandBuffer) {
+        while (!openScopes.empty()) {
+            endScope(commandBuffer);
+        }
+    }
+
+    void beginScope(VkCommandBuffer commandBuffer, const std::string& name) {
+        if (!isEnabled()) {
+            return;
+        }
+        uint32_t scope = reserveScope(name);
+        openScopes.push_back(scope);
+        writeBegin(commandBuffer, scope);
+    }
+
+    void endScope(VkCommandBuffer commandBuffer) {
+        if (!isEnabled() || openScopes.empty()) {
+            return;
+        }
+        uint32_t scope = openScopes.back();
+        openScopes.pop_back();
+        writeEnd(commandBuffer, scope);
+    }
+
+    // For scopes inside secondary command buffers recorded on other threads: reserve them on the thread that records
+    // the primary buffer, nested under parent or else under the scope open there, then write both timestamps from
+    // the recording thread.
+    // Scopes past maxScopes in one frame are dropped rather than overflowing into the next slot's queries
+    uint32_t reserveScope(const std::string& name, uint32_t parent = NO_SCOPE) {
+        if (!isEnabled() || slots[currentFrame].scopes.size() >= maxScopes) {
+            return NO_SCOPE;
+        }
+        Slot& slot = slots[currentFrame];
+        uint32_t depth = parent != NO_SCOPE ? slot.scopes[parent].depth + 1 : static_cast<uint32_t>(openScopes.size());
+        slot.scopes.push_back({ name, depth });
+        return static_cast<uint32_t>(slot.scopes.size() - 1);
+    }
+
+    void writeBegin(VkCommandBuffer commandBuffer, uint32_t scope) const {
+        if (scope != NO_SCOPE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery(currentFrame) + scope * 2);
+        }
+    }
+
+    void writeEnd(VkCommandBuffer commandBuffer, uint32_t scope) const {
+        if (scope != NO_SCOPE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(currentFrame) + scope * 2 + 1);
+        }
+    }
+
+    // scopes of the most recently collected frame, in the order they were opened
+    const std::vector<GpuScopeTiming>& lastFrame() const {
+        return latest;
+    }
+
+    // rolling average of every scope seen so far over the last historyLength frames that contained it
+    std::vector<GpuScopeTiming> averages() const {
+        std::vector<GpuScopeTiming> result;
+        for (const auto& series : history) {
+            result.push_back({ series.name, series.depth, series.sum / std::max<size_t>(series.samples.size(), 1) });
+        }
+        return result;
+    }
+
+    double averageMs(const std::string& name) const {
+        for (const auto& series : history) {
+            if (series.name == name) {
+                return series.sum / std::max<size_t>(series.samples.size(), 1);
+            }
+        }
+        return 0.0;
+    }
+
+    void report(std::ostream& out) const {
+        if (history.empty()) {
+            return;
+        }
+        std::ios format(nullptr);
+        format.copyfmt(out);
+        out << "gpu time, average of the last " << historyLength << " frames:" << std::endl;
+        for (const auto& timing : averages()) {
+            out << "  " << std::string(timing.depth * 2, ' ') << std::left << std::setw(24 - timing.depth * 2) << timing.name
+                << std::right << std::fixed << std::setprecision(3) << std::setw(9) << timing.ms << " ms" << std::endl;
+        }
+        out.copyfmt(format);
+    }
+
+    void destroy() {
+        if (queryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device, queryPool, nullptr);
+        }
+    }
+
+private:
+
+    struct RecordedScope {
+        std::string name;
+        uint32_t depth;
+    };
+
+    struct Slot {
+        std::vector<RecordedScope> scopes;
+    };
+
+    struct Series {
+        std::string name;
+        uint32_t depth;
+        std::vector<double> samples;
+        size_t next = 0;
+        double sum = 0.0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint64_t timestampMask = 0;
+    float timestampPeriod = 1.f;
+    uint32_t maxScopes = DEFAULT_MAX_SCOPES;
+    uint32_t historyLength = DEFAULT_HISTORY;
+
+    std::vector<Slot> slots;
+    uint32_t currentFrame = 0;
+    std::vector<uint32_t> openScopes;
+    std::vector<GpuScopeTiming> latest;
+    // in order of first appearance, which keeps nested scopes below their parent in the report
+    std::vector<Series> history;
+
+    uint32_t firstQuery(uint32_t frame) const {
+        return frame * maxScopes * 2;
+    }
+
+    void addToHistory(const GpuScopeTiming& timing) {
+        auto series = std::find_if(history.begin(), history.end(), [&](const Series& entry) { return entry.name == timing.name; });
+        if (series == history.end()) {
+            history.push_back({ timing.name, timing.depth, {} });
+            series = history.end() - 1;
+        }
+        if (series->samples.size() < historyLength) {
+            series->samples.push_back(timing.ms);
+        }
+        else {
+            series->sum -= series->samples[series->next];
+            series->samples[series->next] = timing.ms;
+            series->next = (series->next + 1) % historyLength;
+        }
+        series->sum += timing.ms;
+    }
+};
+
+#endif
@@ -13,6 +13,9 @@
 #include <limits> 
 #include <algorithm> 
 #include <fstream>
+//Vulkan's clip space depth is [0, 1]. glm only reads this before it is first included, and the frustum planes
+//rely on it
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <array>
 #include <glm/gtc/matrix_transform.hpp>
@@ -20,6 +23,29 @@
 #include <unordered_map>
 #include "camera.h"
 #include "helper.h"
+#include "benchmark.h"
+#include "allocator.h"
+#include "upload.h"
+#include "meshcache.h"
+#include "threadpool.h"
+#include "meshimport.h"
+#include "meshoptimize.h"
+#include "meshsimplify.h"
+#include "uniformring.h"
+#include "pipelinecache.h"
+#include "gpuprofiler.h"
+#include "commandrecorder.h"
+#include "rendergraph.h"
+#include "texturecontainer.h"
+#include "texturecompress.h"
+#include "textureprefetch.h"
+#include "mipgen.h"
+#include "vertexformat.h"
+#include "scene.h"
+#include "shadowcascades.h"
+#include "gpuculling.h"
+#include "bindless.h"
+#include "drawconstants.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -31,7 +57,6 @@
 #define GLFW_INCLUDE_VULKAN
 #define GLFW_EXPOSE_NATIVE_WIN32
 #define GLM_FOURCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
@@ -39,8 +64,13 @@ const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const std::string MODEL_PATH = "model/temp.obj";
+const std::string MODEL_CACHE_PATH = "model/temp.obj.meshcache";
 const std::string TEXTURE_PATH = "texture/viking_room.png";
 const std::string SKYBOX_PATH = "texture/skybox1.jpg";
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+//points from the scene towards the sun, the only light that casts shadows
+const glm::vec3 SUN_DIRECTION = glm::normalize(glm::vec3(0.3f, 1.f, 0.2f));
 
 const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 
@@ -48,6 +78,33 @@ const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+//the bindless descriptor set, needed with or without a window
+const std::vector<const char*> bindlessDeviceExtensions = {
+    VK_KHR_MAINTENANCE_3_EXTENSION_NAME,
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+//block compressed formats for color textures, most preferred first. The built in encoder only writes the BC formats,
+//ASTC containers have to come from an external encoder
+const std::vector<VkFormat> colorTextureFormats = {
+    VK_FORMAT_ASTC_4x4_SRGB_BLOCK,
+    VK_FORMAT_BC7_SRGB_BLOCK,
+    VK_FORMAT_BC1_RGB_SRGB_BLOCK
+};
+
+//enabled when the device has them, nothing depends on them being there
+const std::vector<const char*> optionalDeviceExtensions = {
+    VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
+    //sRGB images with UNORM storage views for compute mip generation, core in 1.1
+    VK_KHR_MAINTENANCE_2_EXTENSION_NAME,
+    //draw counts read from a buffer, so the GPU can decide how many scene draws there are
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+    //passes begin on image views instead of render pass and framebuffer objects, the other two are what it depends on
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME
+};
+
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -118,6 +175,12 @@ struct Vertex {
         return attributeDescriptions;
     }
 
+    //how the packers of vertexformat.h find the attributes
+    static VertexSource source(const Vertex* vertices, size_t count) {
+        return { vertices, static_cast<uint32_t>(count), sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, color),
+            offsetof(Vertex, texCoord), offsetof(Vertex, normal) };
+    }
+
     bool operator==(const Vertex& other) const {
         return pos == other.pos && color == other.color && texCoord == other.texCoord && normal == other.normal;
     }
@@ -131,18 +194,26 @@ struct UniformBufferObject {
     glm::mat4 lightProjection;
     glm::vec3 pos;
     glm::vec3 lightPos;
+    //std140 starts the matrices on the next 16 bytes
+    alignas(16) ShadowCascadeUniforms shadow;
+    //bindless indices: x the material buffer, y the shadow cascades, z their comparison sampler
+    alignas(16) glm::uvec4 resources;
 };
 
 struct Vec3UniformBufferObject {};
 
 glm::vec3 uniformLightPos;
 
+//covers every attribute, operator== compares all of them as well
+inline uint64_t hashVertex(const Vertex& vertex) {
+    static_assert(sizeof(Vertex) == 11 * sizeof(float), "Vertex is expected to be tightly packed floats");
+    return hashFloats(&vertex.pos.x, sizeof(Vertex) / sizeof(float));
+}
+
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^
-                (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-                (hash<glm::vec2>()(vertex.texCoord) << 1);
+            return static_cast<size_t>(hashVertex(vertex));
         }
     };
 }
@@ -202,6 +273,38 @@ const std::vector<uint32_t> shadowDepthIndices = {
     26, 24, 25, 26, 25, 27
 };
 
+//material indices of the scene instances, the cube box fragment shader looks them up in the material buffer
+const uint32_t PLANE_MATERIAL = 0;
+const uint32_t CUBE_MATERIAL = 1;
+const uint32_t MODEL_MATERIAL = 2;
+//the skybox's, it has no instances and gets it through its draw constants
+const uint32_t SKY_MATERIAL = 3;
+
+//a material as the shaders read it (std430), texture and sampler are bindless indices or BINDLESS_NONE
+struct GpuMaterial {
+    glm::vec4 tint;
+    uint32_t textureIndex;
+    uint32_t samplerIndex;
+    uint32_t padding[2] = {};
+};
+
+//the draws with constants of their own, updateUniformBuffer fills them in
+const uint32_t SKY_DRAW = 0;
+const uint32_t OPAQUE_DRAW = 1;
+//one per cascade
+const uint32_t SHADOW_DRAW = 2;
+const uint32_t DRAW_SLOT_COUNT = SHADOW_DRAW + MAX_SHADOW_CASCADES;
+
+//the cube faces of shadowDepthVertices, drawn for the extra scene instances
+const std::vector<uint32_t> sceneCubeIndices = {
+    0, 1, 2, 2, 1, 3,
+    4, 5, 6, 5, 7, 6,
+    8, 10, 9, 9, 10, 11,
+    12, 14, 13, 13, 14, 15,
+    16, 17, 18, 17, 19, 18,
+    20, 22, 21, 21, 22, 23
+};
+
 const std::vector<Vertex> boxVertices = {
     //left
     {{-1.f, -1.f, -1.f}, {1.0f, 0.0f, 0.0f}, {1.0f,0.f}, {1,0,0}},
@@ -307,9 +410,144 @@ float lastX = (float)WIDTH / 2.0;
 float lastY = (float)HEIGHT / 2.0;
 bool firstMouse = true;
 
+//how the objects outside the view are left out of the scene's draws
+enum class CullingMode {
+    None,
+    Cpu,
+    Gpu
+};
+
+struct LaunchOptions {
+    //render into an offscreen target without creating a window, then exit after the benchmark
+    bool headless = false;
+    //upload the textures as RGBA8 with GPU generated mips even where the device samples a compressed format
+    bool uncompressedTextures = false;
+    uint32_t benchmarkFrames = 600;
+    uint32_t warmupFrames = 30;
+    std::string benchmarkOutput = "benchmark.json";
+    //compress the textures into containers for every format the built in encoder supports, then exit
+    bool buildTextures = false;
+    //objects in the scene: the plane plus sceneInstances - 1 cubes
+    uint32_t sceneInstances = 1;
+    //copies of the model placed on the plane next to the cubes
+    uint32_t modelInstances = 0;
+    //how the scene's vertices are stored, see VertexLayout::fromName
+    VertexLayout vertexLayout = VertexLayout::packed();
+    //reordering of the model after deduplication, cached along with it
+    MeshOptimization meshOptimization = MeshOptimization::Overdraw;
+    //levels of detail of the model including the full mesh, 1 draws the full mesh everywhere
+    uint32_t lodLevels = 4;
+    //most pixels a level's simplification error may cover on screen
+    float lodThreshold = 1.f;
+    //GPU frustum and occlusion culling falls back to CPU frustum culling on devices that can't do it
+    CullingMode culling = CullingMode::Gpu;
+    //cascade count, resolution, distance and split of the sun's shadow maps
+    ShadowSettings shadows;
+    //time the frustum culler on this many random objects, then exit
+    uint32_t cullBenchmarkObjects = 0;
+    //per-draw constants as push constants, otherwise always through the uniform ring
+    bool pushConstants = true;
+    //dynamic rendering when the device has it, otherwise render pass and framebuffer objects
+    bool dynamicRendering = true;
+};
+
+LaunchOptions parseLaunchOptions(int argc, char* argv[]) {
+    LaunchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--uncompressed-textures") {
+            options.uncompressedTextures = true;
+        }
+        else if (arg == "--frames" && hasValue) {
+            options.benchmarkFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--warmup" && hasValue) {
+            options.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--benchmark-out" && hasValue) {
+            options.benchmarkOutput = argv[++i];
+        }
+        else if (arg == "--build-textures") {
+            options.buildTextures = true;
+        }
+        else if (arg == "--instances" && hasValue) {
+            options.sceneInstances = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--models" && hasValue) {
+            options.modelInstances = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--vertex-format" && hasValue) {
+            options.vertexLayout = VertexLayout::fromName(argv[++i]);
+        }
+        else if (arg == "--mesh-optimize" && hasValue) {
+            std::string mode = argv[++i];
+            if (mode == "none") {
+                options.meshOptimization = MeshOptimization::None;
+            }
+            else if (mode == "cache") {
+                options.meshOptimization = MeshOptimization::VertexCache;
+            }
+            else if (mode == "overdraw") {
+                options.meshOptimization = MeshOptimization::Overdraw;
+            }
+            else {
+                throw std::runtime_error("unknown mesh optimization: " + mode);
+            }
+        }
+        else if (arg == "--lods" && hasValue) {
+            options.lodLevels = std::clamp(static_cast<uint32_t>(std::stoul(argv[++i])), 1u, SCENE_MAX_LODS);
+        }
+        else if (arg == "--lod-threshold" && hasValue) {
+            options.lodThreshold = std::stof(argv[++i]);
+        }
+        else if (arg == "--shadow-cascades" && hasValue) {
+            options.shadows.cascadeCount = std::clamp(static_cast<uint32_t>(std::stoul(argv[++i])), 1u, MAX_SHADOW_CASCADES);
+        }
+        else if (arg == "--shadow-resolution" && hasValue) {
+            options.shadows.resolution = std::max(16u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+        else if (arg == "--shadow-distance" && hasValue) {
+            options.shadows.distance = std::stof(argv[++i]);
+        }
+        else if (arg == "--shadow-split" && hasValue) {
+            options.shadows.splitLambda = std::clamp(std::stof(argv[++i]), 0.f, 1.f);
+        }
+        else if (arg == "--no-shadow-cache") {
+            options.shadows.cache = false;
+        }
+        else if (arg == "--no-push-constants") {
+            options.pushConstants = false;
+        }
+        else if (arg == "--no-dynamic-rendering") {
+            options.dynamicRendering = false;
+        }
+        else if (arg == "--no-culling") {
+            options.culling = CullingMode::None;
+        }
+        else if (arg == "--cpu-culling") {
+            options.culling = CullingMode::Cpu;
+        }
+        else if (arg == "--cull-benchmark" && hasValue) {
+            options.cullBenchmarkObjects = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else {
+            throw std::runtime_error("unknown or incomplete argument: " + arg);
+        }
+    }
+    return options;
+}
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    //transfer-only family (DMA engine) if the device has one
+    std::optional<uint32_t> transferFamily;
+    //compute family without graphics (async compute) if the device has one
+    std::optional<uint32_t> computeFamily;
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -325,26 +563,63 @@ struct SwapChainSupportDetails {
 class HelloTriangleApplication
 {
 public:
+    HelloTriangleApplication(const LaunchOptions& options = {}) : options(options) {}
+
     void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
+        if (options.buildTextures) {
+            //CPU only, no device needed
+            buildTextureContainers();
+            return;
+        }
+        if (options.cullBenchmarkObjects > 0) {
+            benchmarkFrustumCulling(threadPool, options.cullBenchmarkObjects, std::cout);
+            return;
+        }
+        //decoding and compressing the textures doesn't need a device, let it run while the device is created
+        texturePrefetcher.start(threadPool, { TEXTURE_PATH, SKYBOX_PATH },
+            options.uncompressedTextures ? std::vector<VkFormat>() : colorTextureFormats);
+        if (options.headless) {
+            initVulkan();
+            runBenchmark();
+        }
+        else {
+            initWindow();
+            initVulkan();
+            mainLoop();
+        }
         cleanup();
     }
 
 private:
+    LaunchOptions options;
+
     GLFWwindow* window;
     VkInstance instance;
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
     VkDebugUtilsMessengerEXT debugMessenger;
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
+    DeviceMemoryAllocator allocator;
+    UploadManager uploader;
+    PipelineCacheStore pipelineCache;
+    MipGenerator mipGenerator;
+    SceneDrawList scene;
+    uint32_t opaqueBatch = 0;
+    //batches of objects that move, their shadows are drawn every frame over the cached ones of the static casters.
+    //Nothing in the scene moves yet, so the cascades are drawn straight into the sampled map
+    std::vector<uint32_t> dynamicBatches;
+    std::set<std::string> enabledDeviceExtensions;
+    //the render graph begins its passes with vkCmdBeginRenderingKHR
+    bool dynamicRendering = false;
 
     VkQueue graphicsQueue;
 
     VkSurfaceKHR surface;
 
     VkQueue presentQueue;
+    VkQueue transferQueue;
+    VkQueue computeQueue;
 
     VkSwapchainKHR swapChain;
 
@@ -357,79 +632,86 @@ private:
     std::vector<VkImageView> swapChainImageViews;
 
     VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout skyboxPipelineLayout;
+    //every graphics pipeline: the frame set, the bindless set and the draw constants when they are push constants
     VkPipelineLayout pipelineLayout;
-    VkPipelineLayout boxPipelineLayout;
-    VkPipelineLayout shadowImagePipelineLayout;
-
-    VkRenderPass renderPass;
-    VkRenderPass shadowImageRenderPass;
 
     VkPipeline skyboxPipeline;
     VkPipeline graphicsPipeline;
     VkPipeline boxPipeline;
     VkPipeline shadowImagePipeline;
 
-    std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkFramebuffer shadowImageFramebuffer;
-
     VkCommandPool commandPool;
 
+    //parsed model, only filled when the mesh cache is missing or stale
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    MeshCache modelCache;
+    ThreadPool threadPool;
+    TexturePrefetcher texturePrefetcher;
+    uint32_t modelIndexCount = 0;
 
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    MemoryAllocation vertexBufferMemory;
 
     VkBuffer skyboxVertexBuffer;
-    VkDeviceMemory skyboxVertexBufferMemory;
+    MemoryAllocation skyboxVertexBufferMemory;
 
     VkBuffer cubeboxVertexBuffer;
-    VkDeviceMemory cubeboxVertexBufferMemory;
+    MemoryAllocation cubeboxVertexBufferMemory;
 
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    MemoryAllocation indexBufferMemory;
 
     VkBuffer skyboxIndexBuffer;
-    VkDeviceMemory skyboxIndexBufferMemory;
+    MemoryAllocation skyboxIndexBufferMemory;
+    VkIndexType skyboxIndexType;
 
     VkBuffer cubeboxIndexBuffer;
-    VkDeviceMemory cubeboxIndexBufferMemory;
+    MemoryAllocation cubeboxIndexBufferMemory;
 
     VkBuffer shadowDepthVertexBuffer;
-    VkDeviceMemory shadowDepthVertexBufferMemory;
+    MemoryAllocation shadowDepthVertexBufferMemory;
 
     VkBuffer shadowDepthIndexBuffer;
-    VkDeviceMemory shadowDepthIndexBufferMemory;
-
-    uint32_t mipLevels;
+    MemoryAllocation shadowDepthIndexBufferMemory;
+    VkIndexType shadowDepthIndexType;
 
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    MemoryAllocation textureImageMemory;
     VkImageView textureImageView;
-    VkSampler textureSampler;
+    uint32_t textureSampler;
+    VkFormat textureFormat;
+    uint32_t textureMipLevels;
 
     VkImage skyboxImage;
-    VkDeviceMemory skyboxImageMemory;
+    MemoryAllocation skyboxImageMemory;
     VkImageView skyboxImageView;
-    VkSampler skyboxSampler;
+    uint32_t skyboxSampler;
+    VkFormat skyboxFormat;
+    uint32_t skyboxMipLevels;
 
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-    std::vector<void*> uniformBuffersMapped;
+    //device memory taken by the texture mip chains
+    VkDeviceSize textureBytes = 0;
 
-    std::vector<VkBuffer> lightPosUniformBuffers;
-    std::vector<VkDeviceMemory> lightPosUniformBuffersMemory;
-    std::vector<void*> lightPosUniformBuffersMapped;
+    //per-frame and per-draw uniforms, bound through dynamic offsets
+    UniformRing uniformRing;
+    uint32_t frameUniformOffset = 0;
+    uint32_t lightPosUniformOffset = 0;
+    DrawConstantTable drawConstants;
 
+    //set 0, the same for every frame since the dynamic offsets pick the frame's uniforms
     VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
-    VkDescriptorPool skyboxDescriptorPool;
-    std::vector<VkDescriptorSet> skyboxDescriptorSets;
-    VkDescriptorPool cubeboxDescriptorPool;
-    std::vector<VkDescriptorSet> cubeboxDescriptorSets;
-    VkDescriptorPool shadowImageDescriptorPool;
-    std::vector<VkDescriptorSet> shadowImageDescriptorSets;
+    VkDescriptorSet frameDescriptorSet;
+
+    //set 1, every texture, sampler and storage buffer by index
+    BindlessTable bindless;
+    uint32_t textureIndex = BINDLESS_NONE;
+    uint32_t skyboxTextureIndex = BINDLESS_NONE;
+    uint32_t shadowTextureIndex = BINDLESS_NONE;
+    uint32_t shadowSamplerIndex = BINDLESS_NONE;
+    uint32_t materialBufferIndex = BINDLESS_NONE;
+    VkBuffer materialBuffer;
+    MemoryAllocation materialBufferMemory;
 
     std::vector<VkCommandBuffer> commandBuffers;
 
@@ -438,14 +720,32 @@ private:
     std::vector<VkFence> inFlightFences;
     uint32_t currentFrame = 0;
 
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
-
-    VkImage shadowDepthImage;
-    VkDeviceMemory shadowDepthImageMemory;
-    VkImageView shadowDepthImageView;
-    VkSampler shadowDepthImageSampler;
+    //the sun's cascades, one layer each
+    CascadedShadowMap shadowMap;
+    //shadow casters the cascades kept after culling, this frame
+    uint32_t shadowCasterCount = 0;
+    //static caster layers in the cached map, one per cascade, only with dynamic batches
+    std::vector<RenderGraph::Resource> staticCascadeResources;
+
+    //headless mode renders into this image instead of the swap chain images
+    VkImage offscreenColorImage;
+    MemoryAllocation offscreenColorImageMemory;
+
+    GpuProfiler gpuProfiler;
+    ParallelCommandRecorder commandRecorder;
+
+    //owns the render passes, framebuffers and the depth buffer
+    RenderGraph renderGraph;
+    RenderGraph::Resource backbufferResource;
+    //one per cascade, the layers are written by their own passes
+    std::vector<RenderGraph::Resource> shadowCascadeResources;
+    RenderGraph::Resource depthResource;
+    std::vector<uint32_t> shadowPasses;
+    uint32_t skyPass;
+    uint32_t opaquePass;
+
+    CullingMode cullingMode = CullingMode::None;
+    GpuCuller gpuCuller;
 
     bool framebufferResized = false;
 
@@ -464,42 +764,261 @@ private:
         std::cout << temp.x << " " << temp.y << " " << temp.z << std::endl;
         createInstance();
         setupDebugMessenger();
-        createSurface();
+        if (!options.headless) {
+            createSurface();
+        }
         pickPhysicalDevice();
         createLogicalDevice();
-        createSwapChain();
+        //the VKBase.h wrappers find the device through graphicsBase
+        vulkan::graphicsBase::Base().Device(device);
+        allocator.init(physicalDevice, device);
+        initUploader();
+        pipelineCache.init(physicalDevice, device, PIPELINE_CACHE_PATH, enabledDeviceExtensions.count(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) > 0);
+        createMipGenerator();
+        createCulling();
+        if (options.headless) {
+            createOffscreenTarget();
+        }
+        else {
+            createSwapChain();
+        }
         createImageViews();
-        createRenderPass();
         prepareOffScreen();
+        buildRenderGraph();
+        drawConstants.init(physicalDevice, DRAW_SLOT_COUNT, options.pushConstants);
         createDescriptorSetLayout();
+        createPipelineLayout();
         createTestGraphicsPipeline();
-        createGraphicsPipeline("Shaders/vert.spv", "Shaders/frag.spv", pipelineLayout, graphicsPipeline);
-        createGraphicsPipeline("Shaders/cubeBoxVert.spv", "Shaders/cubeBoxFrag.spv", boxPipelineLayout, boxPipeline);
-        createGraphicsPipeline("Shaders/testVert.spv","Shaders/testFrag.spv", shadowImagePipelineLayout, shadowImagePipeline);
+        createGraphicsPipeline(drawShaderPath("vert"), "Shaders/frag.spv", graphicsPipeline);
+        createGraphicsPipeline(drawShaderPath("cubeBoxVert"), "Shaders/cubeBoxFrag.spv", boxPipeline, true);
+        createGraphicsPipeline(drawShaderPath("testVert"), "Shaders/testFrag.spv", shadowImagePipeline, true, true);
         createCommandPool();
-        createDepthResources();
-        createFramebuffers();
-        createTextureImage(TEXTURE_PATH, textureImage, textureImageMemory);
-        createTextureImage(SKYBOX_PATH, skyboxImage, skyboxImageMemory);
-        createTextureImageView(textureImage, textureImageView);
-        createTextureImageView(skyboxImage, skyboxImageView);
-        createTextureSampler(textureSampler);
-        createTextureSampler(skyboxSampler);
+        commandRecorder.init(&threadPool, findQueueFamilies(physicalDevice).graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+        createRenderGraphResources();
+        createTextureImage(TEXTURE_PATH, textureImage, textureImageMemory, textureFormat, textureMipLevels);
+        createTextureImage(SKYBOX_PATH, skyboxImage, skyboxImageMemory, skyboxFormat, skyboxMipLevels);
+        createTextureImageView(textureImage, textureFormat, textureMipLevels, textureImageView);
+        createTextureImageView(skyboxImage, skyboxFormat, skyboxMipLevels, skyboxImageView);
+        textureSampler = createTextureSampler();
+        skyboxSampler = createTextureSampler();
         loadModel();
+        createScene();
         createVertexBuffer(shadowDepthVertices, shadowDepthVertexBuffer, shadowDepthVertexBufferMemory);
-        createVertexBuffer(vertices, vertexBuffer, vertexBufferMemory);
+        createModelBuffers();
         createVertexBuffer(skyboxVertices, skyboxVertexBuffer, skyboxVertexBufferMemory);
         createVertexBuffer(boxVertices, cubeboxVertexBuffer, cubeboxVertexBufferMemory);
-        createIndexBuffer(shadowDepthIndices, shadowDepthIndexBuffer, shadowDepthIndexBufferMemory);
-        createIndexBuffer(indices, indexBuffer, indexBufferMemory);
-        createIndexBuffer(skyboxIndices, skyboxIndexBuffer, skyboxIndexBufferMemory);
+        shadowDepthIndexType = createPackedIndexBuffer(shadowDepthIndices, shadowDepthIndexBuffer, shadowDepthIndexBufferMemory);
+        skyboxIndexType = createPackedIndexBuffer(skyboxIndices, skyboxIndexBuffer, skyboxIndexBufferMemory);
         createIndexBuffer(boxIndices, cubeboxIndexBuffer, cubeboxIndexBufferMemory);
-        createUnifomBuffers(sizeof(UniformBufferObject), uniformBuffers, uniformBuffersMemory, uniformBuffersMapped);
-        createUnifomBuffers(sizeof(glm::vec3), lightPosUniformBuffers, lightPosUniformBuffersMemory, lightPosUniformBuffersMapped);
+        uniformRing.init(physicalDevice, device, &allocator, MAX_FRAMES_IN_FLIGHT);
         createDescriptorPool();
         createDescriptorSet();
+        createMaterialBuffer();
         createCommandBuffers();
         createSyncObjects();
+        gpuProfiler.init(physicalDevice, device, findQueueFamilies(physicalDevice).graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+
+        //everything above only recorded uploads, wait for all of them in one go
+        uploader.flush();
+        mipGenerator.releaseTransient();
+
+        AllocatorStats memoryStats = allocator.getStats();
+        std::cout << "device memory: " << memoryStats.bytesUsed << " bytes used, " << memoryStats.bytesWasted << " bytes wasted, "
+            << memoryStats.bytesAllocated << " bytes in " << memoryStats.blockCount << " blocks and "
+            << memoryStats.dedicatedAllocationCount << " dedicated allocations" << std::endl;
+        std::cout << "textures: " << textureBytes << " bytes of mip chains" << std::endl;
+        texturePrefetcher.report(std::cout);
+        const MipGeneratorStats& mipStats = mipGenerator.getStats();
+        std::cout << "mip generation: " << mipStats.levelCount << " levels of " << mipStats.imageCount << " images in "
+            << mipStats.dispatchCount << " dispatches" << (uploader.usesComputeQueue() ? " on the async compute queue" : "")
+            << (mipGenerator.usesSubgroupQuads() ? " with subgroup quads" : "") << std::endl;
+
+        SceneDrawStats sceneStats = scene.getStats();
+        std::cout << "scene: " << sceneStats.instanceCount << " instances of " << sceneStats.meshCount << " meshes in "
+            << sceneStats.batchCount << " batches, " << sceneStats.instancedCommandCount << " instanced " << sceneStats.drawPath << " draws unculled, "
+            << (cullingMode == CullingMode::Gpu ? std::string(gpuCuller.compacts() ? "compacting " : "") + "GPU frustum and occlusion culling"
+                : cullingMode == CullingMode::Cpu ? std::string(FrustumCuller::instructionSet()) + " frustum culling" : std::string("no culling")) << std::endl;
+        std::cout << "scene geometry: " << sceneStats.vertexBytes << " bytes of " << sceneStats.vertexStride << " byte vertices, "
+            << sceneStats.indexBytes << " bytes of " << (sceneStats.indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32) << " bit indices, "
+            << sceneStats.lodCount << " levels of detail" << std::endl;
+        std::cout << "shadows: " << shadowMap.cascadeCount() << " cascades of " << shadowMap.resolution() << "x" << shadowMap.resolution()
+            << " out to " << options.shadows.distance << (options.shadows.cache ? ", static casters cached" : "")
+            << (shadowMap.hasDynamicLayer() ? " under a dynamic layer" : "") << std::endl;
+        const BindlessStats& bindlessStats = bindless.getStats();
+        std::cout << "bindless: " << bindlessStats.textureCount << " textures, " << bindlessStats.samplerCount << " samplers ("
+            << bindlessStats.samplersShared << " requests shared), " << bindlessStats.bufferCount << " storage buffers" << std::endl;
+        std::cout << "draw constants: " << sizeof(DrawConstants) << " bytes per draw in "
+            << (drawConstants.usesPushConstants() ? "push constants" : "the uniform ring") << std::endl;
+
+        const RenderGraphStats& graphStats = renderGraph.getStats();
+        std::cout << "render graph: " << graphStats.passCount << " passes, " << graphStats.culledPassCount << " culled, "
+            << graphStats.renderPassCount << (renderGraph.usesDynamicRendering() ? " dynamic rendering passes, " : " render passes, ") << graphStats.barrierCount << " barriers, transient memory "
+            << graphStats.transientBytesAllocated << " of " << graphStats.transientBytesRequested << " bytes after aliasing" << std::endl;
+
+        const PipelineCacheStats& cacheStats = pipelineCache.getStats();
+        std::cout << "pipelines: " << cacheStats.pipelineCount << " created in " << cacheStats.compileMs << " ms, "
+            << cacheStats.cacheHits << " cache hits (" << (cacheStats.hitsFromFeedback ? "creation feedback" : "cache records") << "), "
+            << cacheStats.savedMs << " ms saved, " << cacheStats.loadedBytes << " bytes loaded" << std::endl;
+    }
+
+    void initUploader() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t transferFamily = indices.transferFamily.value_or(indices.graphicsFamily.value());
+        uint32_t computeFamily = indices.computeFamily.value_or(indices.graphicsFamily.value());
+        uploader.init(device, &allocator, indices.graphicsFamily.value(), graphicsQueue, transferFamily, transferQueue, computeFamily, computeQueue);
+    }
+
+    //every object is an instance record plus an indirect command on the GPU, the opaque pass draws them all with
+    //one call per batch
+    void createScene() {
+        scene.init(device, &allocator, options.vertexLayout);
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        auto drawIndexedIndirectCount = enabledDeviceExtensions.count(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) > 0
+            ? (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR") : nullptr;
+        //createLogicalDevice enables both features whenever they are supported
+        scene.setDrawPath(supportedFeatures.multiDrawIndirect, supportedFeatures.drawIndirectFirstInstance,
+            properties.limits.maxDrawIndirectCount, drawIndexedIndirectCount);
+
+        VertexSource cubeVertices = Vertex::source(shadowDepthVertices.data(), shadowDepthVertices.size());
+        uint32_t plane = scene.addMesh(cubeVertices, shadowDepthIndices);
+        uint32_t cube = scene.addMesh(cubeVertices, sceneCubeIndices);
+        //the model comes from the mapped cache or the parsed vectors, createModelBuffers releases both afterwards
+        uint32_t modelMesh = 0;
+        if (options.modelInstances > 0) {
+            VertexSource modelVertices = modelCache.isMapped()
+                ? Vertex::source(static_cast<const Vertex*>(modelCache.vertexData()), modelCache.info().vertexCount)
+                : Vertex::source(vertices.data(), vertices.size());
+            const uint32_t* modelIndices = modelCache.isMapped() ? static_cast<const uint32_t*>(modelCache.indexData()) : indices.data();
+            modelMesh = scene.addMesh(modelVertices, modelIndices, modelIndexCount);
+            createModelLods(modelMesh, modelVertices, modelIndices);
+        }
+
+        opaqueBatch = scene.addBatch();
+        scene.addInstance(opaqueBatch, plane, glm::mat4(1.f), PLANE_MATERIAL);
+
+        //the extra cubes and then the models stand on the plane in one square grid. Each kind is added in one run so
+        //the unculled draws take one instanced command per kind
+        uint32_t cubeCount = options.sceneInstances - 1;
+        uint32_t slotCount = cubeCount + options.modelInstances;
+        uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(slotCount))));
+        float spacing = side > 0 ? 18.f / side : 0.f;
+        float scale = spacing * 0.3f;
+        auto slotPosition = [&](uint32_t slot, float height) {
+            return glm::vec3(-9.f + spacing * (slot % side + 0.5f), -0.5f + height, -9.f + spacing * (slot / side + 0.5f));
+        };
+        for (uint32_t i = 0; i < cubeCount; i++) {
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.f), slotPosition(i, scale)), glm::vec3(scale));
+            scene.addInstance(opaqueBatch, cube, model, CUBE_MATERIAL);
+        }
+        if (options.modelInstances > 0) {
+            //scaled so the bounding sphere fits the cube's footprint, centered over the slot
+            const SceneMesh& mesh = scene.getMesh(modelMesh);
+            float modelScale = mesh.radius > 0.f ? spacing * 0.4f / mesh.radius : 1.f;
+            for (uint32_t i = 0; i < options.modelInstances; i++) {
+                glm::mat4 model = glm::translate(glm::mat4(1.f), slotPosition(cubeCount + i, mesh.radius * modelScale));
+                model = glm::translate(glm::scale(model, glm::vec3(modelScale)), -mesh.center);
+                scene.addInstance(opaqueBatch, modelMesh, model, MODEL_MATERIAL);
+            }
+        }
+
+        //the camera's view and one per shadow cascade
+        scene.upload(uploader, MAX_FRAMES_IN_FLIGHT, 1 + shadowMap.cascadeCount());
+        if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.setScene(scene);
+        }
+    }
+
+    //coarser levels of the model for the instances far from the camera, they index its vertices too
+    void createModelLods(uint32_t mesh, const VertexSource& modelVertices, const uint32_t* modelIndices) {
+        if (options.lodLevels <= 1) {
+            return;
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        LodSettings settings;
+        settings.levelCount = options.lodLevels;
+        std::vector<MeshLod> chain = buildLodChain(modelVertices, modelIndices, modelIndexCount, settings);
+        std::cout << "model levels of detail in "
+            << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms:";
+        for (size_t level = 0; level < chain.size(); level++) {
+            if (level > 0) {
+                scene.addLod(mesh, chain[level].indices, chain[level].error);
+            }
+            std::cout << (level > 0 ? ", " : " ") << chain[level].indices.size() / 3 << " triangles (error " << chain[level].error << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    //GPU culling needs indirect draws and a depth buffer it can sample for the depth pyramid
+    void createCulling() {
+        cullingMode = options.culling;
+        if (cullingMode != CullingMode::Gpu) {
+            return;
+        }
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        VkFormatProperties depthProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, findDepthFormat(), &depthProperties);
+        if (!supportedFeatures.multiDrawIndirect || !supportedFeatures.drawIndirectFirstInstance
+            || !(depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+            cullingMode = CullingMode::Cpu;
+            return;
+        }
+        //the frustum culler on the CPU needs no shaders, so missing modules only cost the occlusion culling
+        std::vector<char> cullCode = readOptionalFile("Shaders/cull.spv");
+        std::vector<char> hizCode = readOptionalFile("Shaders/hiz.spv");
+        if (cullCode.empty() || hizCode.empty()) {
+            std::cout << "culling: Shaders/cull.spv or Shaders/hiz.spv not found, culling on the CPU" << std::endl;
+            cullingMode = CullingMode::Cpu;
+            return;
+        }
+        gpuCuller.init(device, &allocator, pipelineCache, cullCode, hizCode, MAX_FRAMES_IN_FLIGHT);
+    }
+
+    void createMipGenerator() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        bool vulkan11 = instanceApiVersion >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1;
+
+        //the quad shader needs SPIR-V 1.3, so only look for quads on a 1.1 device
+        bool subgroupQuads = false;
+        if (vulkan11) {
+            VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+            subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &subgroupProperties;
+            vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+            subgroupQuads = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+                && (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_QUAD_BIT) && subgroupProperties.subgroupSize >= 4;
+        }
+        bool extendedUsage = vulkan11 || enabledDeviceExtensions.count(VK_KHR_MAINTENANCE_2_EXTENSION_NAME) > 0;
+
+        //without the compute module every texture keeps the blitted mip chain
+        std::vector<char> code = readOptionalFile("Shaders/mipgen.spv");
+        if (code.empty()) {
+            std::cout << "mip generation: Shaders/mipgen.spv not found, blitting the mip chains" << std::endl;
+            return;
+        }
+        std::vector<char> quadCode = subgroupQuads ? readOptionalFile("Shaders/mipgenQuad.spv") : std::vector<char>();
+        mipGenerator.init(physicalDevice, device, pipelineCache, code, quadCode, !quadCode.empty(), extendedUsage);
+    }
+
+    //stands in for the swap chain when running without a window, so the rest of initVulkan stays unchanged
+    void createOffscreenTarget() {
+        swapChainImageFormat = findSupportedFormat({ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+        swapChainExtent = { WIDTH, HEIGHT };
+
+        createImage(swapChainExtent.width, swapChainExtent.height, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            offscreenColorImage, offscreenColorImageMemory);
+
+        swapChainImages = { offscreenColorImage };
     }
 
     void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels){
@@ -511,7 +1030,8 @@ private:
             throw std::runtime_error("texture image format does not support linear blitting!");
         }
 
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        //blits need a graphics queue, so this runs in the graphics half of the current upload batch
+        VkCommandBuffer commandBuffer = uploader.graphicsCommands();
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         barrier.image = image;
@@ -584,11 +1104,73 @@ private:
             0, nullptr,
             0, nullptr,
             1, &barrier);
-
-        endSingleTimeCommands(commandBuffer);
     }
 
     void loadModel() {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        uint64_t sourceHash;
+        if (!hashFile(MODEL_PATH, sourceHash)) {
+            throw std::runtime_error("failed to open model file!");
+        }
+
+        uint32_t optimization = static_cast<uint32_t>(options.meshOptimization);
+        if (modelCache.open(MODEL_CACHE_PATH, sourceHash, sizeof(Vertex), sizeof(uint32_t), optimization)) {
+            modelIndexCount = static_cast<uint32_t>(modelCache.info().indexCount);
+            std::cout << "loaded model from mesh cache in "
+                << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms, ACMR "
+                << modelCache.info().acmr << ", ATVR " << modelCache.info().atvr << std::endl;
+            return;
+        }
+
+        parseModel();
+
+        //the OBJ face order and first seen vertex order are poor for the post-transform cache and for fetching
+        MeshOptimizeStats optimizeStats = optimizeMesh(vertices, indices, options.meshOptimization, [](const Vertex& vertex) { return vertex.pos; });
+        std::cout << "optimized model in " << optimizeStats.ms << " ms: ACMR " << optimizeStats.before.acmr << " -> " << optimizeStats.after.acmr
+            << ", ATVR " << optimizeStats.before.atvr << " -> " << optimizeStats.after.atvr << ", " << optimizeStats.clusterCount << " clusters"
+            << (optimizeStats.overdrawSorted ? " sorted for overdraw" : "") << std::endl;
+        modelIndexCount = static_cast<uint32_t>(indices.size());
+
+        glm::vec3 boundsMin(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+        for (const auto& vertex : vertices) {
+            boundsMin = glm::min(boundsMin, vertex.pos);
+            boundsMax = glm::max(boundsMax, vertex.pos);
+        }
+
+        //a cache that can't be written (e.g. read-only install) only costs the parse on the next launch
+        try {
+            MeshCache::write(MODEL_CACHE_PATH, sourceHash, vertices.data(), vertices.size(), sizeof(Vertex),
+                indices.data(), indices.size(), sizeof(uint32_t), &boundsMin.x, &boundsMax.x,
+                optimization, optimizeStats.after.acmr, optimizeStats.after.atvr);
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+
+        std::cout << "parsed model in "
+            << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+    }
+
+    //uploads straight from the mapped cache when there is one, so a cached model is never copied on the CPU side
+    void createModelBuffers() {
+        if (modelCache.isMapped()) {
+            createVertexBuffer(modelCache.vertexData(), modelCache.vertexBytes(), vertexBuffer, vertexBufferMemory);
+            createIndexBuffer(modelCache.indexData(), modelCache.indexBytes(), indexBuffer, indexBufferMemory);
+            modelCache.close();
+        }
+        else {
+            createVertexBuffer(vertices, vertexBuffer, vertexBufferMemory);
+            createIndexBuffer(indices, indexBuffer, indexBufferMemory);
+            vertices.clear();
+            vertices.shrink_to_fit();
+            indices.clear();
+            indices.shrink_to_fit();
+        }
+    }
+
+    void parseModel() {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
@@ -598,33 +1180,47 @@ private:
             throw std::runtime_error(warn + err);
         }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
+        //all corners of all shapes in file order, the workers split this list into ranges
+        std::vector<tinyobj::index_t> corners;
+        size_t cornerCount = 0;
         for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
+            cornerCount += shape.mesh.indices.size();
+        }
+        corners.reserve(cornerCount);
+        for (const auto& shape : shapes) {
+            corners.insert(corners.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+        }
 
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2],
-                };
+        auto buildVertex = [&](size_t corner) {
+            const tinyobj::index_t& index = corners[corner];
+            Vertex vertex{};
 
+            vertex.pos = {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2],
+            };
+
+            if (index.texcoord_index >= 0) {
                 vertex.texCoord = {
                     attrib.texcoords[2 * index.texcoord_index + 0],
                     1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
                 };
+            }
 
-                vertex.color = {1.f, 1.f, 1.f};
+            if (index.normal_index >= 0) {
+                vertex.normal = {
+                    attrib.normals[3 * index.normal_index + 0],
+                    attrib.normals[3 * index.normal_index + 1],
+                    attrib.normals[3 * index.normal_index + 2],
+                };
+            }
 
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
+            vertex.color = {1.f, 1.f, 1.f};
+            return vertex;
+        };
 
-                indices.push_back(uniqueVertices[vertex]);
-            }
-        }
+        buildIndexedMesh<Vertex>(threadPool, corners.size(), buildVertex, hashVertex, vertices, indices);
     }
 
     bool hasStencilComponent(VkFormat format) {
@@ -652,16 +1248,8 @@ private:
         throw std::runtime_error("failed to find supported format");
     }
 
-    void createDepthResources() {
-        VkFormat depthFormat = findDepthFormat();
-        createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, 
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            depthImage, depthImageMemory);
-        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-        transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-    }
-
-    void createTextureSampler(VkSampler& textureSampler) {
+    //a bindless index, textures with the same filtering share the sampler whatever their mip count
+    uint32_t createTextureSampler() {
         VkSamplerCreateInfo samplerInfo{};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
         samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -682,11 +1270,9 @@ private:
         samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
         //samplerInfo.mipLodBias = 0.f;
         samplerInfo.minLod = 0.f;
-        samplerInfo.maxLod = static_cast<float>(mipLevels);
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-        if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture sampler!");
-        }
+        return bindless.addSampler(samplerInfo);
     }
 
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
@@ -709,48 +1295,189 @@ private:
     }
 
 
-    void createTextureImageView(VkImage textureImage, VkImageView & textureImageView) {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    void createTextureImageView(VkImage textureImage, VkFormat format, uint32_t mipLevels, VkImageView & textureImageView) {
+        textureImageView = createImageView(textureImage, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
     }
 
-    void createTextureImage(std::string path, VkImage& textureImage, VkDeviceMemory& textureImageMemory) {
-        int texWidth, texHeight, texChannels;
-        //stbi_uc* pixels = stbi_load("texture/texture.jpg",&texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+    bool isSampledFormatSupported(VkFormat format) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        return (properties.optimalTilingFeatures & required) == required;
+    }
 
-        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    //prefers a container with pre-built mips in the best compressed format the device samples. Without one the source is
+    //compressed on the CPU (and the container written for the next launch), and if the device samples none of the
+    //formats the encoder knows (or --uncompressed-textures is set), the decoded image is uploaded uncompressed and its
+    //mips are generated on the GPU. The reading, decoding and usually the compression already happened on the thread
+    //pool while the device was created
+    void createTextureImage(std::string path, VkImage& textureImage, MemoryAllocation& textureImageMemory, VkFormat& format, uint32_t& mipLevels) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        PrefetchedTexture prefetched = texturePrefetcher.take(path);
+
+        std::vector<VkFormat> supportedFormats;
+        for (VkFormat candidate : colorTextureFormats) {
+            if (!options.uncompressedTextures && isSampledFormatSupported(candidate)) {
+                supportedFormats.push_back(candidate);
+            }
+        }
+
+        //without the source any container will do, it is all there is
+        for (VkFormat candidate : supportedFormats) {
+            const TextureContainer* container = prefetched.container(candidate);
+            if (!container) {
+                continue;
+            }
+            std::vector<UploadManager::ImageLevel> levels;
+            for (const auto& level : container->mipLevels()) {
+                levels.push_back({ level.data, level.size, level.width, level.height });
+            }
+            format = candidate;
+            mipLevels = static_cast<uint32_t>(levels.size());
+            createCompressedTextureImage(format, container->width(), container->height(), levels, textureImage, textureImageMemory);
 
-        if (!pixels) {
+            std::cout << "loaded " << textureContainerPath(path, format) << " (" << mipLevels << " mips) in "
+                << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+            return;
+        }
+
+        if (!prefetched.hasSource) {
             throw std::runtime_error("failed to load texture image!");
         }
+        //the prefetch only decodes when the compression it guessed at is needed
+        if (prefetched.mips.empty()) {
+            RgbaImage base;
+            if (!loadRgbaImage(path, base)) {
+                throw std::runtime_error("failed to load texture image!");
+            }
+            prefetched.mips.push_back(std::move(base));
+        }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
+        auto target = std::find_if(supportedFormats.begin(), supportedFormats.end(), canCompressTo);
+        if (target != supportedFormats.end()) {
+            uint32_t width = prefetched.mips[0].width;
+            uint32_t height = prefetched.mips[0].height;
+            std::vector<std::vector<uint8_t>> blocks;
+            if (prefetched.compressedFormat == *target) {
+                blocks = std::move(prefetched.compressedLevels);
+            }
+            else {
+                if (prefetched.mips.size() == 1) {
+                    prefetched.mips = buildMipChain(std::move(prefetched.mips[0]), findTextureFormat(*target)->srgb);
+                }
+                for (const RgbaImage& level : prefetched.mips) {
+                    blocks.push_back(compressImage(level, *target, threadPool));
+                }
+            }
 
-        createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+            //a container that can't be written only costs the compression on the next launch
+            try {
+                TextureContainer::write(textureContainerPath(path, *target), *target, width, height, prefetched.sourceHash, blocks);
+            }
+            catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
+
+            std::vector<UploadManager::ImageLevel> levels;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                levels.push_back({ blocks[i].data(), blocks[i].size(), std::max(width >> i, 1u), std::max(height >> i, 1u) });
+            }
+            format = *target;
+            mipLevels = static_cast<uint32_t>(levels.size());
+            createCompressedTextureImage(format, width, height, levels, textureImage, textureImageMemory);
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device, stagingBufferMemory);
+            std::cout << "compressed " << path << " to " << findTextureFormat(format)->tag << " in "
+                << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+            return;
+        }
 
-        stbi_image_free(pixels);
+        const RgbaImage& base = prefetched.mips[0];
+        int texWidth = static_cast<int>(base.width);
+        int texHeight = static_cast<int>(base.height);
+        VkDeviceSize imageSize = base.pixels.size();
 
-        createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-        
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-        copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-        //transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+        format = VK_FORMAT_R8G8B8A8_SRGB;
+        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        //blits are the fallback for devices that can't write the format from a compute shader
+        bool computeMips = mipGenerator.supports(format);
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+            | (computeMips ? mipGenerator.imageUsage() : VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        createImage(texWidth, texHeight, mipLevels, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory,
+            computeMips ? mipGenerator.imageCreateFlags(format) : 0);
 
-        generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+        //the pixels are copied into the staging ring right away, the GPU copy happens when the batch is submitted
+        uploader.uploadImage(textureImage, base.pixels.data(), imageSize, base.width, base.height, mipLevels, 4, computeMips);
+
+        if (computeMips) {
+            mipGenerator.generate(uploader, textureImage, format, base.width, base.height, mipLevels);
+        }
+        else {
+            generateMipmaps(textureImage, format, texWidth, texHeight, mipLevels);
+        }
+        //a full mip chain is a third bigger than the base level
+        textureBytes += imageSize * 4 / 3;
+
+        std::cout << "decoded " << path << (options.uncompressedTextures ? " uncompressed as asked in " : " uncompressed, the device samples none of the compressed formats in ")
+            << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+    }
+
+    //decodes the source and returns every mip level compressed to format
+    std::vector<std::vector<uint8_t>> compressTexture(const std::string& path, VkFormat format, uint32_t& width, uint32_t& height) {
+        RgbaImage base;
+        if (!loadRgbaImage(path, base)) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+        width = base.width;
+        height = base.height;
+
+        std::vector<std::vector<uint8_t>> blocks;
+        for (const RgbaImage& level : buildMipChain(std::move(base), findTextureFormat(format)->srgb)) {
+            blocks.push_back(compressImage(level, format, threadPool));
+        }
+        return blocks;
+    }
+
+    //the levels are complete, so there is nothing to blit: copy them and make the image readable
+    void createCompressedTextureImage(VkFormat format, uint32_t width, uint32_t height, const std::vector<UploadManager::ImageLevel>& levels,
+        VkImage& textureImage, MemoryAllocation& textureImageMemory) {
+        uint32_t mipLevels = static_cast<uint32_t>(levels.size());
+        createImage(width, height, mipLevels, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+
+        uploader.uploadImageLevels(textureImage, levels.data(), mipLevels, mipLevels, findTextureFormat(format)->blockBytes);
+        transitionImageLayout(textureImage, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+
+        for (const auto& level : levels) {
+            textureBytes += level.size;
+        }
+    }
+
+    //--build-textures: the offline step, so the first launch doesn't have to compress anything
+    void buildTextureContainers() {
+        for (const std::string& path : { TEXTURE_PATH, SKYBOX_PATH }) {
+            uint64_t sourceHash;
+            if (!hashFile(path, sourceHash)) {
+                throw std::runtime_error("failed to load texture image!");
+            }
+            for (VkFormat format : colorTextureFormats) {
+                if (!canCompressTo(format)) {
+                    continue;
+                }
+                auto startTime = std::chrono::high_resolution_clock::now();
+                uint32_t width, height;
+                std::vector<std::vector<uint8_t>> blocks = compressTexture(path, format, width, height);
+                std::string containerPath = textureContainerPath(path, format);
+                TextureContainer::write(containerPath, format, width, height, sourceHash, blocks);
+                std::cout << "wrote " << containerPath << " in "
+                    << std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+            }
+        }
     }
 
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-        VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+        VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, VkImageCreateFlags flags = 0) {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -764,416 +1491,195 @@ private:
         imageInfo.usage = usage;
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.flags = 0;
+        imageInfo.flags = flags;
         imageInfo.mipLevels = mipLevels;
 
         if (vkCreateImage(device, &imageInfo, nullptr, &image)) {
             throw std::runtime_error("failed to crate image!");
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
-
-        vkBindImageMemory(device, image, imageMemory, 0);
+        imageMemory = allocator.allocateImage(image, properties, tiling);
     }
 
     void createDescriptorSet() {
-        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
         VkDescriptorSetAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        allocInfo.pSetLayouts = layouts.data();
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
 
-        
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
-        }
-
-        allocInfo.descriptorPool = skyboxDescriptorPool;
-
-        skyboxDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, skyboxDescriptorSets.data()) != VK_SUCCESS) {
+        if (vkAllocateDescriptorSets(device, &allocInfo, &frameDescriptorSet) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate descriptor sets!");
         }
 
-        allocInfo.descriptorPool = cubeboxDescriptorPool;
-
-        cubeboxDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, cubeboxDescriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
-        }
-
-        allocInfo.descriptorPool = shadowImageDescriptorPool;
-        shadowImageDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, shadowImageDescriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
-        }
-
-        //model
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            VkDescriptorBufferInfo bufferInfo1{};
-            bufferInfo1.buffer = lightPosUniformBuffers[i];
-            bufferInfo1.offset = 0;
-            bufferInfo1.range = sizeof(glm::vec3);
-
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = textureImageView;
-            imageInfo.sampler = textureSampler;
-
-            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-            descriptorWrites[0].pImageInfo = nullptr;
-            descriptorWrites[0].pTexelBufferView = nullptr;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
-
-            descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[2].dstSet = descriptorSets[i];
-            descriptorWrites[2].dstBinding = 2;
-            descriptorWrites[2].dstArrayElement = 0;
-            descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[2].descriptorCount = 1;
-            descriptorWrites[2].pBufferInfo = &bufferInfo1;
-            descriptorWrites[2].pImageInfo = nullptr;
-            descriptorWrites[2].pTexelBufferView = nullptr;
-
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
-
-        //skybox
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = skyboxImageView;
-            imageInfo.sampler = skyboxSampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = skyboxDescriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-            descriptorWrites[0].pImageInfo = nullptr;
-            descriptorWrites[0].pTexelBufferView = nullptr;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = skyboxDescriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
-
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
-
-        //cube box
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            VkDescriptorBufferInfo bufferInfo1{};
-            bufferInfo1.buffer = lightPosUniformBuffers[i];
-            bufferInfo1.offset = 0;
-            bufferInfo1.range = sizeof(glm::vec3);
-
-            //VkDescriptorImageInfo imageInfo{};
-            //imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            //imageInfo.imageView = depthImageView;
-            //imageInfo.sampler = depthImageSampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = cubeboxDescriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-            descriptorWrites[0].pImageInfo = nullptr;
-            descriptorWrites[0].pTexelBufferView = nullptr;
-
-            //descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            //descriptorWrites[1].dstSet = cubeboxDescriptorSets[i];
-            //descriptorWrites[1].dstBinding = 1;
-            //descriptorWrites[1].dstArrayElement = 0;
-            //descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; //VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            //descriptorWrites[1].descriptorCount = 1;
-            //descriptorWrites[1].pImageInfo = &imageInfo;
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = cubeboxDescriptorSets[i];
-            descriptorWrites[1].dstBinding = 2;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pBufferInfo = &bufferInfo1;
-            descriptorWrites[1].pImageInfo = nullptr;
-            descriptorWrites[1].pTexelBufferView = nullptr;
-
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
-
-        //shadow depth
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = shadowImageDescriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-            descriptorWrites[0].pImageInfo = nullptr;
-            descriptorWrites[0].pTexelBufferView = nullptr;
-
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
-
-    }
-
+        VkDescriptorBufferInfo bufferInfo = uniformRing.descriptorInfo(sizeof(UniformBufferObject));
+
+        VkDescriptorBufferInfo bufferInfo1 = uniformRing.descriptorInfo(sizeof(glm::vec3));
+
+        VkDescriptorBufferInfo drawBufferInfo = uniformRing.descriptorInfo(sizeof(DrawConstants));
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = frameDescriptorSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+        descriptorWrites[0].pImageInfo = nullptr;
+        descriptorWrites[0].pTexelBufferView = nullptr;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = frameDescriptorSet;
+        descriptorWrites[1].dstBinding = 2;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &bufferInfo1;
+        descriptorWrites[1].pImageInfo = nullptr;
+        descriptorWrites[1].pTexelBufferView = nullptr;
+
+        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2].dstSet = frameDescriptorSet;
+        descriptorWrites[2].dstBinding = DRAW_CONSTANTS_BINDING;
+        descriptorWrites[2].dstArrayElement = 0;
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[2].descriptorCount = 1;
+        descriptorWrites[2].pBufferInfo = &drawBufferInfo;
+        descriptorWrites[2].pImageInfo = nullptr;
+        descriptorWrites[2].pTexelBufferView = nullptr;
+
+        //the draw constants binding only exists without push constants
+        uint32_t writeCount = drawConstants.usesPushConstants() ? 2 : 3;
+        vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
+
+        //the textures go into the bindless set once, the materials and the frame uniforms refer to them by index
+        textureIndex = bindless.addTexture(textureImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        skyboxTextureIndex = bindless.addTexture(skyboxImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        //every cascade with the comparison sampler
+        shadowTextureIndex = bindless.addTexture(shadowMap.getArrayView(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        shadowSamplerIndex = bindless.addSampler(CascadedShadowMap::samplerInfo());
+    }
+
+    void createMaterialBuffer() {
+        std::array<GpuMaterial, 4> materials{};
+        materials[PLANE_MATERIAL] = { glm::vec4(1.f), BINDLESS_NONE, BINDLESS_NONE };
+        materials[CUBE_MATERIAL] = { glm::vec4(0.9f, 0.75f, 0.6f, 1.f), BINDLESS_NONE, BINDLESS_NONE };
+        materials[MODEL_MATERIAL] = { glm::vec4(1.f), textureIndex, textureSampler };
+        materials[SKY_MATERIAL] = { glm::vec4(1.f), skyboxTextureIndex, skyboxSampler };
+
+        VkDeviceSize bufferSize = sizeof(materials);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, materialBuffer, materialBufferMemory);
+        uploader.uploadBuffer(materialBuffer, materials.data(), bufferSize, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        materialBufferIndex = bindless.addStorageBuffer(materialBuffer);
+    }
+
+    //one set for the frame's uniforms, new textures only take slots of the bindless pool
     void createDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 3> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSize.descriptorCount = drawConstants.usesPushConstants() ? 2 : 3;
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
 
         if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool)) {
             throw std::runtime_error("failed to create descriptor pool!");
         }
-
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &skyboxDescriptorPool)) {
-            throw std::runtime_error("failed to create descriptor pool!");
-        }
-
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &cubeboxDescriptorPool)) {
-            throw std::runtime_error("failed to create descriptor pool!");
-        }
-
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &shadowImageDescriptorPool)) {
-            throw std::runtime_error("failed to create descriptor pool!");
-        }
-    }
-
-    void createUnifomBuffers(size_t size, std::vector<VkBuffer>& uniformBuffers, std::vector<VkDeviceMemory>& uniformBuffersMemory, std::vector<void*>& uniformBuffersMapped) {
-        VkDeviceSize bufferSize = size;//sizeof(UniformBufferObject);
-
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
-
-            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
-        }
     }
 
     void createDescriptorSetLayout() {
         VkDescriptorSetLayoutBinding uboLayoutBinding{};
         uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uboLayoutBinding.descriptorCount = 1;
         uboLayoutBinding.pImmutableSamplers = nullptr;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        //the fragment shaders read the shadow cascades from it
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
         VkDescriptorSetLayoutBinding uboLayoutBinding1{};
         uboLayoutBinding1.binding = 2;
-        uboLayoutBinding1.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding1.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uboLayoutBinding1.descriptorCount = 1;
         uboLayoutBinding1.pImmutableSamplers = nullptr;
         uboLayoutBinding1.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-        std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, uboLayoutBinding1 };
+        VkDescriptorSetLayoutBinding drawLayoutBinding{};
+        drawLayoutBinding.binding = DRAW_CONSTANTS_BINDING;
+        drawLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        drawLayoutBinding.descriptorCount = 1;
+        drawLayoutBinding.pImmutableSamplers = nullptr;
+        drawLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        //binding 1 used to be the pass's texture, textures are in the bindless set now
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, uboLayoutBinding1, drawLayoutBinding };
 
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        //the draw constants binding only without push constants
+        layoutInfo.bindingCount = drawConstants.usesPushConstants() ? 2 : 3;
         layoutInfo.pBindings = bindings.data();
 
         if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
-    }
-
-    void createIndexBuffer(std::vector<uint32_t> indices, VkBuffer& indexBuffer, VkDeviceMemory& indexBufferMemory) {
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-    }
-
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = size;
-        bufferInfo.usage = usage;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create vertex buffer!");
-        }
-
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory)) {
-            throw std::runtime_error("failed to allocate vertex buffer memory");
-        }
-
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
-    }
-
-    VkCommandBuffer beginSingleTimeCommands() {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-        return commandBuffer;
+        bindless.init(device, VK_SHADER_STAGE_FRAGMENT_BIT);
     }
 
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-        vkEndCommandBuffer(commandBuffer);
+    //shared by the graphics pipelines, so a pass binds its descriptor sets once whichever pipelines it switches between
+    void createPipelineLayout() {
+        std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, bindless.getLayout() };
+        VkPushConstantRange drawRange = drawConstants.pushConstantRange();
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = drawConstants.usesPushConstants() ? 1 : 0;
+        pipelineLayoutInfo.pPushConstantRanges = &drawRange;
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkBufferCopy copyRegion{};
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    void createIndexBuffer(const std::vector<uint32_t>& indices, VkBuffer& indexBuffer, MemoryAllocation& indexBufferMemory) {
+        createIndexBuffer(indices.data(), sizeof(indices[0]) * indices.size(), indexBuffer, indexBufferMemory);
+    }
 
-        endSingleTimeCommands(commandBuffer);
+    //16 bit indices whenever they fit, bind the buffer with the returned type
+    VkIndexType createPackedIndexBuffer(const std::vector<uint32_t>& indices, VkBuffer& indexBuffer, MemoryAllocation& indexBufferMemory) {
+        PackedIndices packed = PackedIndices::pack(indices);
+        createIndexBuffer(packed.bytes.data(), packed.bytes.size(), indexBuffer, indexBufferMemory);
+        return packed.type;
     }
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    void createIndexBuffer(const void* indexData, VkDeviceSize bufferSize, VkBuffer& indexBuffer, MemoryAllocation& indexBufferMemory) {
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+        uploader.uploadBuffer(indexBuffer, indexData, bufferSize, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    }
 
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent = { width, height, 1 };
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        vkCmdCopyBufferToImage(
-            commandBuffer,
-            buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &region
-        );
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create vertex buffer!");
+        }
 
-        endSingleTimeCommands(commandBuffer);
+        bufferMemory = allocator.allocateBuffer(buffer, properties);
     }
 
+    //recorded into the current upload batch, takes effect once the batch is submitted
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        VkCommandBuffer commandBuffer = uploader.graphicsCommands();
 
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1205,23 +1711,9 @@ private:
             sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
             destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        }else {
-            throw std::runtime_error("unsupported layout transition!");
-        }
-
-        if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-            if (hasStencilComponent(format)) {
-                barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-            }
-        }
         else {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            //attachment layouts are handled by the render graph
+            throw std::runtime_error("unsupported layout transition!");
         }
 
         vkCmdPipelineBarrier(
@@ -1232,137 +1724,117 @@ private:
             0, nullptr,
             1, &barrier
         );
-
-        endSingleTimeCommands(commandBuffer);
     }
 
-    void createVertexBuffer(std::vector<Vertex> vertices, VkBuffer& vertexBuffer, VkDeviceMemory& vertexBufferMemory) {
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-        
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-        
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    void createVertexBuffer(const std::vector<Vertex>& vertices, VkBuffer& vertexBuffer, MemoryAllocation& vertexBufferMemory) {
+        createVertexBuffer(vertices.data(), sizeof(vertices[0]) * vertices.size(), vertexBuffer, vertexBufferMemory);
     }
 
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("failed to find suitable memory type!");
+    void createVertexBuffer(const void* vertexData, VkDeviceSize bufferSize, VkBuffer& vertexBuffer, MemoryAllocation& vertexBufferMemory) {
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+        uploader.uploadBuffer(vertexBuffer, vertexData, bufferSize, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
     }
 
     void cleanupSwapChain() {
-        vkDestroyImageView(device, depthImageView, nullptr);
-        vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
-
-        for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-            vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-        }
+        renderGraph.destroyResources();
+        gpuCuller.destroyResources();
 
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
             vkDestroyImageView(device, swapChainImageViews[i], nullptr);
         }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        if (options.headless) {
+            vkDestroyImage(device, offscreenColorImage, nullptr);
+            allocator.free(offscreenColorImageMemory);
+        }
+        else {
+            vkDestroySwapchainKHR(device, swapChain, nullptr);
+        }
     }
 
     void cleanup() {
 
         cleanupSwapChain();
 
-        vkDestroyFramebuffer(device, shadowImageFramebuffer, nullptr);
-
-        vkDestroySampler(device, textureSampler, nullptr);
         vkDestroyImageView(device, textureImageView, nullptr);
         vkDestroyImage(device, textureImage, nullptr);
-        vkFreeMemory(device, textureImageMemory, nullptr);
+        allocator.free(textureImageMemory);
 
-        vkDestroySampler(device, skyboxSampler, nullptr);
         vkDestroyImageView(device, skyboxImageView, nullptr);
         vkDestroyImage(device, skyboxImage, nullptr);
-        vkFreeMemory(device, skyboxImageMemory, nullptr);
+        allocator.free(skyboxImageMemory);
 
-        vkDestroySampler(device, shadowDepthImageSampler, nullptr);
-        vkDestroyImageView(device, shadowDepthImageView, nullptr);
-        vkDestroyImage(device, shadowDepthImage, nullptr);
-        vkFreeMemory(device, shadowDepthImageMemory, nullptr);
+        shadowMap.destroy();
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-            vkDestroyBuffer(device, lightPosUniformBuffers[i], nullptr);
-            vkFreeMemory(device, lightPosUniformBuffersMemory[i], nullptr);
-        }
+        uniformRing.destroy();
 
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-        vkDestroyDescriptorPool(device, skyboxDescriptorPool, nullptr);
-        vkDestroyDescriptorPool(device, cubeboxDescriptorPool, nullptr);
-        vkDestroyDescriptorPool(device, shadowImageDescriptorPool, nullptr);
 
         vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
+        vkDestroyBuffer(device, materialBuffer, nullptr);
+        allocator.free(materialBufferMemory);
+        bindless.destroy();
+
         vkDestroyBuffer(device, shadowDepthVertexBuffer, nullptr);
-        vkFreeMemory(device, shadowDepthVertexBufferMemory, nullptr);
+        allocator.free(shadowDepthVertexBufferMemory);
         vkDestroyBuffer(device, cubeboxVertexBuffer, nullptr);
-        vkFreeMemory(device, cubeboxVertexBufferMemory, nullptr);
+        allocator.free(cubeboxVertexBufferMemory);
         vkDestroyBuffer(device, skyboxVertexBuffer, nullptr);
-        vkFreeMemory(device, skyboxVertexBufferMemory, nullptr);
+        allocator.free(skyboxVertexBufferMemory);
         vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
+        allocator.free(vertexBufferMemory);
 
         vkDestroyBuffer(device, shadowDepthIndexBuffer, nullptr);
-        vkFreeMemory(device, shadowDepthIndexBufferMemory, nullptr);
+        allocator.free(shadowDepthIndexBufferMemory);
         vkDestroyBuffer(device, cubeboxIndexBuffer, nullptr);
-        vkFreeMemory(device, cubeboxIndexBufferMemory, nullptr);
+        allocator.free(cubeboxIndexBufferMemory);
         vkDestroyBuffer(device, skyboxIndexBuffer, nullptr);
-        vkFreeMemory(device, skyboxIndexBufferMemory, nullptr);
+        allocator.free(skyboxIndexBufferMemory);
         vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+        allocator.free(indexBufferMemory);
+
+        scene.destroy();
 
         vkDestroyPipeline(device, shadowImagePipeline, nullptr);
-        vkDestroyPipelineLayout(device, shadowImagePipelineLayout, nullptr);
         vkDestroyPipeline(device, boxPipeline, nullptr);
-        vkDestroyPipelineLayout(device, boxPipelineLayout, nullptr);
         vkDestroyPipeline(device, skyboxPipeline, nullptr);
-        vkDestroyPipelineLayout(device, skyboxPipelineLayout, nullptr);
         vkDestroyPipeline(device, graphicsPipeline, nullptr);
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
-        vkDestroyRenderPass(device, shadowImageRenderPass, nullptr);
+        renderGraph.destroy();
+        if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.destroy();
+        }
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
             vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
             vkDestroyFence(device, inFlightFences[i], nullptr);
         }
+
+        gpuProfiler.destroy();
         
+        commandRecorder.destroy();
         vkDestroyCommandPool(device, commandPool, nullptr);
 
+        mipGenerator.destroy();
+        pipelineCache.save();
+        pipelineCache.destroy();
+
+        uploader.destroy();
+        allocator.destroy();
+
         vkDestroyDevice(device, nullptr);
 
         if (enableValidationLayers) {
             DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
         }
 
+        if (options.headless) {
+            vkDestroyInstance(instance, nullptr);
+            return;
+        }
+
         vkDestroySurfaceKHR(instance, surface, nullptr);
 
         vkDestroyInstance(instance, nullptr);
@@ -1421,242 +1893,130 @@ private:
         }
     }
 
+    //the shadow map has a resolution of its own, independent of the window
     void prepareOffScreen() {
-        //create image
-        //VkImage temp;
-        VkImageCreateInfo imageInfo{};
-        VkFormat depthFormat = findDepthFormat();
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = WIDTH;
-        imageInfo.extent.height = HEIGHT;
-        imageInfo.extent.depth = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.format = VK_FORMAT_D16_UNORM;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-
-        if (vkCreateImage(device, &imageInfo, nullptr, &shadowDepthImage)) {
-            throw std::runtime_error("failed to crate image!");
+        shadowMap.init(device, &allocator, VK_FORMAT_D16_UNORM, options.shadows, !dynamicBatches.empty());
+        //the render graph expects them in their resting layouts from the first frame on, cached layers are kept
+        shadowMap.recordInitialLayouts(uploader.graphicsCommands());
+    }
+
+    //every pass declares the images it draws into, the graph derives render passes, layouts and barriers from that
+    void buildRenderGraph() {
+        renderGraph.init(device, &allocator);
+        if (dynamicRendering) {
+            renderGraph.setDynamicRendering((PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"),
+                (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+        }
+
+        //without a swap chain there is nothing to present, leave the image ready for readback instead
+        RenderGraphImageState backbufferFinal{ options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0 };
+        //the acquire semaphore is waited on at the color attachment output stage
+        backbufferResource = renderGraph.importImage("backbuffer", { swapChainImageFormat },
+            { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 }, backbufferFinal);
+
+        //the shadow map outlives the frame, so it is imported and left readable by fragment shaders. Each cascade is
+        //its own layer, so the graph tracks them one by one
+        RenderGraphImageState shadowMapState{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT };
+        shadowCascadeResources.clear();
+        for (uint32_t cascade = 0; cascade < shadowMap.cascadeCount(); cascade++) {
+            shadowCascadeResources.push_back(renderGraph.importImage("shadowCascade" + std::to_string(cascade),
+                { shadowMap.getFormat(), { shadowMap.resolution(), shadowMap.resolution() }, cascade }, shadowMapState, shadowMapState));
+        }
+        //the cached static casters are only ever copied from between frames
+        RenderGraphImageState staticCascadeState{ VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0 };
+        staticCascadeResources.clear();
+        for (uint32_t cascade = 0; cascade < shadowMap.cascadeCount() && shadowMap.hasDynamicLayer(); cascade++) {
+            staticCascadeResources.push_back(renderGraph.importImage("staticShadowCascade" + std::to_string(cascade),
+                { shadowMap.getFormat(), { shadowMap.resolution(), shadowMap.resolution() }, cascade }, staticCascadeState, staticCascadeState));
+        }
+
+        depthResource = renderGraph.createImage("depth", { findDepthFormat() });
+        //the culled commands live in the culler's per frame buffers, the graph only orders the accesses to them
+        RenderGraph::Resource earlyCommands = renderGraph.importBuffer("earlyCommands", VK_NULL_HANDLE);
+        RenderGraph::Resource lateCommands = renderGraph.importBuffer("lateCommands", VK_NULL_HANDLE);
+        bool gpuCulling = cullingMode == CullingMode::Gpu;
+
+        //the static casters are only drawn into cascades whose projection changed. With dynamic batches they go into
+        //their own image, which is copied under the moving casters every frame
+        shadowPasses.clear();
+        for (uint32_t cascade = 0; cascade < shadowMap.cascadeCount(); cascade++) {
+            RenderGraph::Resource staticTarget = shadowMap.hasDynamicLayer() ? staticCascadeResources[cascade] : shadowCascadeResources[cascade];
+            shadowPasses.push_back(renderGraph.addPass("shadow" + std::to_string(cascade))
+                .depth(staticTarget, RenderGraph::LoadOp::Clear)
+                .condition([this, cascade]() { return shadowMap.isDirty(cascade); })
+                .record([this, cascade](VkCommandBuffer commandBuffer) { recordShadowPass(commandBuffer, cascade, { opaqueBatch }); })
+                .index());
+            if (shadowMap.hasDynamicLayer()) {
+                renderGraph.addPass("shadowCopy" + std::to_string(cascade))
+                    .copySource(staticTarget)
+                    .copyDestination(shadowCascadeResources[cascade])
+                    .record([this, cascade](VkCommandBuffer commandBuffer) { shadowMap.recordCopy(commandBuffer, cascade); });
+                renderGraph.addPass("shadowDynamic" + std::to_string(cascade))
+                    .depth(shadowCascadeResources[cascade], RenderGraph::LoadOp::Load)
+                    .record([this, cascade](VkCommandBuffer commandBuffer) { recordShadowPass(commandBuffer, cascade, dynamicBatches); });
+            }
         }
-
-        //allocate and bind the memory
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, shadowDepthImage, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &shadowDepthImageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
+        //objects visible against the previous frame's depth pyramid
+        if (gpuCulling) {
+            renderGraph.addPass("cullEarly")
+                .writeBuffer(earlyCommands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+                .record([this](VkCommandBuffer commandBuffer) { gpuCuller.recordEarly(commandBuffer, currentFrame); });
+        }
+        skyPass = renderGraph.addPass("sky")
+            .color(backbufferResource, RenderGraph::LoadOp::Clear, { {0.f,0.f,0.f,1.f} })
+            .depth(depthResource, RenderGraph::LoadOp::Clear)
+            .record([this](VkCommandBuffer commandBuffer) { recordSkyPass(commandBuffer); })
+            .index();
+        RenderGraph::PassBuilder opaque = renderGraph.addPass("opaque")
+            .color(backbufferResource, RenderGraph::LoadOp::Load)
+            .depth(depthResource, RenderGraph::LoadOp::Load)
+            .record([this](VkCommandBuffer commandBuffer) { recordOpaquePass(commandBuffer); });
+        for (RenderGraph::Resource cascade : shadowCascadeResources) {
+            opaque.sampled(cascade);
+        }
+        if (gpuCulling) {
+            opaque.readBuffer(earlyCommands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        }
+        opaquePass = opaque.index();
+        //rebuild the pyramid from this frame's depth and draw what the early cull hid wrongly
+        if (gpuCulling) {
+            renderGraph.addPass("hiz")
+                .sampled(depthResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+                .sideEffects()
+                .record([this](VkCommandBuffer commandBuffer) { gpuCuller.recordPyramid(commandBuffer); });
+            renderGraph.addPass("cullLate")
+                .writeBuffer(lateCommands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+                .record([this](VkCommandBuffer commandBuffer) { gpuCuller.recordLate(commandBuffer, currentFrame); });
+            RenderGraph::PassBuilder opaqueLate = renderGraph.addPass("opaqueLate")
+                .color(backbufferResource, RenderGraph::LoadOp::Load)
+                .depth(depthResource, RenderGraph::LoadOp::Load)
+                .readBuffer(lateCommands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+                .record([this](VkCommandBuffer commandBuffer) { recordOpaqueLatePass(commandBuffer); });
+            for (RenderGraph::Resource cascade : shadowCascadeResources) {
+                opaqueLate.sampled(cascade);
+            }
         }
 
-        vkBindImageMemory(device, shadowDepthImage, shadowDepthImageMemory, 0);
-
-        //create image view
-        VkImageViewCreateInfo viewInfo{};
-        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.image = shadowDepthImage;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_D16_UNORM;
-        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;//VK_IMAGE_ASPECT_COLOR_BIT;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
+        renderGraph.compile();
+    }
 
-        if (vkCreateImageView(device, &viewInfo, nullptr, &shadowDepthImageView)) {
-            throw std::runtime_error("failed to create texture image view!");
+    //everything that depends on the swap chain size
+    void createRenderGraphResources() {
+        renderGraph.setImportedImages(backbufferResource, swapChainImages, swapChainImageViews);
+        for (uint32_t cascade = 0; cascade < shadowMap.cascadeCount(); cascade++) {
+            renderGraph.setImportedImages(shadowCascadeResources[cascade], { shadowMap.getImage() }, { shadowMap.layerView(cascade) });
         }
-
-        //create sampler
-        VkSamplerCreateInfo samplerInfo{};
-        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
-        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        samplerInfo.mipLodBias = 0.0f;
-        samplerInfo.maxAnisotropy = 1.0f;
-        samplerInfo.minLod = 0.0f;
-        samplerInfo.maxLod = 1.0f;
-        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-
-        VkPhysicalDeviceProperties properties{};
-        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
-
-        if (vkCreateSampler(device, &samplerInfo, nullptr, &shadowDepthImageSampler) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture sampler!");
-        }
-
-        //create renderpass
-        VkAttachmentDescription attachmentDescription{};
-        attachmentDescription.format = VK_FORMAT_D16_UNORM;
-        attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-        attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;							
-        attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;						
-        attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;					
-        attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-
-        VkAttachmentReference depthReference = {};
-        depthReference.attachment = 0;
-        depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 0;													
-        subpass.pDepthStencilAttachment = &depthReference;
-
-        std::array<VkSubpassDependency, 2> dependencies;
-
-        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependencies[0].dstSubpass = 0;
-        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-        dependencies[1].srcSubpass = 0;
-        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-        VkRenderPassCreateInfo renderPassCreateInfo{};
-        renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassCreateInfo.attachmentCount = 1;
-        renderPassCreateInfo.pAttachments = &attachmentDescription;
-        renderPassCreateInfo.subpassCount = 1;
-        renderPassCreateInfo.pSubpasses = &subpass;
-        renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-        renderPassCreateInfo.pDependencies = dependencies.data();
-
-        if (vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &shadowImageRenderPass) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
-        }
-
-        //create framebuffer
-        VkFramebufferCreateInfo fbufCreateInfo{};
-        fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        fbufCreateInfo.renderPass = shadowImageRenderPass;
-        fbufCreateInfo.attachmentCount = 1;
-        fbufCreateInfo.pAttachments = &shadowDepthImageView;
-        fbufCreateInfo.width = WIDTH;
-        fbufCreateInfo.height = HEIGHT;
-        fbufCreateInfo.layers = 1;
-
-        if (vkCreateFramebuffer(device, &fbufCreateInfo, nullptr, &shadowImageFramebuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
-    }
-
-    void createFramebuffers(){
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            //VkImageView attachments[] = {swapChainImageViews[i]};
-
-            std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageView};
-
-            VkFramebufferCreateInfo framebufferInfo = {};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
-
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
+        for (uint32_t cascade = 0; cascade < staticCascadeResources.size(); cascade++) {
+            renderGraph.setImportedImages(staticCascadeResources[cascade], { shadowMap.getStaticImage() }, { shadowMap.staticLayerView(cascade) });
         }
-    }
-
-    void createRenderPass() {
-        VkAttachmentDescription depthAttachment{};
-        depthAttachment.format = findDepthFormat();
-        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference depthAttachmentRef{};
-        depthAttachmentRef.attachment = 1;
-        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
-        subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-        std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        renderPassInfo.pAttachments = attachments.data();
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-        dependency.srcAccessMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
-
-        if (vkCreateRenderPass(device,&renderPassInfo,nullptr,&renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
+        renderGraph.createResources(swapChainExtent);
+        if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.createResources(renderGraph.image(depthResource), findDepthFormat(), swapChainExtent);
         }
     }
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-        VkCommandBufferBeginInfo beginInfo{};
-
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0;
-        beginInfo.pInheritanceInfo = nullptr;
-
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
-
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = { {0.f,0.f,0.f,1.f} };
-        clearValues[1].depthStencil = { 1.0f,0 };
-
+    void setFrameViewport(VkCommandBuffer commandBuffer) {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -1669,109 +2029,112 @@ private:
         scissor.offset = { 0, 0 };
         scissor.extent = swapChainExtent;
 
-        //recreate another renderpass for depth texture
-        VkRenderPassBeginInfo depthTextureRenderPassInfo{};
-        depthTextureRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        depthTextureRenderPassInfo.renderPass = shadowImageRenderPass;
-        depthTextureRenderPassInfo.framebuffer = shadowImageFramebuffer;
-        depthTextureRenderPassInfo.renderArea.offset = { 0,0 };
-        depthTextureRenderPassInfo.renderArea.extent = swapChainExtent;
-
-        depthTextureRenderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        depthTextureRenderPassInfo.pClearValues = clearValues.data();
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
 
-        //begin to create shadow image
-        vkCmdBeginRenderPass(commandBuffer, &depthTextureRenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    //the pass recorders run on the thread pool, they only read what drawFrame prepared
+    //the frame's uniforms and the bindless set, once per pass: every graphics pipeline has the same layout
+    void bindFrameDescriptors(VkCommandBuffer commandBuffer, uint32_t drawSlot) {
+        //in binding order: frame uniforms (binding 0), light position (binding 2), draw constants (binding 3) if there
+        std::array<uint32_t, 3> dynamicOffsets = { frameUniformOffset, lightPosUniformOffset, drawConstants.uniformOffset(drawSlot) };
+        uint32_t offsetCount = drawConstants.usesPushConstants() ? 2 : 3;
+        std::array<VkDescriptorSet, 2> descriptorSets = { frameDescriptorSet, bindless.getSet() };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()),
+            descriptorSets.data(), offsetCount, dynamicOffsets.data());
+        if (drawConstants.usesPushConstants()) {
+            drawConstants.push(commandBuffer, pipelineLayout, drawSlot);
+        }
+    }
 
+    //the casters of the batches the cascade's culling kept, at the shadow map's resolution
+    void recordShadowPass(VkCommandBuffer commandBuffer, uint32_t cascade, const std::vector<uint32_t>& batches) {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowImagePipeline);
 
-        VkBuffer shadowVertexBuffer[] = {shadowDepthVertexBuffer};
-        VkDeviceSize shadowOffsets[] = { 0 };
-
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, shadowVertexBuffer, shadowOffsets);
-
-        vkCmdBindIndexBuffer(commandBuffer, shadowDepthIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        scene.bindGeometry(commandBuffer);
 
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(shadowMap.resolution());
+        viewport.height = static_cast<float>(shadowMap.resolution());
+        viewport.maxDepth = 1.0f;
+        VkRect2D scissor{};
+        scissor.extent = { shadowMap.resolution(), shadowMap.resolution() };
         vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowImagePipelineLayout, 0, 1, &shadowImageDescriptorSets[currentFrame], 0, nullptr);
+        bindFrameDescriptors(commandBuffer, SHADOW_DRAW + cascade);
 
-        vkCmdEndRenderPass(commandBuffer);
-
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0,0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+        //view 0 of the scene is the camera, the cascades follow
+        for (uint32_t batch : batches) {
+            scene.draw(commandBuffer, currentFrame, batch, 1 + cascade);
+        }
+    }
 
+    void recordSkyPass(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline);
 
-        //VkClearValue clearColor = {{{0.f,0.f,0.f,1.f}}};
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
+        VkBuffer vertexBuffers[] = { skyboxVertexBuffer };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-        vkCmdBeginRenderPass(commandBuffer,&renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindIndexBuffer(commandBuffer, skyboxIndexBuffer, 0, skyboxIndexType);
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        setFrameViewport(commandBuffer);
 
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        bindFrameDescriptors(commandBuffer, SKY_DRAW);
 
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(skyboxIndices.size()), 1, 0, 0, 0);
+    }
 
-        //VkViewport viewport{};
-        //viewport.x = 0.0f;
-        //viewport.y = 0.0f;
-        //viewport.width = (float)swapChainExtent.width;
-        //viewport.height = (float)swapChainExtent.height;
-        //viewport.minDepth = 0.0f;
-        //viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer,0,1,&viewport);
+    //the model and the cube
+    void recordOpaquePass(VkCommandBuffer commandBuffer) {
+        //draw the scene: one indirect draw for the visible objects of the batch, however many there are
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boxPipeline);
 
-        //VkRect2D scissor{};
-        //scissor.offset = { 0, 0 };
-        //scissor.extent = swapChainExtent;
-        vkCmdSetScissor(commandBuffer,0,1,&scissor);
+        scene.bindGeometry(commandBuffer);
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+        setFrameViewport(commandBuffer);
 
-        //draw model
-        
-        //vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-        //vkCmdDrawIndexed(commandBuffer,static_cast<uint32_t>(indices.size()),1,0,0,0);
+        bindFrameDescriptors(commandBuffer, OPAQUE_DRAW);
 
-        //draw skybox
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline);
+        if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.drawEarly(commandBuffer, currentFrame, opaqueBatch);
+        }
+        else {
+            scene.draw(commandBuffer, currentFrame, opaqueBatch);
+        }
+    }
 
-        vertexBuffers[0] = skyboxVertexBuffer;
+    //the objects the early cull took for occluded but this frame's depth shows
+    void recordOpaqueLatePass(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boxPipeline);
 
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        scene.bindGeometry(commandBuffer);
 
-        vkCmdBindIndexBuffer(commandBuffer, skyboxIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        setFrameViewport(commandBuffer);
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipelineLayout, 0, 1, &skyboxDescriptorSets[currentFrame], 0, nullptr);
+        bindFrameDescriptors(commandBuffer, OPAQUE_DRAW);
 
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(skyboxIndices.size()), 1, 0, 0, 0);
+        gpuCuller.drawLate(commandBuffer, currentFrame, opaqueBatch);
+    }
 
-        //draw cube
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boxPipeline);
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkCommandBufferBeginInfo beginInfo{};
 
-        //vertexBuffers[0] = cubeboxVertexBuffer;
-        vertexBuffers[0] = shadowDepthVertexBuffer;
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = 0;
+        beginInfo.pInheritanceInfo = nullptr;
 
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
 
-        //vkCmdBindIndexBuffer(commandBuffer, cubeboxIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindIndexBuffer(commandBuffer, shadowDepthIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        gpuProfiler.beginFrame(commandBuffer, currentFrame);
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boxPipelineLayout, 0, 1, &cubeboxDescriptorSets[currentFrame], 0, nullptr);
+        //passes are recorded in parallel into secondary buffers, the graph stitches them together with its barriers
+        renderGraph.execute(commandBuffer, imageIndex, currentFrame, commandRecorder, &gpuProfiler);
 
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(shadowDepthIndices.size()), 1, 0, 0, 0);
-        
-        vkCmdEndRenderPass(commandBuffer);
+        gpuProfiler.endFrame(commandBuffer);
 
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer!");
@@ -1862,6 +2225,12 @@ private:
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
         std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value() };
+        if (indices.transferFamily.has_value()) {
+            uniqueQueueFamilies.insert(indices.transferFamily.value());
+        }
+        if (indices.computeFamily.has_value()) {
+            uniqueQueueFamilies.insert(indices.computeFamily.value());
+        }
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -1873,8 +2242,17 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        //block compressed textures, whichever families the device has
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+        deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+        //indirect scene draws, SceneDrawList falls back to direct draws without them
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -1882,10 +2260,43 @@ private:
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+        //what the bindless set relies on, isDeviceSuitable checked for it. The shaders index the texture, sampler and
+        //material arrays with values from a buffer, which needs the core dynamic indexing features too
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
         createInfo.pEnabledFeatures = &deviceFeatures;
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = BindlessTable::requiredFeatures();
+        createInfo.pNext = &indexingFeatures;
+
+        std::vector<const char*> extensions = getRequiredDeviceExtensions();
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        for (const char* optional : optionalDeviceExtensions) {
+            for (const auto& extension : availableExtensions) {
+                if (strcmp(optional, extension.extensionName) == 0) {
+                    extensions.push_back(optional);
+                    break;
+                }
+            }
+        }
+        enabledDeviceExtensions = std::set<std::string>(extensions.begin(), extensions.end());
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        //the extension alone isn't enough, the feature has to be there and switched on too
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        dynamicRendering = options.dynamicRendering && enabledDeviceExtensions.count(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) > 0;
+        if (dynamicRendering) {
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &dynamicRenderingFeatures;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+            dynamicRendering = dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+            indexingFeatures.pNext = dynamicRendering ? &dynamicRenderingFeatures : nullptr;
+        }
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 
         if (enableValidationLayers) {
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -1901,6 +2312,8 @@ private:
 
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value_or(indices.graphicsFamily.value()), 0, &transferQueue);
+        vkGetDeviceQueue(device, indices.computeFamily.value_or(indices.graphicsFamily.value()), 0, &computeQueue);
     }
 
     bool checkValidationLayerSupport() {
@@ -1946,8 +2359,22 @@ private:
         return buffer;
     }
 
+    //for modules a feature can do without: empty when the file isn't there, so the caller can fall back
+    static std::vector<char> readOptionalFile(const std::string& filename) {
+        if (!std::ifstream(filename, std::ios::binary).is_open()) {
+            return {};
+        }
+        return readFile(filename);
+    }
+
+    //the vertex shaders read their draw constants from push constants, or from the uniform ring in the variant
+    //compiled with DRAW_CONSTANTS_IN_UNIFORM
+    std::string drawShaderPath(const std::string& name) {
+        return "Shaders/" + name + (drawConstants.usesPushConstants() ? "" : "Uniform") + ".spv";
+    }
+
     void createTestGraphicsPipeline() {
-        auto vertShaderCode = readFile("Shaders/skyboxVert.spv");
+        auto vertShaderCode = readFile(drawShaderPath("skyboxVert"));
         auto fragShaderCode = readFile("Shaders/skyboxFrag.spv");
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
@@ -2062,17 +2489,6 @@ private:
         colorBlending.blendConstants[2] = 0.f;
         colorBlending.blendConstants[3] = 0.f;
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &skyboxPipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
-
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineInfo.stageCount = 2;
@@ -2087,25 +2503,26 @@ private:
         pipelineInfo.pColorBlendState = &colorBlending;
         pipelineInfo.pDynamicState = &dynamicState;
 
-        pipelineInfo.layout = skyboxPipelineLayout;
+        pipelineInfo.layout = pipelineLayout;
 
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        renderGraph.setPipelineTarget(pipelineInfo, opaquePass);
 
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
         pipelineInfo.pDepthStencilState = &depthStencil;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &skyboxPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
+        pipelineCache.createGraphicsPipeline("skybox", pipelineInfo, &skyboxPipeline);
 
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
     }
 
-    void createGraphicsPipeline(std::string vertShaderPath, std::string fragShaderPath, VkPipelineLayout& pipelineLayout, VkPipeline& graphicsPipeline) {
+    //instanced pipelines draw the scene: its packed vertices at binding 0 and the instance stream at binding 1
+    //shadowCaster pipelines draw the scene into the cascade their draw constants name: no color and depth bias against
+    //acne
+    void createGraphicsPipeline(std::string vertShaderPath, std::string fragShaderPath, VkPipeline& graphicsPipeline,
+        bool instanced = false, bool shadowCaster = false) {
 
         auto vertShaderCode = readFile(vertShaderPath.c_str());
         auto fragShaderCode = readFile(fragShaderPath.c_str());
@@ -2119,6 +2536,14 @@ private:
         vertShaderStageInfo.module = vertShaderModule;
         vertShaderStageInfo.pName = "main";
 
+        //constant 0 tells the scene's vertex shader to unfold octahedral normals
+        VkBool32 octahedralNormals = options.vertexLayout.octahedralNormals();
+        VkSpecializationMapEntry specializationEntry{ 0, 0, sizeof(VkBool32) };
+        VkSpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(VkBool32), &octahedralNormals };
+        if (instanced) {
+            vertShaderStageInfo.pSpecializationInfo = &specializationInfo;
+        }
+
         VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
         fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -2129,13 +2554,20 @@ private:
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        auto vertexAttributes = Vertex::getAttributeDescriptions();
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions = { Vertex::getBindingDescription() };
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+        if (instanced) {
+            auto instanceAttributes = SceneInstance::getAttributeDescriptions();
+            bindingDescriptions = { options.vertexLayout.getBindingDescription(), SceneInstance::getBindingDescription() };
+            attributeDescriptions = options.vertexLayout.getAttributeDescriptions();
+            attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+        }
 
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
         vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
         vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -2189,10 +2621,10 @@ private:
         rasterizer.rasterizerDiscardEnable = VK_FALSE;
         rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
         rasterizer.lineWidth = 1.f;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.f;
+        rasterizer.depthBiasEnable = shadowCaster ? VK_TRUE : VK_FALSE;
+        rasterizer.depthBiasConstantFactor = shadowCaster ? 1.25f : 0.f;
         rasterizer.depthBiasClamp = 0.f;
-        rasterizer.depthBiasSlopeFactor = 0.f;
+        rasterizer.depthBiasSlopeFactor = shadowCaster ? 1.75f : 0.f;
         //rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
         //rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
         rasterizer.cullMode = VK_CULL_MODE_NONE;
@@ -2215,24 +2647,13 @@ private:
         colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
         colorBlending.logicOpEnable = VK_FALSE;
         colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
+        colorBlending.attachmentCount = shadowCaster ? 0 : 1;
         colorBlending.pAttachments = &colorBlendAttachment;
         colorBlending.blendConstants[0] = 0.f;
         colorBlending.blendConstants[1] = 0.f;
         colorBlending.blendConstants[2] = 0.f;
         colorBlending.blendConstants[3] = 0.f;
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
-
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineInfo.stageCount = 2;
@@ -2249,17 +2670,14 @@ private:
 
         pipelineInfo.layout = pipelineLayout;
 
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        renderGraph.setPipelineTarget(pipelineInfo, shadowCaster ? shadowPasses.front() : opaquePass);
 
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
         pipelineInfo.pDepthStencilState = &depthStencil;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
+        pipelineCache.createGraphicsPipeline(vertShaderPath + "|" + fragShaderPath, pipelineInfo, &graphicsPipeline);
 
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
@@ -2385,9 +2803,9 @@ private:
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
+        bool swapChainAdequate = options.headless;
 
-        if (extensionsSupported) {
+        if (extensionsSupported && !options.headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
@@ -2395,7 +2813,25 @@ private:
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy
+            && supportsBindless(device);
+    }
+
+    //the features are queried through the 1.1 entry point, so the bindless set needs a 1.1 instance and device
+    bool supportsBindless(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (instanceApiVersion < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1) {
+            return false;
+        }
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        return features2.features.shaderSampledImageArrayDynamicIndexing && features2.features.shaderStorageBufferArrayDynamicIndexing
+            && BindlessTable::isSupported(indexingFeatures);
     }
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -2405,7 +2841,8 @@ private:
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        std::vector<const char*> extensions = getRequiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
         for (const auto& extension : availableExtensions) {
             requiredExtensions.erase(extension.extensionName);
@@ -2424,6 +2861,26 @@ private:
         std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+        //a family with transfer but no graphics or compute is usually a dedicated copy engine. It also has to copy
+        //at texel granularity, otherwise it can't upload arbitrary mip sizes
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            VkExtent3D granularity = queueFamilies[family].minImageTransferGranularity;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+                && granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+                indices.transferFamily = family;
+                break;
+            }
+        }
+
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                indices.computeFamily = family;
+                break;
+            }
+        }
+
         int i = 0;
         for (const auto& queueFamily : queueFamilies) {
 
@@ -2431,11 +2888,17 @@ private:
                 indices.graphicsFamily = i;
             }
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            //there is no surface to present to, the graphics queue doubles as the "present" queue
+            if (options.headless) {
+                indices.presentFamily = indices.graphicsFamily;
+            }
+            else {
+                VkBool32 presentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-            if (presentSupport) {
-                indices.presentFamily = i;
+                if (presentSupport) {
+                    indices.presentFamily = i;
+                }
             }
 
             if (indices.isComplete()) {
@@ -2473,6 +2936,123 @@ private:
             drawFrame();
         }
         vkDeviceWaitIdle(device);
+        gpuProfiler.report(std::cout);
+    }
+
+    //fixed orbit around the scene so every run renders the same sequence of views
+    void updateScriptedCamera(uint32_t frame, uint32_t frameCount) {
+        float angle = glm::two_pi<float>() * frame / std::max(frameCount, 1u);
+        camera.Position = glm::vec3(3.f * sin(angle), 1.f, 3.f * cos(angle));
+        camera.LookAt(glm::vec3(0.f));
+    }
+
+    void runBenchmark() {
+        FrameBenchmark benchmark;
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        benchmark.setInfo("device", properties.deviceName);
+        benchmark.setInfo("resolution", std::to_string(swapChainExtent.width) + "x" + std::to_string(swapChainExtent.height));
+        benchmark.setMetric("warmupFrames", options.warmupFrames);
+        benchmark.setMetric("frames", options.benchmarkFrames);
+
+        AllocatorStats memoryStats = allocator.getStats();
+        benchmark.setMetric("memoryBytesUsed", static_cast<double>(memoryStats.bytesUsed));
+        benchmark.setMetric("memoryBytesWasted", static_cast<double>(memoryStats.bytesWasted));
+        benchmark.setMetric("memoryBytesAllocated", static_cast<double>(memoryStats.bytesAllocated));
+        benchmark.setMetric("memoryBlocks", memoryStats.blockCount);
+        benchmark.setMetric("memoryDedicatedAllocations", memoryStats.dedicatedAllocationCount);
+        benchmark.setMetric("textureBytes", static_cast<double>(textureBytes));
+        benchmark.setMetric("sceneInstances", scene.getStats().instanceCount);
+
+        const PipelineCacheStats& cacheStats = pipelineCache.getStats();
+        benchmark.setMetric("pipelineCount", cacheStats.pipelineCount);
+        benchmark.setMetric("pipelineCacheHits", cacheStats.cacheHits);
+        benchmark.setMetric("pipelineCompileMs", cacheStats.compileMs);
+        benchmark.setMetric("pipelineCompileSavedMs", cacheStats.savedMs);
+
+        //whether the last submission on each frame in flight slot should be counted once its timestamps are available
+        std::vector<bool> slotMeasured(MAX_FRAMES_IN_FLIGHT, false);
+        auto collectGpuTime = [&](uint32_t slot) {
+            if (gpuProfiler.collect(slot) && slotMeasured[slot]) {
+                //the frame scope keeps its old series name, every other scope gets its own gpu.<name>Ms series
+                for (const GpuScopeTiming& timing : gpuProfiler.lastFrame()) {
+                    benchmark.addSample(timing.depth == 0 ? "gpuMs" : "gpu." + timing.name + "Ms", timing.ms);
+                }
+            }
+            slotMeasured[slot] = false;
+        };
+
+        uint32_t totalFrames = options.warmupFrames + options.benchmarkFrames;
+        auto previousFrameStart = std::chrono::high_resolution_clock::now();
+        for (uint32_t frame = 0; frame < totalFrames; frame++) {
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            if (frame > options.warmupFrames) {
+                benchmark.addSample("frameMs", std::chrono::duration<double, std::milli>(frameStart - previousFrameStart).count());
+            }
+            previousFrameStart = frameStart;
+
+            vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+            collectGpuTime(currentFrame);
+            //counters of the frame that last used this slot
+            if (cullingMode == CullingMode::Gpu && gpuCuller.collect(currentFrame) && frame >= options.warmupFrames) {
+                const GpuCullStats& cullStats = gpuCuller.getStats();
+                benchmark.addSample("gpuFrustumCulled", cullStats.frustumCulled);
+                benchmark.addSample("gpuOcclusionCulled", cullStats.occlusionCulled);
+                benchmark.addSample("gpuVisibleEarly", cullStats.earlyVisible);
+                benchmark.addSample("gpuVisibleLate", cullStats.lateVisible);
+                benchmark.addSample("gpuTriangles", cullStats.triangles);
+            }
+            uploader.collect();
+
+            updateScriptedCamera(frame, totalFrames);
+            updateUniformBuffer(currentFrame);
+            if (frame >= options.warmupFrames) {
+                benchmark.addSample("shadowCasters", shadowCasterCount);
+                benchmark.addSample("shadowCascadesDrawn", shadowMap.dirtyCount());
+            }
+            if (cullingMode == CullingMode::Cpu && frame >= options.warmupFrames) {
+                benchmark.addSample("cpuCullMs", scene.getCullStats().ms);
+                benchmark.addSample("visibleInstances", scene.getCullStats().visibleCount);
+                SceneDrawStats sceneStats = scene.getStats();
+                benchmark.addSample("cpuTriangles", static_cast<double>(sceneStats.culledTriangles));
+                for (uint32_t level = 0; level < options.lodLevels; level++) {
+                    benchmark.addSample("cpuLod" + std::to_string(level) + "Objects", sceneStats.objectsPerLod[level]);
+                }
+            }
+
+            vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+            auto cpuStart = std::chrono::high_resolution_clock::now();
+            vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+            recordCommandBuffer(commandBuffers[currentFrame], 0);
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+            if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+            auto cpuEnd = std::chrono::high_resolution_clock::now();
+
+            if (frame >= options.warmupFrames) {
+                benchmark.addSample("cpuRecordSubmitMs", std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count());
+                slotMeasured[currentFrame] = true;
+            }
+
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        }
+
+        vkDeviceWaitIdle(device);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            collectGpuTime((currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+        }
+
+        benchmark.printSummary(std::cout);
+        gpuProfiler.report(std::cout);
+        benchmark.writeJson(options.benchmarkOutput);
+        std::cout << "benchmark results written to " << options.benchmarkOutput << std::endl;
     }
 
     void processInput(GLFWwindow* window, float deltaTime)
@@ -2535,12 +3115,60 @@ private:
         glm::vec3 lightPos = glm::vec3(0.0f, 0.f, 0.0f);
         glm::vec3 cameraPos = camera.Position;
 
-        memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-        memcpy(lightPosUniformBuffersMapped[currentImage], &lightPos, sizeof(lightPos));
+        //the cascades follow the camera's view out to the shadow distance
+        glm::vec4 sceneSphere = scene.getBoundingSphere();
+        shadowMap.update(ubo.view * ubo.model, glm::radians(camera.Zoom), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f,
+            SUN_DIRECTION, glm::vec3(sceneSphere), sceneSphere.w);
+        ubo.shadow = shadowMap.getUniforms();
+        ubo.resources = glm::uvec4(materialBufferIndex, shadowTextureIndex, shadowSamplerIndex, 0);
+
+        //the skybox has no instances to carry its material, the casters draw into their cascade
+        drawConstants.set(SKY_DRAW, { glm::mat4(1.f), SKY_MATERIAL, 0 });
+        drawConstants.set(OPAQUE_DRAW, { ubo.model, BINDLESS_NONE, 0 });
+        for (uint32_t cascade = 0; cascade < MAX_SHADOW_CASCADES; cascade++) {
+            drawConstants.set(SHADOW_DRAW + cascade, { ubo.model, BINDLESS_NONE, cascade });
+        }
+
+        uniformRing.beginFrame(currentImage);
+        frameUniformOffset = uniformRing.push(ubo);
+        lightPosUniformOffset = uniformRing.push(lightPos);
+        drawConstants.upload(uniformRing);
+
+        //the objects outside the camera's view are left out of this frame's draws, the others get their level of detail
+        SceneLodView lodView{};
+        lodView.cameraPosition = glm::vec3(glm::inverse(ubo.view * ubo.model)[3]);
+        lodView.pixelScale = 0.5f * swapChainExtent.height * std::abs(ubo.proj[1][1]);
+        lodView.threshold = options.lodThreshold;
+        //the near plane back from the [0, 1] depth mapping, like GpuCuller::setView does
+        lodView.nearPlane = ubo.proj[3][2] / ubo.proj[2][2];
+
+        //every cascade only draws the casters inside its box, whatever culls the camera's view. They go first so the
+        //cull stats are the camera's. Cascades that keep their cached static casters and have no moving ones draw
+        //nothing this frame
+        shadowCasterCount = 0;
+        for (uint32_t cascade = 0; cascade < shadowMap.cascadeCount(); cascade++) {
+            if (!shadowMap.isDirty(cascade) && dynamicBatches.empty()) {
+                continue;
+            }
+            scene.cull(currentImage, ubo.shadow.viewProj[cascade], &threadPool, &lodView, 1 + cascade);
+            shadowCasterCount += scene.getCullStats().visibleCount;
+        }
+
+        if (cullingMode == CullingMode::Cpu) {
+            scene.cull(currentImage, ubo.proj * ubo.view * ubo.model, &threadPool, &lodView);
+        }
+        else if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.setView(currentImage, ubo.view * ubo.model, ubo.proj, static_cast<float>(swapChainExtent.height), options.lodThreshold);
+        }
     }
 
     void drawFrame() {
         vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        uploader.collect();
+        gpuProfiler.collect(currentFrame);
+        if (cullingMode == CullingMode::Gpu) {
+            gpuCuller.collect(currentFrame);
+        }
 
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -2618,8 +3246,7 @@ private:
 
         createSwapChain();
         createImageViews();
-        createDepthResources();
-        createFramebuffers();
+        createRenderGraphResources();
     }
 
     void createInstance() {
@@ -2633,7 +3260,14 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        //1.1 where the loader has it, for subgroup operations; 1.0 loaders don't export vkEnumerateInstanceVersion
+        auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+        uint32_t loaderVersion = VK_API_VERSION_1_0;
+        if (enumerateInstanceVersion != nullptr) {
+            enumerateInstanceVersion(&loaderVersion);
+        }
+        instanceApiVersion = loaderVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+        appInfo.apiVersion = instanceApiVersion;
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -2669,10 +3303,15 @@ private:
     }
 
     std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        std::vector<const char*> extensions;
+
+        //surface extensions are only needed when presenting to a window
+        if (!options.headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -2681,6 +3320,14 @@ private:
         return extensions;
     }
 
+    std::vector<const char*> getRequiredDeviceExtensions() {
+        std::vector<const char*> extensions = bindlessDeviceExtensions;
+        if (!options.headless) {
+            extensions.insert(extensions.end(), deviceExtensions.begin(), deviceExtensions.end());
+        }
+        return extensions;
+    }
+
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
         createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -2704,9 +3351,9 @@ private:
     }
 };
 
-int main() {
-    HelloTriangleApplication app;
+int main(int argc, char* argv[]) {
     try {
+        HelloTriangleApplication app(parseLaunchOptions(argc, argv));
         app.run();
     }
     catch (const std::exception& e) {
@@ -0,0 +1,281 @@
+#pragma once
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file, backed by the OS page cache instead of a heap copy
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            close();
+            return false;
+        }
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        data = view == MAP_FAILED ? nullptr : view;
+        size = static_cast<size_t>(info.st_size);
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) {
+            munmap(data, size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* bytes() const {
+        return static_cast<const uint8_t*>(data);
+    }
+
+    size_t fileSize() const {
+        return size;
+    }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// 64-bit FNV-1a. Only used to notice that a source asset changed, not for security
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline bool hashFile(const std::string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    hash = hashBytes(file.bytes(), file.fileSize());
+    return true;
+}
+
+// On-disk layout, everything little endian and tightly packed:
+// header | vertex blob (vertexCount * vertexStride) | index blob (indexCount * indexSize)
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    // layout of the vertex struct that produced the blob, a mismatch means the cache is from another build
+    uint32_t vertexStride;
+    uint32_t indexSize;
+    uint64_t sourceHash;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+    // which reordering pass ran before the write (the loader's own enum), part of the cache key
+    uint32_t optimization;
+    // post-transform cache statistics of the stored index order, 0 when they weren't measured
+    float acmr;
+    float atvr;
+};
+
+static const char MESH_CACHE_MAGIC[4] = { 'V', 'K', 'M', 'C' };
+// bump whenever the loader output changes (vertex contents, dedup, reordering), otherwise stale caches stay valid
+static const uint32_t MESH_CACHE_VERSION = 3;
+
+// Binary cache of a processed mesh next to its source asset. Written once after parsing, then memory-mapped on later
+// runs so the vertex and index blobs can be copied into the staging buffer as they are
+class MeshCache {
+public:
+    // maps the cache and checks it against the current source, vertex layout and optimization. False means it has to
+    // be rebuilt
+    bool open(const std::string& path, uint64_t sourceHash, uint32_t vertexStride, uint32_t indexSize, uint32_t optimization = 0) {
+        if (!file.open(path) || file.fileSize() < sizeof(MeshCacheHeader)) {
+            file.close();
+            return false;
+        }
+        memcpy(&header, file.bytes(), sizeof(header));
+
+        bool valid = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+            && header.version == MESH_CACHE_VERSION
+            && header.sourceHash == sourceHash
+            && header.vertexStride == vertexStride
+            && header.indexSize == indexSize
+            && header.optimization == optimization
+            && header.vertexOffset + header.vertexCount * vertexStride <= file.fileSize()
+            && header.indexOffset + header.indexCount * indexSize <= file.fileSize();
+        if (!valid) {
+            file.close();
+            header = MeshCacheHeader{};
+        }
+        return valid;
+    }
+
+    // drops the mapping once the blobs are uploaded, the header (counts, bounds) stays available
+    void close() {
+        file.close();
+    }
+
+    bool isMapped() const {
+        return file.bytes() != nullptr;
+    }
+
+    const void* vertexData() const {
+        return file.bytes() + header.vertexOffset;
+    }
+
+    const void* indexData() const {
+        return file.bytes() + header.indexOffset;
+    }
+
+    size_t vertexBytes() const {
+        return static_cast<size_t>(header.vertexCount * header.vertexStride);
+    }
+
+    size_t indexBytes() const {
+        return static_cast<size_t>(header.indexCount * header.indexSize);
+    }
+
+    const MeshCacheHeader& info() const {
+        return header;
+    }
+
+    // written to a temporary file first and renamed, so an interrupted write never leaves a half valid cache behind
+    static void write(const std::string& path, uint64_t sourceHash, const void* vertexData, uint64_t vertexCount, uint32_t vertexStride,
+        const void* indexData, uint64_t indexCount, uint32_t indexSize, const float boundsMin[3], const float boundsMax[3],
+        uint32_t optimization = 0, float acmr = 0.f, float atvr = 0.f) {
+        MeshCacheHeader header{};
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexStride = vertexStride;
+        header.indexSize = indexSize;
+        header.sourceHash = sourceHash;
+        header.vertexCount = vertexCount;
+        header.indexCount = indexCount;
+        // blobs start on 16 byte boundaries so the mapped pointers are suitably aligned for any vertex type
+        header.vertexOffset = alignUp(sizeof(MeshCacheHeader), 16);
+        header.indexOffset = alignUp(header.vertexOffset + vertexCount * vertexStride, 16);
+        memcpy(header.boundsMin, boundsMin, sizeof(header.boundsMin));
+        memcpy(header.boundsMax, boundsMax, sizeof(header.boundsMax));
+        header.optimization = optimization;
+        header.acmr = acmr;
+        header.atvr = atvr;
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                throw std::runtime_error("failed to open mesh cache for writing!");
+            }
+            std::vector<char> padding(16, 0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(padding.data(), header.vertexOffset - sizeof(header));
+            out.write(static_cast<const char*>(vertexData), vertexCount * vertexStride);
+            out.write(padding.data(), header.indexOffset - (header.vertexOffset + vertexCount * vertexStride));
+            out.write(static_cast<const char*>(indexData), indexCount * indexSize);
+            if (!out) {
+                throw std::runtime_error("failed to write mesh cache!");
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            throw std::runtime_error("failed to replace mesh cache!");
+        }
+    }
+
+private:
+    MappedFile file;
+    MeshCacheHeader header{};
+
+    static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif
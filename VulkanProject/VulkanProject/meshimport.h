@@ -0,0 +1,166 @@
+#pragma once
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "threadpool.h"
+
+// murmur3 finalizer, spreads every input bit over the whole word
+inline uint64_t mixHash(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+// hashes a run of floats by their bit patterns. -0 and +0 compare equal, so they have to hash equal as well
+inline uint64_t hashFloats(const float* values, size_t count, uint64_t seed = 0x9e3779b97f4a7c15ull) {
+    uint64_t hash = seed;
+    for (size_t i = 0; i < count; i++) {
+        float value = values[i] + 0.0f;
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        hash = mixHash(hash ^ (bits + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2)));
+    }
+    return hash;
+}
+
+// Open addressing (linear probing) set of vertex indices. Equality is checked against the caller's vertex array,
+// the full 64-bit hash is kept per slot so probing and growing never have to rehash vertices
+template<typename V>
+class FlatVertexTable {
+public:
+    explicit FlatVertexTable(size_t expectedCount = 0) {
+        size_t capacity = 16;
+        while (capacity < expectedCount * 2) {
+            capacity <<= 1;
+        }
+        slots.assign(capacity, Slot{});
+    }
+
+    // returns the index of an equal vertex already in the table, or inserts newIndex and returns it
+    uint32_t findOrInsert(const std::vector<V>& vertices, const V& vertex, uint64_t hash, uint32_t newIndex) {
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+        }
+
+        size_t mask = slots.size() - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            Slot& entry = slots[slot];
+            if (entry.index == EMPTY) {
+                entry.hash = hash;
+                entry.index = newIndex;
+                count++;
+                return newIndex;
+            }
+            if (entry.hash == hash && vertices[entry.index] == vertex) {
+                return entry.index;
+            }
+        }
+    }
+
+private:
+    static const uint32_t EMPTY = 0xffffffffu;
+
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t index = EMPTY;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(old.size() * 2, Slot{});
+        size_t mask = slots.size() - 1;
+        for (const Slot& entry : old) {
+            if (entry.index == EMPTY) {
+                continue;
+            }
+            size_t slot = entry.hash & mask;
+            while (slots[slot].index != EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = entry;
+        }
+    }
+};
+
+// Builds an indexed mesh out of cornerCount triangle corners. buildVertex(corner) returns the vertex of one corner,
+// hashVertex(vertex) its 64-bit hash.
+// Corners are split into contiguous ranges that are built and deduplicated on the pool, then the per-range unique
+// vertices are merged in range order. Vertices end up in order of first use and indices in corner order, exactly
+// what a single-threaded pass produces, whatever the number of threads
+template<typename V, typename BuildVertex, typename HashVertex>
+void buildIndexedMesh(ThreadPool& pool, size_t cornerCount, BuildVertex buildVertex, HashVertex hashVertex,
+    std::vector<V>& vertices, std::vector<uint32_t>& indices, size_t minRangeSize = 16384) {
+    struct Range {
+        std::vector<V> vertices;
+        std::vector<uint64_t> hashes;
+        // indices into this range's vertices until the merge rewrites them to global ones
+        std::vector<uint32_t> indices;
+    };
+    std::vector<Range> ranges(pool.rangesFor(cornerCount, minRangeSize));
+
+    pool.parallelFor(cornerCount, minRangeSize, [&](size_t begin, size_t end, size_t rangeIndex) {
+        Range& range = ranges[rangeIndex];
+        range.indices.reserve(end - begin);
+        FlatVertexTable<V> table(end - begin);
+
+        for (size_t corner = begin; corner < end; corner++) {
+            V vertex = buildVertex(corner);
+            uint64_t hash = hashVertex(vertex);
+            uint32_t index = table.findOrInsert(range.vertices, vertex, hash, static_cast<uint32_t>(range.vertices.size()));
+            if (index == range.vertices.size()) {
+                range.vertices.push_back(vertex);
+                range.hashes.push_back(hash);
+            }
+            range.indices.push_back(index);
+        }
+    });
+
+    // merge: walk the ranges in order so first occurrences keep their global order
+    size_t uniqueUpperBound = 0;
+    for (const Range& range : ranges) {
+        uniqueUpperBound += range.vertices.size();
+    }
+    vertices.clear();
+    vertices.reserve(uniqueUpperBound);
+    FlatVertexTable<V> table(uniqueUpperBound);
+
+    std::vector<std::vector<uint32_t>> remaps(ranges.size());
+    std::vector<size_t> indexOffsets(ranges.size());
+    size_t indexCount = 0;
+    for (size_t r = 0; r < ranges.size(); r++) {
+        Range& range = ranges[r];
+        remaps[r].resize(range.vertices.size());
+        for (size_t i = 0; i < range.vertices.size(); i++) {
+            uint32_t index = table.findOrInsert(vertices, range.vertices[i], range.hashes[i], static_cast<uint32_t>(vertices.size()));
+            if (index == vertices.size()) {
+                vertices.push_back(range.vertices[i]);
+            }
+            remaps[r][i] = index;
+        }
+        indexOffsets[r] = indexCount;
+        indexCount += range.indices.size();
+    }
+
+    indices.resize(indexCount);
+    pool.parallelFor(ranges.size(), 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t r = begin; r < end; r++) {
+            const Range& range = ranges[r];
+            for (size_t i = 0; i < range.indices.size(); i++) {
+                indices[indexOffsets[r] + i] = remaps[r][range.indices[i]];
+            }
+        }
+    });
+}
+
+#endif
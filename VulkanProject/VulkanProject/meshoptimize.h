@@ -0,0 +1,281 @@
+#pragma once
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// post-transform cache size the optimizer plans for and the statistics are simulated with, about what current GPUs
+// keep per batch of vertices
+const uint32_t MESH_VERTEX_CACHE_SIZE = 16;
+
+// ACMR is the vertices transformed per triangle (0.5 at best, 3 at worst) and ATVR per referenced vertex (1 at best)
+struct VertexCacheStats {
+    float acmr = 0.f;
+    float atvr = 0.f;
+};
+
+// simulates a FIFO post-transform cache over the index buffer
+inline VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = MESH_VERTEX_CACHE_SIZE) {
+    VertexCacheStats stats;
+    if (indices.empty()) {
+        return stats;
+    }
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t misses = 0;
+    size_t referencedCount = 0;
+    for (uint32_t index : indices) {
+        if (loadedAt[index] == 0 || misses - loadedAt[index] + 1 > cacheSize) {
+            misses++;
+            loadedAt[index] = misses;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            referencedCount++;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(referencedCount);
+    return stats;
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"): fans
+// around the vertex that is most likely still cached and jumps to a dead end vertex when none is. Every jump starts
+// a new cluster, the first triangle of each is appended to clusterStarts
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = MESH_VERTEX_CACHE_SIZE,
+    std::vector<uint32_t>* clusterStarts = nullptr) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // triangles around each vertex, in CSR form
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // triangles of each vertex not emitted yet
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = indices[0];
+    if (clusterStarts) {
+        clusterStarts->assign(1, 0);
+    }
+
+    while (fanning >= 0) {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // the candidate that stays in the cache after its remaining triangles, the oldest such one first
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        if (next >= 0) {
+            fanning = next;
+            continue;
+        }
+
+        // dead end: the most recent vertex that still has triangles, otherwise the next one in input order
+        fanning = -1;
+        while (!deadEnds.empty()) {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) {
+                fanning = v;
+                break;
+            }
+        }
+        while (fanning < 0 && cursor < indices.size()) {
+            uint32_t v = indices[cursor++];
+            if (liveTriangles[v] > 0) {
+                fanning = v;
+            }
+        }
+        if (fanning >= 0 && clusterStarts) {
+            clusterStarts->push_back(static_cast<uint32_t>(output.size() / 3));
+        }
+    }
+    indices.swap(output);
+}
+
+// Sorts the clusters so the ones facing away from the mesh center come first, they are likely to hide the rest. Tiny
+// clusters are merged with the next one first, and the sort is undone if the ACMR would get worse than threshold
+// times what it was. positionOf(vertex index) returns the model space position
+template<typename PositionOf>
+bool optimizeOverdraw(std::vector<uint32_t>& indices, size_t vertexCount, const std::vector<uint32_t>& clusterStarts,
+    PositionOf positionOf, float threshold = 1.05f, uint32_t minClusterTriangles = 64) {
+    size_t triangleCount = indices.size() / 3;
+    if (clusterStarts.size() < 2) {
+        return false;
+    }
+
+    std::vector<uint32_t> starts;
+    for (uint32_t start : clusterStarts) {
+        if (starts.empty() || start - starts.back() >= minClusterTriangles) {
+            starts.push_back(start);
+        }
+    }
+    if (starts.size() < 2) {
+        return false;
+    }
+
+    glm::vec3 meshCenter(0.f);
+    for (uint32_t index : indices) {
+        meshCenter += positionOf(index);
+    }
+    meshCenter /= static_cast<float>(indices.size());
+
+    struct Cluster {
+        uint32_t first;
+        uint32_t count;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters(starts.size());
+    for (size_t c = 0; c < starts.size(); c++) {
+        uint32_t end = c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(triangleCount);
+        // area weighted, the unnormalized face normals are twice the triangle areas
+        glm::vec3 centroid(0.f);
+        glm::vec3 normal(0.f);
+        float area = 0.f;
+        for (uint32_t t = starts[c]; t < end; t++) {
+            glm::vec3 p0 = positionOf(indices[t * 3 + 0]);
+            glm::vec3 p1 = positionOf(indices[t * 3 + 1]);
+            glm::vec3 p2 = positionOf(indices[t * 3 + 2]);
+            glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+            float faceArea = glm::length(faceNormal);
+            centroid += (p0 + p1 + p2) * (faceArea / 3.f);
+            normal += faceNormal;
+            area += faceArea;
+        }
+        centroid = area > 0.f ? centroid / area : positionOf(indices[starts[c] * 3]);
+        float normalLength = glm::length(normal);
+        clusters[c] = { starts[c], end - starts[c], normalLength > 0.f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.f };
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        sorted.insert(sorted.end(), indices.begin() + cluster.first * 3, indices.begin() + (cluster.first + cluster.count) * 3);
+    }
+    if (analyzeVertexCache(sorted, vertexCount).acmr > analyzeVertexCache(indices, vertexCount).acmr * threshold) {
+        return false;
+    }
+    indices.swap(sorted);
+    return true;
+}
+
+// moves the vertices into the order the index buffer first uses them and drops unreferenced ones, so the vertex
+// fetches walk memory forward
+template<typename V>
+void optimizeVertexFetch(std::vector<V>& vertices, std::vector<uint32_t>& indices) {
+    const uint32_t UNUSED = 0xffffffffu;
+    std::vector<uint32_t> remap(vertices.size(), UNUSED);
+    std::vector<V> reordered;
+    reordered.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+enum class MeshOptimization {
+    None,
+    // vertex cache order and vertex fetch order
+    VertexCache,
+    // the above plus cluster sorting against overdraw
+    Overdraw
+};
+
+struct MeshOptimizeStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t clusterCount = 0;
+    bool overdrawSorted = false;
+    float ms = 0.f;
+};
+
+// The whole pass on a deduplicated mesh: triangles in vertex cache order, clusters sorted for overdraw if asked for,
+// then vertices in fetch order. positionOf(const V&) returns a vertex's position
+template<typename V, typename PositionOf>
+MeshOptimizeStats optimizeMesh(std::vector<V>& vertices, std::vector<uint32_t>& indices, MeshOptimization optimization, PositionOf positionOf) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    MeshOptimizeStats stats;
+    stats.before = analyzeVertexCache(indices, vertices.size());
+    if (optimization != MeshOptimization::None) {
+        std::vector<uint32_t> clusterStarts;
+        optimizeVertexCache(indices, vertices.size(), MESH_VERTEX_CACHE_SIZE, &clusterStarts);
+        stats.clusterCount = static_cast<uint32_t>(clusterStarts.size());
+        if (optimization == MeshOptimization::Overdraw) {
+            stats.overdrawSorted = optimizeOverdraw(indices, vertices.size(), clusterStarts, [&](uint32_t index) {
+                return positionOf(vertices[index]);
+            });
+        }
+        optimizeVertexFetch(vertices, indices);
+    }
+    stats.after = analyzeVertexCache(indices, vertices.size());
+    stats.ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    return stats;
+}
+
+#endif
@@ -0,0 +1,330 @@
+#pragma once
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "meshimport.h"
+#include "meshoptimize.h"
+#include "vertexformat.h"
+
+// one level of detail: indices into the full mesh's vertices and the largest distance the simplification moved the
+// surface by, in model units
+struct MeshLod {
+    std::vector<uint32_t> indices;
+    float error = 0.f;
+};
+
+struct LodSettings {
+    // levels including the full mesh, 1 turns the chain off
+    uint32_t levelCount = 4;
+    // triangles of each level relative to the one before
+    float ratio = 0.5f;
+    // no level goes below this many triangles
+    uint32_t minTriangles = 64;
+};
+
+// Edge collapse simplifier with quadric error metrics (Garland and Heckbert 1997) working on the index buffer only,
+// every level keeps using the mesh's vertices. A vertex only collapses onto one of its neighbours, so no new vertices
+// are made. Vertices on a border or on an attribute seam (several vertices at one position, e.g. a UV island edge)
+// never move, other vertices may still collapse onto them, so the seams stay closed. Collapses across a crease pay
+// for the normal they drop on top of the quadric error
+class MeshSimplifier {
+public:
+    MeshSimplifier(const VertexSource& vertices, const uint32_t* indices, size_t indexCount)
+        : vertices(vertices), current(indices, indices + indexCount) {
+        size_t vertexCount = vertices.count;
+        positions.resize(vertexCount);
+        normals.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            positions[v] = vertices.read(v, vertices.positionOffset);
+            normals[v] = vertices.read(v, vertices.normalOffset);
+        }
+
+        //vertices at the same position share a group, a group of more than one is a seam
+        groups.resize(vertexCount);
+        std::vector<uint32_t> groupSize(vertexCount, 0);
+        std::unordered_map<uint64_t, std::vector<uint32_t>> byPosition;
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            std::vector<uint32_t>& candidates = byPosition[hashFloats(&positions[v].x, 3)];
+            groups[v] = v;
+            for (uint32_t other : candidates) {
+                if (positions[other] == positions[v]) {
+                    groups[v] = groups[other];
+                    break;
+                }
+            }
+            candidates.push_back(v);
+            groupSize[groups[v]]++;
+        }
+
+        //an edge between two groups used by a single triangle is on a border
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        for (size_t t = 0; t + 2 < current.size(); t += 3) {
+            for (uint32_t e = 0; e < 3; e++) {
+                edgeUses[edgeKey(groups[current[t + e]], groups[current[t + (e + 1) % 3]])]++;
+            }
+        }
+        locked.assign(vertexCount, false);
+        for (size_t t = 0; t + 2 < current.size(); t += 3) {
+            for (uint32_t e = 0; e < 3; e++) {
+                uint32_t a = current[t + e];
+                uint32_t b = current[t + (e + 1) % 3];
+                if (edgeUses[edgeKey(groups[a], groups[b])] == 1) {
+                    locked[a] = locked[b] = true;
+                }
+            }
+        }
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            if (groupSize[groups[v]] > 1) {
+                locked[v] = true;
+            }
+        }
+
+        //area weighted plane quadrics, summed per group so every vertex at a position sees the same surface
+        quadrics.assign(vertexCount, Quadric{});
+        for (size_t t = 0; t + 2 < current.size(); t += 3) {
+            glm::dvec3 p0 = positions[current[t]];
+            glm::dvec3 p1 = positions[current[t + 1]];
+            glm::dvec3 p2 = positions[current[t + 2]];
+            glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double area = glm::length(normal);
+            if (area <= 0.0) {
+                continue;
+            }
+            normal /= area;
+            Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), area * 0.5);
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                quadrics[groups[current[t + corner]]].add(plane);
+            }
+        }
+    }
+
+    // collapses edges until the mesh has at most targetIndexCount indices or no collapse is left under maxError,
+    // continuing from the previous call. The error of a collapse is measured against the original surface
+    void simplify(size_t targetIndexCount, float maxError = 1e30f) {
+        double maxCost = static_cast<double>(maxError) * maxError;
+        std::vector<uint32_t> remap(vertices.count);
+        std::vector<bool> touched(vertices.count);
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> adjacencyOffsets;
+        std::vector<uint32_t> adjacency;
+
+        while (current.size() > targetIndexCount) {
+            buildAdjacency(adjacencyOffsets, adjacency);
+
+            collapses.clear();
+            for (size_t t = 0; t + 2 < current.size(); t += 3) {
+                for (uint32_t e = 0; e < 3; e++) {
+                    uint32_t a = current[t + e];
+                    uint32_t b = current[t + (e + 1) % 3];
+                    if (!locked[a]) {
+                        collapses.push_back({ a, b, collapseCost(a, b) });
+                    }
+                    if (!locked[b]) {
+                        collapses.push_back({ b, a, collapseCost(b, a) });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                return x.cost < y.cost;
+            });
+
+            for (uint32_t v = 0; v < vertices.count; v++) {
+                remap[v] = v;
+            }
+            std::fill(touched.begin(), touched.end(), false);
+            //every collapse removes about two triangles, stop once that reaches the target
+            size_t remaining = current.size();
+            size_t applied = 0;
+            for (const Collapse& collapse : collapses) {
+                if (remaining <= targetIndexCount || collapse.cost > maxCost) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to, adjacencyOffsets, adjacency)) {
+                    continue;
+                }
+                remap[collapse.from] = collapse.to;
+                quadrics[groups[collapse.to]].add(quadrics[groups[collapse.from]]);
+                error = std::max(error, static_cast<float>(std::sqrt(std::max(collapse.cost, 0.0))));
+                //the neighbourhood changed, its other collapses wait for the next pass
+                for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+                    for (uint32_t corner = 0; corner < 3; corner++) {
+                        touched[current[adjacency[a] * 3 + corner]] = true;
+                    }
+                }
+                touched[collapse.to] = true;
+                remaining -= 6;
+                applied++;
+            }
+            if (applied == 0) {
+                break;
+            }
+
+            size_t write = 0;
+            for (size_t t = 0; t + 2 < current.size(); t += 3) {
+                uint32_t a = remap[current[t]];
+                uint32_t b = remap[current[t + 1]];
+                uint32_t c = remap[current[t + 2]];
+                if (a != b && b != c && c != a) {
+                    current[write++] = a;
+                    current[write++] = b;
+                    current[write++] = c;
+                }
+            }
+            current.resize(write);
+        }
+    }
+
+    const std::vector<uint32_t>& indices() const {
+        return current;
+    }
+
+    float getError() const {
+        return error;
+    }
+
+private:
+    // symmetric 4x4 quadric, the upper triangle
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+
+        static Quadric fromPlane(const glm::dvec3& n, double d, double weight) {
+            Quadric q;
+            q.a00 = n.x * n.x * weight;
+            q.a01 = n.x * n.y * weight;
+            q.a02 = n.x * n.z * weight;
+            q.a11 = n.y * n.y * weight;
+            q.a12 = n.y * n.z * weight;
+            q.a22 = n.z * n.z * weight;
+            q.b0 = n.x * d * weight;
+            q.b1 = n.y * d * weight;
+            q.b2 = n.z * d * weight;
+            q.c = d * d * weight;
+            return q;
+        }
+
+        void add(const Quadric& other) {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+        }
+
+        double evaluate(const glm::dvec3& p) const {
+            return a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + a11 * p.y * p.y + 2 * a12 * p.y * p.z + a22 * p.z * p.z
+                + 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        }
+    };
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    VertexSource vertices;
+    std::vector<uint32_t> current;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> groups;
+    std::vector<bool> locked;
+    std::vector<Quadric> quadrics;
+    float error = 0.f;
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    // area weighted squared distance to the planes merged so far plus the crease the collapse flattens. The quadrics
+    // are normalized by their total weight, so the cost is a squared distance in model units
+    double collapseCost(uint32_t from, uint32_t to) const {
+        Quadric merged = quadrics[groups[from]];
+        merged.add(quadrics[groups[to]]);
+        double weight = merged.a00 + merged.a11 + merged.a22;
+        double cost = weight > 0.0 ? std::max(merged.evaluate(positions[to]), 0.0) / weight : 0.0;
+        glm::vec3 edge = positions[to] - positions[from];
+        double crease = 1.0 - glm::clamp(glm::dot(safeNormalize(normals[from]), safeNormalize(normals[to])), -1.f, 1.f);
+        return cost + crease * glm::dot(edge, edge) * 0.5;
+    }
+
+    static glm::vec3 safeNormalize(const glm::vec3& v) {
+        float length = glm::length(v);
+        return length > 0.f ? v / length : v;
+    }
+
+    // triangles of every vertex in the current mesh, in CSR form
+    void buildAdjacency(std::vector<uint32_t>& offsets, std::vector<uint32_t>& adjacency) const {
+        offsets.assign(vertices.count + 1, 0);
+        for (uint32_t index : current) {
+            offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vertices.count; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(current.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < current.size(); i++) {
+            adjacency[fill[current[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    // whether moving from onto to turns a triangle that stays over, or squashes it to nothing
+    bool flips(uint32_t from, uint32_t to, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency) const {
+        for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++) {
+            uint32_t t = adjacency[a] * 3;
+            uint32_t corners[3] = { current[t], current[t + 1], current[t + 2] };
+            if (corners[0] == to || corners[1] == to || corners[2] == to) {
+                continue;
+            }
+            glm::vec3 before = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+            for (uint32_t& corner : corners) {
+                if (corner == from) {
+                    corner = to;
+                }
+            }
+            glm::vec3 after = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+            if (glm::dot(before, after) <= 0.f) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// The full mesh and up to settings.levelCount - 1 simplified levels, each in vertex cache order. The chain ends early
+// once a level can't get below the target, e.g. when the locked seams are all that is left
+inline std::vector<MeshLod> buildLodChain(const VertexSource& vertices, const uint32_t* indices, size_t indexCount, const LodSettings& settings) {
+    std::vector<MeshLod> chain(1);
+    chain[0].indices.assign(indices, indices + indexCount);
+
+    MeshSimplifier simplifier(vertices, indices, indexCount);
+    for (uint32_t level = 1; level < settings.levelCount; level++) {
+        size_t previous = chain.back().indices.size();
+        size_t target = static_cast<size_t>(previous / 3 * settings.ratio) * 3;
+        if (target < static_cast<size_t>(settings.minTriangles) * 3) {
+            break;
+        }
+        simplifier.simplify(target);
+        //less than half the planned reduction isn't worth a level
+        if (simplifier.indices().size() > previous - (previous - target) / 2) {
+            break;
+        }
+        MeshLod lod;
+        lod.indices = simplifier.indices();
+        lod.error = simplifier.getError();
+        optimizeVertexCache(lod.indices, vertices.count);
+        chain.push_back(std::move(lod));
+    }
+    return chain;
+}
+
+#endif
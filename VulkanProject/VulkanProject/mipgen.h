@@ -0,0 +1,373 @@
+#pragma once
+#ifndef MIPGEN_H
+#define MIPGEN_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "pipelinecache.h"
+#include "upload.h"
+
+struct MipGeneratorStats {
+    uint32_t imageCount = 0;
+    uint32_t levelCount = 0;
+    uint32_t dispatchCount = 0;
+};
+
+// Builds mip chains of RGBA8 images with a compute shader instead of a blit and two barriers per level. A dispatch
+// writes up to six levels below its source (shared memory, and subgroup quads where the device has them), so a
+// power-of-two image up to 4096 texels takes two dispatches. Odd sizes are filtered exactly; levels are only chained
+// in one dispatch while no footprint crosses a workgroup's block, which may cost an extra dispatch.
+// sRGB images get UNORM storage views and the shader converts to linear and back around the filter.
+// The work is recorded into the upload batch's compute part, which runs on the async compute queue if there is one
+class MipGenerator {
+public:
+    static const uint32_t LEVELS_PER_DISPATCH = 6;
+    // source texels one workgroup reduces along each axis
+    static const uint32_t BLOCK_SIZE = 64;
+    // descriptor sets for the dispatches recorded between two releaseTransient calls
+    static const uint32_t MAX_DISPATCHES = 64;
+
+    // quadCode is only used when subgroupQuads is set. extendedUsage says whether images may be created with usages
+    // only their views support (Vulkan 1.1 or VK_KHR_maintenance2), which sRGB images need for storage views
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, PipelineCacheStore& pipelineCache, const std::vector<char>& code,
+        const std::vector<char>& quadCode, bool subgroupQuads, bool extendedUsage) {
+        this->device = device;
+        this->extendedUsage = extendedUsage;
+        usesQuads = subgroupQuads;
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &properties);
+        unormStorage = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_SRGB, &properties);
+        srgbStorage = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+        if (!unormStorage) {
+            return;
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = LEVELS_PER_DISPATCH;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mip generation descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(Params);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mip generation pipeline layout!");
+        }
+
+        const std::vector<char>& shaderCode = usesQuads ? quadCode : code;
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+        pipelineCache.createComputePipeline(usesQuads ? "mipgenQuad" : "mipgen", pipelineInfo, &pipeline);
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSize.descriptorCount = MAX_DISPATCHES * (LEVELS_PER_DISPATCH + 1);
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = MAX_DISPATCHES;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mip generation descriptor pool!");
+        }
+    }
+
+    // false means the caller has to blit
+    bool supports(VkFormat format) const {
+        if (pipeline == VK_NULL_HANDLE) {
+            return false;
+        }
+        if (format == VK_FORMAT_R8G8B8A8_UNORM) {
+            return true;
+        }
+        return format == VK_FORMAT_R8G8B8A8_SRGB && (srgbStorage || extendedUsage);
+    }
+
+    // for images that will be passed to generate
+    VkImageUsageFlags imageUsage() const {
+        return VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    VkImageCreateFlags imageCreateFlags(VkFormat format) const {
+        VkImageCreateFlags flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+        if (format == VK_FORMAT_R8G8B8A8_SRGB && !srgbStorage) {
+            flags |= VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+        }
+        return flags;
+    }
+
+    // level 0 has to be uploaded with forCompute set; every level ends up in SHADER_READ_ONLY_OPTIMAL, owned by the
+    // graphics family. The views and descriptor sets are kept until releaseTransient
+    void generate(UploadManager& uploader, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels) {
+        std::vector<VkImageView> views(mipLevels);
+        for (uint32_t level = 0; level < mipLevels; level++) {
+            views[level] = createLevelView(image, level);
+            transientViews.push_back(views[level]);
+        }
+
+        VkCommandBuffer commandBuffer = uploader.computeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+        std::vector<Dispatch> dispatches = plan(width, height, mipLevels);
+        for (size_t i = 0; i < dispatches.size(); i++) {
+            const Dispatch& dispatch = dispatches[i];
+            VkDescriptorSet set = allocateSet(views, dispatch);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+
+            Params params{};
+            params.srcWidth = static_cast<int32_t>(std::max(width >> dispatch.srcLevel, 1u));
+            params.srcHeight = static_cast<int32_t>(std::max(height >> dispatch.srcLevel, 1u));
+            params.levelCount = static_cast<int32_t>(dispatch.levelCount);
+            params.srgb = format == VK_FORMAT_R8G8B8A8_SRGB ? 1 : 0;
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Params), &params);
+            vkCmdDispatch(commandBuffer, dispatch.groupsX, dispatch.groupsY, 1);
+
+            if (i + 1 < dispatches.size()) {
+                // the next dispatch reads the last level this one wrote
+                VkMemoryBarrier memoryBarrier{};
+                memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                    1, &memoryBarrier, 0, nullptr, 0, nullptr);
+            }
+        }
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        if (uploader.usesComputeQueue()) {
+            // release on the compute queue, acquire on the graphics queue which waits for this batch's compute part
+            barrier.srcQueueFamilyIndex = uploader.computeQueueFamily();
+            barrier.dstQueueFamilyIndex = uploader.graphicsQueueFamily();
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(uploader.graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        else {
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+        }
+
+        stats.imageCount++;
+        stats.levelCount += mipLevels - 1;
+        stats.dispatchCount += static_cast<uint32_t>(dispatches.size());
+    }
+
+    // call once the upload batches holding the recorded work have completed
+    void releaseTransient() {
+        for (VkImageView view : transientViews) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        transientViews.clear();
+        if (descriptorPool != VK_NULL_HANDLE) {
+            vkResetDescriptorPool(device, descriptorPool, 0);
+        }
+        allocatedSets = 0;
+    }
+
+    bool usesSubgroupQuads() const {
+        return usesQuads;
+    }
+
+    const MipGeneratorStats& getStats() const {
+        return stats;
+    }
+
+    void destroy() {
+        releaseTransient();
+        if (pipeline == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+
+private:
+    // matches the push constant block of mipgen.comp
+    struct Params {
+        int32_t srcWidth;
+        int32_t srcHeight;
+        int32_t levelCount;
+        int32_t srgb;
+    };
+
+    struct Dispatch {
+        uint32_t srcLevel;
+        uint32_t levelCount;
+        uint32_t groupsX;
+        uint32_t groupsY;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    bool extendedUsage = false;
+    bool usesQuads = false;
+    bool unormStorage = false;
+    bool srgbStorage = false;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    uint32_t allocatedSets = 0;
+    std::vector<VkImageView> transientViews;
+    MipGeneratorStats stats;
+
+    // a dispatch reads its source level from memory, so its first level may have any size. The levels after it are
+    // filtered from the workgroup's block in shared memory, which only holds everything they need if the level they
+    // are made from halves evenly, or if a single workgroup covers the whole source
+    static std::vector<Dispatch> plan(uint32_t width, uint32_t height, uint32_t mipLevels) {
+        std::vector<Dispatch> dispatches;
+        uint32_t level = 0;
+        while (level + 1 < mipLevels) {
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+            Dispatch dispatch{ level, 1, (levelWidth + BLOCK_SIZE - 1) / BLOCK_SIZE, (levelHeight + BLOCK_SIZE - 1) / BLOCK_SIZE };
+            bool singleGroup = dispatch.groupsX == 1 && dispatch.groupsY == 1;
+
+            while (dispatch.levelCount < LEVELS_PER_DISPATCH && level + dispatch.levelCount + 1 < mipLevels) {
+                uint32_t sourceWidth = std::max(width >> (level + dispatch.levelCount), 1u);
+                uint32_t sourceHeight = std::max(height >> (level + dispatch.levelCount), 1u);
+                bool odd = (sourceWidth > 1 && sourceWidth % 2 != 0) || (sourceHeight > 1 && sourceHeight % 2 != 0);
+                if (odd && !singleGroup) {
+                    break;
+                }
+                dispatch.levelCount++;
+            }
+            dispatches.push_back(dispatch);
+            level += dispatch.levelCount;
+        }
+        return dispatches;
+    }
+
+    VkImageView createLevelView(VkImage image, uint32_t level) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mip level view!");
+        }
+        return view;
+    }
+
+    // destination slots past the dispatch's last level repeat it, the shader never writes them
+    VkDescriptorSet allocateSet(const std::vector<VkImageView>& views, const Dispatch& dispatch) {
+        if (allocatedSets == MAX_DISPATCHES) {
+            throw std::runtime_error("failed to allocate mip generation descriptor set!");
+        }
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate mip generation descriptor set!");
+        }
+        allocatedSets++;
+
+        std::array<VkDescriptorImageInfo, LEVELS_PER_DISPATCH + 1> imageInfos{};
+        for (uint32_t i = 0; i < imageInfos.size(); i++) {
+            imageInfos[i].imageView = views[dispatch.srcLevel + std::min(i, dispatch.levelCount)];
+            imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = set;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &imageInfos[0];
+        writes[1] = writes[0];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = LEVELS_PER_DISPATCH;
+        writes[1].pImageInfo = &imageInfos[1];
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return set;
+    }
+};
+
+#endif
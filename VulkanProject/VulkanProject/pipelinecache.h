@@ -0,0 +1,265 @@
+#pragma once
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "meshcache.h"
+
+struct PipelineCacheStats {
+    // bytes of driver cache data accepted from disk, 0 for a cold start
+    size_t loadedBytes = 0;
+    uint32_t pipelineCount = 0;
+    uint32_t cacheHits = 0;
+    double compileMs = 0.0;
+    // cold compile time recorded on an earlier run minus what the same pipeline took now, summed over hits
+    double savedMs = 0.0;
+    // hits come from VK_EXT_pipeline_creation_feedback when available, otherwise every pipeline the loaded file knew is counted
+    bool hitsFromFeedback = false;
+};
+
+// VkPipelineCache persisted between runs. The file wraps the driver blob with the cold compile time of every pipeline
+// key so startup can report what the cache saved:
+// PipelineCacheFileHeader | PipelineRecord * recordCount | driver data (dataSize bytes)
+class PipelineCacheStore {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path, bool creationFeedback) {
+        this->device = device;
+        this->path = path;
+        this->creationFeedback = creationFeedback;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        stats.hitsFromFeedback = creationFeedback;
+
+        std::vector<char> initialData = load();
+        stats.loadedBytes = initialData.size();
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = initialData.size();
+        cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    VkPipelineCache handle() const {
+        return cache;
+    }
+
+    // key names the pipeline across runs (e.g. its shader paths) so compile times can be compared
+    void createGraphicsPipeline(const std::string& key, VkGraphicsPipelineCreateInfo pipelineInfo, VkPipeline* pipeline) {
+        VkPipelineCreationFeedbackEXT pipelineFeedback{};
+        std::vector<VkPipelineCreationFeedbackEXT> stageFeedbacks(pipelineInfo.stageCount);
+        VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+        if (creationFeedback) {
+            feedbackInfo = feedbackCreateInfo(pipelineInfo.pNext, &pipelineFeedback, stageFeedbacks);
+            pipelineInfo.pNext = &feedbackInfo;
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        record(key, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count(), pipelineFeedback);
+    }
+
+    void createComputePipeline(const std::string& key, VkComputePipelineCreateInfo pipelineInfo, VkPipeline* pipeline) {
+        VkPipelineCreationFeedbackEXT pipelineFeedback{};
+        std::vector<VkPipelineCreationFeedbackEXT> stageFeedbacks(1);
+        VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+        if (creationFeedback) {
+            feedbackInfo = feedbackCreateInfo(pipelineInfo.pNext, &pipelineFeedback, stageFeedbacks);
+            pipelineInfo.pNext = &feedbackInfo;
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+        record(key, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count(), pipelineFeedback);
+    }
+
+    const PipelineCacheStats& getStats() const {
+        return stats;
+    }
+
+    // writes to a temporary file and renames it over the old cache, so a crash mid-write never corrupts it
+    void save() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            return;
+        }
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS) {
+            return;
+        }
+        data.resize(dataSize);
+
+        PipelineCacheFileHeader header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.recordCount = static_cast<uint32_t>(records.size());
+        header.dataSize = data.size();
+        header.dataHash = hashBytes(data.data(), data.size());
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                std::cout << "failed to write pipeline cache" << std::endl;
+                return;
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& record : records) {
+                PipelineRecord entry{ record.first, record.second };
+                out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            }
+            out.write(data.data(), data.size());
+            if (!out) {
+                std::cout << "failed to write pipeline cache" << std::endl;
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            std::cout << "failed to replace pipeline cache" << std::endl;
+        }
+    }
+
+    void destroy() {
+        vkDestroyPipelineCache(device, cache, nullptr);
+    }
+
+private:
+    struct PipelineCacheFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t recordCount;
+        uint32_t reserved;
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    struct PipelineRecord {
+        uint64_t keyHash;
+        double coldCompileMs;
+    };
+
+    static constexpr char MAGIC[4] = { 'V', 'K', 'P', 'C' };
+    static const uint32_t VERSION = 1;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::string path;
+    bool creationFeedback = false;
+    std::map<uint64_t, double> records;
+    PipelineCacheStats stats;
+
+    static VkPipelineCreationFeedbackCreateInfoEXT feedbackCreateInfo(const void* next, VkPipelineCreationFeedbackEXT* pipelineFeedback,
+        std::vector<VkPipelineCreationFeedbackEXT>& stageFeedbacks) {
+        VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+        feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+        feedbackInfo.pNext = next;
+        feedbackInfo.pPipelineCreationFeedback = pipelineFeedback;
+        feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageFeedbacks.size());
+        feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+        return feedbackInfo;
+    }
+
+    // hit/miss bookkeeping shared by both pipeline kinds
+    void record(const std::string& key, double ms, const VkPipelineCreationFeedbackEXT& pipelineFeedback) {
+        uint64_t keyHash = hashBytes(key.data(), key.size());
+        auto known = records.find(keyHash);
+
+        bool hit;
+        if (creationFeedback && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+            hit = (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+        }
+        else {
+            hit = stats.loadedBytes > 0 && known != records.end();
+        }
+
+        stats.pipelineCount++;
+        stats.compileMs += ms;
+        if (hit) {
+            stats.cacheHits++;
+            if (known != records.end()) {
+                stats.savedMs += std::max(0.0, known->second - ms);
+            }
+        }
+        else {
+            // a miss is a full compile, remember it as the cost a later hit avoids
+            records[keyHash] = ms;
+        }
+    }
+
+    // driver data from the file, or nothing if it is missing, damaged or belongs to another device/driver
+    std::vector<char> load() {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open()) {
+            return {};
+        }
+        size_t fileSize = static_cast<size_t>(in.tellg());
+        in.seekg(0);
+
+        PipelineCacheFileHeader header{};
+        if (fileSize < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+            || sizeof(header) + header.recordCount * sizeof(PipelineRecord) + header.dataSize != fileSize) {
+            std::cout << "ignoring pipeline cache " << path << ": unrecognized file" << std::endl;
+            return {};
+        }
+
+        std::vector<PipelineRecord> loadedRecords(header.recordCount);
+        std::vector<char> data(static_cast<size_t>(header.dataSize));
+        in.read(reinterpret_cast<char*>(loadedRecords.data()), loadedRecords.size() * sizeof(PipelineRecord));
+        in.read(data.data(), data.size());
+        if (!in || hashBytes(data.data(), data.size()) != header.dataHash) {
+            std::cout << "ignoring pipeline cache " << path << ": damaged" << std::endl;
+            return {};
+        }
+
+        if (!matchesDevice(data)) {
+            std::cout << "ignoring pipeline cache " << path << ": written by another device or driver" << std::endl;
+            return {};
+        }
+
+        for (const auto& record : loadedRecords) {
+            records[record.keyHash] = record.coldCompileMs;
+        }
+        return data;
+    }
+
+    // the driver blob starts with VkPipelineCacheHeaderVersionOne
+    bool matchesDevice(const std::vector<char>& data) const {
+        VkPipelineCacheHeaderVersionOne vkHeader{};
+        if (data.size() < sizeof(vkHeader)) {
+            return false;
+        }
+        memcpy(&vkHeader, data.data(), sizeof(vkHeader));
+        return vkHeader.headerSize >= sizeof(vkHeader)
+            && vkHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && vkHeader.vendorID == properties.vendorID
+            && vkHeader.deviceID == properties.deviceID
+            && memcmp(vkHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,1130 @@
+#pragma once
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "allocator.h"
+#include "commandrecorder.h"
+#include "gpuprofiler.h"
+
+// Where an image is (layout) and which earlier work touched it (stages/access) when the graph hands it over
+struct RenderGraphImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags access = 0;
+};
+
+struct RenderGraphStats {
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    // render pass instances after merging passes that draw into the same attachments
+    uint32_t renderPassCount = 0;
+    uint32_t barrierCount = 0;
+    // transient memory without and with aliasing
+    VkDeviceSize transientBytesRequested = 0;
+    VkDeviceSize transientBytesAllocated = 0;
+};
+
+// Frame graph over the passes of one frame. Passes declare the images and buffers they read and write, compile()
+// then derives from the declarations alone:
+// - which passes contribute to an imported resource (or are marked with sideEffects); everything else is culled
+// - render passes with initial == final layouts and load/store ops, merging consecutive passes on the same attachments
+// - the minimal image/memory barriers in between, including all layout transitions
+// createResources() allocates the transient images, letting images whose lifetimes do not overlap share memory.
+// Graphics passes are recorded into secondary command buffers in parallel, passes without attachments inline.
+// Passes with a condition are only recorded in frames where it holds, e.g. to keep a cached image from an earlier
+// frame. With dynamic rendering (VK_KHR_dynamic_rendering) there are no render pass or framebuffer objects: groups
+// begin directly on their attachments' views and pipelines are created against the attachment formats
+class RenderGraph {
+public:
+    typedef uint32_t Resource;
+
+    enum class LoadOp {
+        Load,
+        Clear,
+        DontCare
+    };
+
+    // the barriers of a resource cover every layer of its image unless it stands for a single one
+    static const uint32_t ALL_LAYERS = ~0u;
+
+    struct ImageDesc {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        // {0, 0} follows the frame extent given to createResources
+        VkExtent2D extent = { 0, 0 };
+        // imported images only: the array layer the resource is, so the layers of one image can be written by
+        // different passes and are tracked apart. Its imported view has to be of that layer
+        uint32_t layer = ALL_LAYERS;
+    };
+
+    class PassBuilder {
+    public:
+        PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+        PassBuilder& color(Resource image, LoadOp load, VkClearColorValue clear = {}) {
+            VkClearValue value{};
+            value.color = clear;
+            graph.addAccess(pass, image, AccessKind::ColorAttachment, load, value, 0, 0);
+            return *this;
+        }
+
+        PassBuilder& depth(Resource image, LoadOp load, VkClearDepthStencilValue clear = { 1.0f, 0 }) {
+            VkClearValue value{};
+            value.depthStencil = clear;
+            graph.addAccess(pass, image, AccessKind::DepthAttachment, load, value, 0, 0);
+            return *this;
+        }
+
+        PassBuilder& sampled(Resource image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) {
+            graph.addAccess(pass, image, AccessKind::Sampled, LoadOp::Load, {}, stages, VK_ACCESS_SHADER_READ_BIT);
+            return *this;
+        }
+
+        PassBuilder& readBuffer(Resource buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+            graph.addAccess(pass, buffer, AccessKind::BufferRead, LoadOp::Load, {}, stages, access);
+            return *this;
+        }
+
+        PassBuilder& writeBuffer(Resource buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+            graph.addAccess(pass, buffer, AccessKind::BufferWrite, LoadOp::Load, {}, stages, access);
+            return *this;
+        }
+
+        // an image the pass copies from with transfer commands
+        PassBuilder& copySource(Resource image) {
+            graph.addAccess(pass, image, AccessKind::TransferSource, LoadOp::Load, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            return *this;
+        }
+
+        // an image the pass overwrites as a whole with transfer commands
+        PassBuilder& copyDestination(Resource image) {
+            graph.addAccess(pass, image, AccessKind::TransferDestination, LoadOp::DontCare, {}, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            return *this;
+        }
+
+        // asked once per execute(), the pass is skipped in frames where it returns false. Its barriers still run and
+        // keep the contents of what it writes, so a skipped pass leaves what an earlier frame wrote. Only useful for
+        // imported images, transient ones don't outlive the frame
+        PassBuilder& condition(std::function<bool()> enabled) {
+            graph.passes[pass].condition = std::move(enabled);
+            return *this;
+        }
+
+        // keeps the pass even if nothing in the graph consumes what it writes
+        PassBuilder& sideEffects() {
+            graph.passes[pass].sideEffects = true;
+            return *this;
+        }
+
+        // graphics passes get a secondary command buffer inside their render pass, which has to set its own dynamic
+        // state. Runs on a worker thread, so it must only read shared state
+        PassBuilder& record(std::function<void(VkCommandBuffer)> callback) {
+            graph.passes[pass].record = std::move(callback);
+            return *this;
+        }
+
+        uint32_t index() const {
+            return pass;
+        }
+
+    private:
+        RenderGraph& graph;
+        uint32_t pass;
+    };
+
+    void init(VkDevice device, DeviceMemoryAllocator* allocator) {
+        this->device = device;
+        this->allocator = allocator;
+    }
+
+    Resource createImage(const std::string& name, const ImageDesc& desc) {
+        ResourceNode node;
+        node.name = name;
+        node.isImage = true;
+        node.desc = desc;
+        resources.push_back(node);
+        return static_cast<Resource>(resources.size() - 1);
+    }
+
+    // an image owned outside the graph. initial describes how it arrives every frame, final how it has to be left;
+    // for images that persist between frames both are usually the same
+    Resource importImage(const std::string& name, const ImageDesc& desc, RenderGraphImageState initial, RenderGraphImageState final) {
+        Resource resource = createImage(name, desc);
+        resources[resource].imported = true;
+        resources[resource].initial = initial;
+        resources[resource].final = final;
+        return resource;
+    }
+
+    Resource importBuffer(const std::string& name, VkBuffer buffer) {
+        ResourceNode node;
+        node.name = name;
+        node.imported = true;
+        node.buffer = buffer;
+        resources.push_back(node);
+        return static_cast<Resource>(resources.size() - 1);
+    }
+
+    // swap chains import one image per variant; execute() picks the variant to render into
+    void setImportedImages(Resource resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views) {
+        resources[resource].importedImages = images;
+        resources[resource].importedViews = views;
+    }
+
+    PassBuilder addPass(const std::string& name) {
+        PassNode node;
+        node.name = name;
+        passes.push_back(node);
+        return PassBuilder(*this, static_cast<uint32_t>(passes.size() - 1));
+    }
+
+    void compile() {
+        cullPasses();
+        buildGroups();
+        buildBarriers();
+        describeAttachments();
+        if (usesDynamicRendering()) {
+            describeRendering();
+        }
+        else {
+            createRenderPasses();
+        }
+
+        stats.passCount = static_cast<uint32_t>(passes.size());
+        stats.culledPassCount = 0;
+        for (const auto& pass : passes) {
+            stats.culledPassCount += pass.culled ? 1 : 0;
+        }
+        stats.renderPassCount = 0;
+        stats.barrierCount = 0;
+        for (const auto& group : groups) {
+            stats.renderPassCount += group.attachments.empty() ? 0 : 1;
+            stats.barrierCount += static_cast<uint32_t>(group.barriers.images.size()) + (group.barriers.memorySrc ? 1 : 0);
+        }
+        stats.barrierCount += static_cast<uint32_t>(finalBarriers.images.size()) + (finalBarriers.memorySrc ? 1 : 0);
+    }
+
+    // the transient image behind resource, valid between createResources and destroyResources. For passes that need
+    // their own views, e.g. of a single aspect
+    VkImage image(Resource resource) const {
+        return resources[resource].image;
+    }
+
+    // before compile(): begin the groups with these (vkCmdBeginRenderingKHR/vkCmdEndRenderingKHR) instead of render
+    // pass objects. A resize then only recreates the transient images, there are no framebuffers to rebuild
+    void setDynamicRendering(PFN_vkCmdBeginRenderingKHR begin, PFN_vkCmdEndRenderingKHR end) {
+        beginRendering = begin;
+        endRendering = end;
+    }
+
+    bool usesDynamicRendering() const {
+        return beginRendering != nullptr;
+    }
+
+    // render pass a pass is recorded in. Null for culled passes, passes without attachments and dynamic rendering
+    VkRenderPass renderPass(uint32_t pass) const {
+        return passes[pass].culled ? VK_NULL_HANDLE : groups[passes[pass].group].renderPass;
+    }
+
+    // points a pipeline that draws in pass at what it is recorded in: the render pass, or with dynamic rendering the
+    // attachment formats chained into pNext. The chained struct lives as long as the graph
+    void setPipelineTarget(VkGraphicsPipelineCreateInfo& pipelineInfo, uint32_t pass) const {
+        pipelineInfo.subpass = 0;
+        if (passes[pass].culled || !usesDynamicRendering()) {
+            pipelineInfo.renderPass = renderPass(pass);
+            return;
+        }
+        const Group& group = groups[passes[pass].group];
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+        pipelineInfo.pNext = group.attachments.empty() ? pipelineInfo.pNext : &group.pipelineRendering;
+    }
+
+    // size dependent part: transient images, their memory and the framebuffers. Imported images must be set already
+    void createResources(VkExtent2D frameExtent) {
+        this->frameExtent = frameExtent;
+        createTransientImages();
+        for (auto& group : groups) {
+            if (!group.attachments.empty()) {
+                group.extent = extentOf(resources[group.attachments.front().resource]);
+            }
+        }
+        if (!usesDynamicRendering()) {
+            createFramebuffers();
+        }
+        patchTransientBarriers();
+    }
+
+    void destroyResources() {
+        for (auto& group : groups) {
+            for (VkFramebuffer framebuffer : group.framebuffers) {
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+            group.framebuffers.clear();
+        }
+        for (auto& resource : resources) {
+            if (resource.imported || !resource.isImage) {
+                continue;
+            }
+            vkDestroyImageView(device, resource.view, nullptr);
+            vkDestroyImage(device, resource.image, nullptr);
+            resource.view = VK_NULL_HANDLE;
+            resource.image = VK_NULL_HANDLE;
+        }
+        for (auto& memory : transientMemory) {
+            allocator->free(memory);
+        }
+        transientMemory.clear();
+    }
+
+    // records the whole frame into primary. variant selects the imported image of every multi-image import
+    void execute(VkCommandBuffer primary, uint32_t variant, uint32_t frame, ParallelCommandRecorder& recorder, GpuProfiler* profiler = nullptr) {
+        std::vector<uint32_t> scopes(passes.size(), GpuProfiler::NO_SCOPE);
+        std::vector<SecondaryRecordTask> tasks;
+        std::vector<uint32_t> taskPasses;
+        std::vector<bool> skipped(passes.size(), false);
+        for (uint32_t p = 0; p < passes.size(); p++) {
+            const PassNode& pass = passes[p];
+            skipped[p] = pass.culled || (pass.condition && !pass.condition());
+            if (skipped[p]) {
+                continue;
+            }
+            if (profiler) {
+                scopes[p] = profiler->reserveScope(pass.name);
+            }
+            const Group& group = groups[pass.group];
+            if (group.attachments.empty()) {
+                continue;
+            }
+            SecondaryRecordTask task;
+            if (usesDynamicRendering()) {
+                task.rendering = &group.inheritanceRendering;
+            }
+            else {
+                task.renderPass = group.renderPass;
+                task.framebuffer = group.framebuffers[std::min<size_t>(variant, group.framebuffers.size() - 1)];
+            }
+            uint32_t scope = scopes[p];
+            task.record = [this, p, scope, profiler](VkCommandBuffer commandBuffer) {
+                if (profiler) {
+                    profiler->writeBegin(commandBuffer, scope);
+                }
+                if (passes[p].record) {
+                    passes[p].record(commandBuffer);
+                }
+                if (profiler) {
+                    profiler->writeEnd(commandBuffer, scope);
+                }
+            };
+            tasks.push_back(std::move(task));
+            taskPasses.push_back(p);
+        }
+
+        std::vector<VkCommandBuffer> secondaries = recorder.record(frame, tasks);
+        std::vector<VkCommandBuffer> passSecondaries(passes.size(), VK_NULL_HANDLE);
+        for (size_t i = 0; i < taskPasses.size(); i++) {
+            passSecondaries[taskPasses[i]] = secondaries[i];
+        }
+
+        for (const Group& group : groups) {
+            recordBarriers(primary, group.barriers, variant);
+
+            if (group.attachments.empty()) {
+                for (uint32_t p : group.passes) {
+                    if (skipped[p]) {
+                        continue;
+                    }
+                    if (profiler) {
+                        profiler->writeBegin(primary, scopes[p]);
+                    }
+                    if (passes[p].record) {
+                        passes[p].record(primary);
+                    }
+                    if (profiler) {
+                        profiler->writeEnd(primary, scopes[p]);
+                    }
+                }
+                continue;
+            }
+
+            std::vector<VkCommandBuffer> groupSecondaries;
+            for (uint32_t p : group.passes) {
+                if (!skipped[p]) {
+                    groupSecondaries.push_back(passSecondaries[p]);
+                }
+            }
+            if (groupSecondaries.empty()) {
+                continue;
+            }
+
+            if (usesDynamicRendering()) {
+                beginGroupRendering(primary, group, variant);
+                vkCmdExecuteCommands(primary, static_cast<uint32_t>(groupSecondaries.size()), groupSecondaries.data());
+                endRendering(primary);
+                continue;
+            }
+
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = group.renderPass;
+            renderPassInfo.framebuffer = group.framebuffers[std::min<size_t>(variant, group.framebuffers.size() - 1)];
+            renderPassInfo.renderArea.offset = { 0, 0 };
+            renderPassInfo.renderArea.extent = group.extent;
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(group.clearValues.size());
+            renderPassInfo.pClearValues = group.clearValues.data();
+
+            vkCmdBeginRenderPass(primary, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(primary, static_cast<uint32_t>(groupSecondaries.size()), groupSecondaries.data());
+            vkCmdEndRenderPass(primary);
+        }
+
+        recordBarriers(primary, finalBarriers, variant);
+    }
+
+    const RenderGraphStats& getStats() const {
+        return stats;
+    }
+
+    void destroy() {
+        destroyResources();
+        for (auto& group : groups) {
+            if (group.renderPass != VK_NULL_HANDLE) {
+                vkDestroyRenderPass(device, group.renderPass, nullptr);
+            }
+        }
+        groups.clear();
+    }
+
+private:
+    enum class AccessKind {
+        ColorAttachment,
+        DepthAttachment,
+        Sampled,
+        BufferRead,
+        BufferWrite,
+        TransferSource,
+        TransferDestination
+    };
+
+    struct Access {
+        Resource resource;
+        AccessKind kind;
+        LoadOp load;
+        VkClearValue clear;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+
+        bool isAttachment() const {
+            return kind == AccessKind::ColorAttachment || kind == AccessKind::DepthAttachment;
+        }
+        bool writes() const {
+            return isAttachment() || kind == AccessKind::BufferWrite || kind == AccessKind::TransferDestination;
+        }
+        // whether the previous contents matter
+        bool reads() const {
+            return !isAttachment() ? kind != AccessKind::BufferWrite && kind != AccessKind::TransferDestination : load == LoadOp::Load;
+        }
+    };
+
+    struct PassNode {
+        std::string name;
+        std::vector<Access> accesses;
+        std::function<void(VkCommandBuffer)> record;
+        std::function<bool()> condition;
+        bool sideEffects = false;
+        bool culled = false;
+        uint32_t group = 0;
+
+        bool hasAttachments() const {
+            return std::any_of(accesses.begin(), accesses.end(), [](const Access& access) { return access.isAttachment(); });
+        }
+    };
+
+    struct ResourceNode {
+        std::string name;
+        bool isImage = false;
+        bool imported = false;
+        ImageDesc desc;
+        RenderGraphImageState initial;
+        RenderGraphImageState final;
+
+        std::vector<VkImage> importedImages;
+        std::vector<VkImageView> importedViews;
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        // transient images only
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkImageUsageFlags usage = 0;
+        uint32_t firstGroup = ~0u;
+        uint32_t lastGroup = 0;
+        // stages/access of the last use in the frame, which the next frame's first use has to wait for
+        VkPipelineStageFlags lastStages = 0;
+        VkAccessFlags lastAccess = 0;
+        uint32_t memoryBucket = 0;
+
+        VkImage imageFor(uint32_t variant) const {
+            if (!imported) {
+                return image;
+            }
+            return importedImages.empty() ? VK_NULL_HANDLE : importedImages[std::min<size_t>(variant, importedImages.size() - 1)];
+        }
+        VkImageView viewFor(uint32_t variant) const {
+            if (!imported) {
+                return view;
+            }
+            return importedViews.empty() ? VK_NULL_HANDLE : importedViews[std::min<size_t>(variant, importedViews.size() - 1)];
+        }
+    };
+
+    struct ImageBarrier {
+        Resource resource;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+        // first use of a transient image in the frame, waits for whatever used its memory last
+        bool transientEntry;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkAccessFlags memorySrc = 0;
+        VkAccessFlags memoryDst = 0;
+        std::vector<ImageBarrier> images;
+    };
+
+    // consecutive passes recorded into the same render pass instance, or a single pass without attachments
+    struct Group {
+        std::vector<uint32_t> passes;
+        std::vector<Access> attachments;
+        BarrierBatch compiledBarriers;
+        BarrierBatch barriers;
+        // formats, load/store ops and layouts of the attachments, in attachment order
+        std::vector<VkAttachmentDescription> descriptions;
+        std::vector<VkClearValue> clearValues;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<VkFramebuffer> framebuffers;
+        // dynamic rendering: the attachment formats for pipelines and secondary command buffers, pointing into
+        // colorFormats
+        std::vector<VkFormat> colorFormats;
+        VkPipelineRenderingCreateInfoKHR pipelineRendering{};
+        VkCommandBufferInheritanceRenderingInfoKHR inheritanceRendering{};
+        VkExtent2D extent = { 0, 0 };
+    };
+
+    // tracked per resource while walking the groups in order
+    struct TrackedState {
+        VkImageLayout layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+        // stages the last write is already visible to, reads there need no barrier
+        VkPipelineStageFlags visibleStages;
+        VkPipelineStageFlags readStages;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    std::vector<ResourceNode> resources;
+    std::vector<PassNode> passes;
+    std::vector<Group> groups;
+    BarrierBatch finalBarriers;
+    std::vector<MemoryAllocation> transientMemory;
+    VkExtent2D frameExtent = { 0, 0 };
+    RenderGraphStats stats;
+    PFN_vkCmdBeginRenderingKHR beginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR endRendering = nullptr;
+
+    // only writes have to be made available, read bits in a source access mask do nothing
+    static VkAccessFlags writesOf(VkAccessFlags access) {
+        return access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+    }
+
+    static bool hasStencil(VkFormat format) {
+        return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT
+            || format == VK_FORMAT_S8_UINT;
+    }
+
+    static bool isDepthFormat(VkFormat format) {
+        return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT || hasStencil(format);
+    }
+
+    static VkImageAspectFlags aspectOf(VkFormat format) {
+        if (!isDepthFormat(format)) {
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+        VkImageAspectFlags aspect = format == VK_FORMAT_S8_UINT ? 0 : VK_IMAGE_ASPECT_DEPTH_BIT;
+        return hasStencil(format) ? aspect | VK_IMAGE_ASPECT_STENCIL_BIT : aspect;
+    }
+
+    VkExtent2D extentOf(const ResourceNode& resource) const {
+        return resource.desc.extent.width == 0 ? frameExtent : resource.desc.extent;
+    }
+
+    void addAccess(uint32_t pass, Resource resource, AccessKind kind, LoadOp load, VkClearValue clear, VkPipelineStageFlags stages, VkAccessFlags access) {
+        Access entry{ resource, kind, load, clear, stages, access, VK_IMAGE_LAYOUT_UNDEFINED };
+        switch (kind) {
+        case AccessKind::ColorAttachment:
+            entry.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            entry.access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (load == LoadOp::Load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0);
+            entry.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            resources[resource].usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            break;
+        case AccessKind::DepthAttachment:
+            entry.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            entry.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            entry.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            resources[resource].usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            break;
+        case AccessKind::Sampled:
+            entry.layout = isDepthFormat(resources[resource].desc.format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            resources[resource].usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+            break;
+        case AccessKind::TransferSource:
+            entry.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            resources[resource].usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            break;
+        case AccessKind::TransferDestination:
+            entry.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            resources[resource].usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            break;
+        default:
+            break;
+        }
+        passes[pass].accesses.push_back(entry);
+    }
+
+    // walks backwards from the imported resources: a pass survives if a surviving pass (or the outside world) reads
+    // something it writes. A write that does not keep the old contents ends the interest in earlier writers
+    void cullPasses() {
+        std::vector<bool> needed(resources.size(), false);
+        for (size_t r = 0; r < resources.size(); r++) {
+            needed[r] = resources[r].imported;
+        }
+        for (size_t p = passes.size(); p-- > 0;) {
+            PassNode& pass = passes[p];
+            bool contributes = pass.sideEffects;
+            for (const Access& access : pass.accesses) {
+                contributes = contributes || (access.writes() && needed[access.resource]);
+            }
+            pass.culled = !contributes;
+            if (pass.culled) {
+                continue;
+            }
+            for (const Access& access : pass.accesses) {
+                if (access.writes() && !access.reads() && !resources[access.resource].imported) {
+                    needed[access.resource] = false;
+                }
+            }
+            for (const Access& access : pass.accesses) {
+                if (access.reads()) {
+                    needed[access.resource] = true;
+                }
+            }
+        }
+    }
+
+    static bool sameAttachments(const std::vector<Access>& a, const std::vector<Access>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].resource != b[i].resource || a[i].kind != b[i].kind) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // a pass joins the previous render pass instance if it only continues drawing into the same attachments. Draws in
+    // one subpass are ordered by the rasterizer, so no barrier is needed between them. Buffers and images it reads
+    // besides (e.g. indirect commands, shadow maps) get their barriers in front of the render pass instance, as long
+    // as none of them is one of its attachments
+    void buildGroups() {
+        groups.clear();
+        for (uint32_t p = 0; p < passes.size(); p++) {
+            PassNode& pass = passes[p];
+            if (pass.culled) {
+                continue;
+            }
+            std::vector<Access> attachments;
+            bool allLoad = true;
+            for (const Access& access : pass.accesses) {
+                if (access.isAttachment()) {
+                    attachments.push_back(access);
+                    allLoad = allLoad && access.load == LoadOp::Load;
+                }
+            }
+            bool onlyOutsideReads = std::all_of(pass.accesses.begin(), pass.accesses.end(), [&](const Access& access) {
+                return access.isAttachment() || access.kind == AccessKind::BufferRead
+                    || (access.kind == AccessKind::Sampled && std::none_of(attachments.begin(), attachments.end(),
+                        [&](const Access& attachment) { return attachment.resource == access.resource; }));
+            });
+
+            bool merge = !groups.empty() && !attachments.empty() && onlyOutsideReads && allLoad
+                && !groups.back().attachments.empty()
+                && sameAttachments(groups.back().attachments, attachments);
+            if (!merge) {
+                groups.push_back({});
+                groups.back().attachments = attachments;
+            }
+            groups.back().passes.push_back(p);
+            pass.group = static_cast<uint32_t>(groups.size() - 1);
+        }
+    }
+
+    void addImageBarrier(BarrierBatch& batch, Resource resource, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess, bool transientEntry) {
+        batch.srcStages |= srcStages;
+        batch.dstStages |= dstStages;
+        batch.images.push_back({ resource, oldLayout, newLayout, srcAccess, dstAccess, transientEntry });
+    }
+
+    // waits only where a hazard exists: read after write (unless already visible to these stages), write after
+    // read or write, and any layout change
+    void buildBarriers() {
+        std::vector<TrackedState> states(resources.size());
+        std::vector<bool> touched(resources.size(), false);
+        for (size_t r = 0; r < resources.size(); r++) {
+            const ResourceNode& resource = resources[r];
+            states[r] = { resource.imported ? resource.initial.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+                resource.imported ? resource.initial.stages : 0, resource.imported ? writesOf(resource.initial.access) : 0, 0, 0 };
+        }
+
+        for (uint32_t g = 0; g < groups.size(); g++) {
+            Group& group = groups[g];
+            BarrierBatch batch;
+            // merged passes share the first pass's attachment accesses, only their buffer reads are added
+            std::vector<Access> accesses = passes[group.passes.front()].accesses;
+            // a pass that may be skipped must not have its images discarded by the layout transition in front of it
+            bool keepContents = std::any_of(group.passes.begin(), group.passes.end(), [this](uint32_t p) { return static_cast<bool>(passes[p].condition); });
+            for (size_t i = 1; i < group.passes.size(); i++) {
+                for (const Access& access : passes[group.passes[i]].accesses) {
+                    if (!access.isAttachment()) {
+                        accesses.push_back(access);
+                    }
+                }
+            }
+            for (const Access& access : accesses) {
+                ResourceNode& resource = resources[access.resource];
+                TrackedState& state = states[access.resource];
+                bool firstUse = !touched[access.resource];
+                touched[access.resource] = true;
+
+                if (!resource.imported && resource.isImage) {
+                    resource.firstGroup = std::min(resource.firstGroup, g);
+                    resource.lastGroup = std::max(resource.lastGroup, g);
+                }
+
+                bool transientEntry = firstUse && !resource.imported;
+                bool layoutChange = resource.isImage && state.layout != access.layout;
+                bool readAfterWrite = access.reads() && state.writeStages != 0 && (access.stages & ~state.visibleStages) != 0;
+                bool writeAfterAny = access.writes() && (state.writeStages != 0 || state.readStages != 0);
+                if (layoutChange || readAfterWrite || writeAfterAny || transientEntry) {
+                    VkPipelineStageFlags srcStages = state.writeStages;
+                    if (access.writes() || layoutChange) {
+                        srcStages |= state.readStages;
+                    }
+                    if (resource.isImage) {
+                        VkImageLayout oldLayout = access.reads() || keepContents ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                        addImageBarrier(batch, access.resource, oldLayout, access.layout, srcStages, state.writeAccess, access.stages, access.access, transientEntry);
+                    }
+                    else {
+                        batch.srcStages |= srcStages;
+                        batch.dstStages |= access.stages;
+                        batch.memorySrc |= state.writeAccess;
+                        batch.memoryDst |= access.access;
+                    }
+                    state.visibleStages = access.stages;
+                    if (access.writes() || layoutChange) {
+                        state.readStages = 0;
+                    }
+                }
+
+                state.layout = resource.isImage ? access.layout : state.layout;
+                if (access.writes()) {
+                    state.writeStages = access.stages;
+                    state.writeAccess = writesOf(access.access);
+                    state.visibleStages = 0;
+                    state.readStages = 0;
+                }
+                else {
+                    state.readStages |= access.stages;
+                }
+                resource.lastStages = access.stages;
+                resource.lastAccess = access.access;
+            }
+            group.compiledBarriers = batch;
+            group.barriers = batch;
+        }
+
+        // hand imported images over in the state the outside world expects
+        finalBarriers = {};
+        for (size_t r = 0; r < resources.size(); r++) {
+            const ResourceNode& resource = resources[r];
+            if (!resource.imported || !resource.isImage || !touched[r]) {
+                continue;
+            }
+            const TrackedState& state = states[r];
+            if (state.layout != resource.final.layout || state.writeStages != 0) {
+                VkPipelineStageFlags dstStages = resource.final.stages ? resource.final.stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+                addImageBarrier(finalBarriers, static_cast<Resource>(r), state.layout, resource.final.layout,
+                    state.writeStages | state.readStages, state.writeAccess, dstStages, resource.final.access, false);
+            }
+        }
+    }
+
+    // every layout transition is done by the graph's barriers, so attachments stay in one layout for the whole pass
+    void describeAttachments() {
+        for (uint32_t g = 0; g < groups.size(); g++) {
+            Group& group = groups[g];
+            group.descriptions.clear();
+            group.clearValues.clear();
+            for (const Access& access : group.attachments) {
+                const ResourceNode& resource = resources[access.resource];
+
+                VkAttachmentDescription description{};
+                description.format = resource.desc.format;
+                description.samples = VK_SAMPLE_COUNT_1_BIT;
+                description.loadOp = access.load == LoadOp::Load ? VK_ATTACHMENT_LOAD_OP_LOAD
+                    : access.load == LoadOp::Clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                description.storeOp = isReadAfter(access.resource, g) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                bool stencil = hasStencil(resource.desc.format);
+                description.stencilLoadOp = stencil ? description.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                description.stencilStoreOp = stencil ? description.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                description.initialLayout = access.layout;
+                description.finalLayout = access.layout;
+                group.descriptions.push_back(description);
+                group.clearValues.push_back(access.clear);
+            }
+        }
+    }
+
+    void createRenderPasses() {
+        for (Group& group : groups) {
+            if (group.attachments.empty()) {
+                continue;
+            }
+
+            std::vector<VkAttachmentReference> colorReferences;
+            VkAttachmentReference depthReference{};
+            bool hasDepth = false;
+            for (uint32_t a = 0; a < group.attachments.size(); a++) {
+                const Access& access = group.attachments[a];
+                if (access.kind == AccessKind::DepthAttachment) {
+                    depthReference = { a, access.layout };
+                    hasDepth = true;
+                }
+                else {
+                    colorReferences.push_back({ a, access.layout });
+                }
+            }
+
+            VkSubpassDescription subpass{};
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+            subpass.pColorAttachments = colorReferences.data();
+            subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+            VkRenderPassCreateInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            renderPassInfo.attachmentCount = static_cast<uint32_t>(group.descriptions.size());
+            renderPassInfo.pAttachments = group.descriptions.data();
+            renderPassInfo.subpassCount = 1;
+            renderPassInfo.pSubpasses = &subpass;
+
+            if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &group.renderPass) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render pass!");
+            }
+        }
+    }
+
+    // the attachment formats in the order the subpass of a render pass would list them. A depth/stencil format is
+    // both the depth and the stencil attachment
+    void describeRendering() {
+        for (Group& group : groups) {
+            if (group.attachments.empty()) {
+                continue;
+            }
+            group.colorFormats.clear();
+            VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+            VkFormat stencilFormat = VK_FORMAT_UNDEFINED;
+            for (const Access& access : group.attachments) {
+                VkFormat format = resources[access.resource].desc.format;
+                if (access.kind != AccessKind::DepthAttachment) {
+                    group.colorFormats.push_back(format);
+                    continue;
+                }
+                depthFormat = (aspectOf(format) & VK_IMAGE_ASPECT_DEPTH_BIT) ? format : VK_FORMAT_UNDEFINED;
+                stencilFormat = hasStencil(format) ? format : VK_FORMAT_UNDEFINED;
+            }
+
+            group.pipelineRendering = {};
+            group.pipelineRendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+            group.pipelineRendering.colorAttachmentCount = static_cast<uint32_t>(group.colorFormats.size());
+            group.pipelineRendering.pColorAttachmentFormats = group.colorFormats.data();
+            group.pipelineRendering.depthAttachmentFormat = depthFormat;
+            group.pipelineRendering.stencilAttachmentFormat = stencilFormat;
+
+            group.inheritanceRendering = {};
+            group.inheritanceRendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+            group.inheritanceRendering.colorAttachmentCount = static_cast<uint32_t>(group.colorFormats.size());
+            group.inheritanceRendering.pColorAttachmentFormats = group.colorFormats.data();
+            group.inheritanceRendering.depthAttachmentFormat = depthFormat;
+            group.inheritanceRendering.stencilAttachmentFormat = stencilFormat;
+            group.inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        }
+    }
+
+    // the dynamic rendering counterpart of vkCmdBeginRenderPass, the draws come from secondary command buffers
+    void beginGroupRendering(VkCommandBuffer commandBuffer, const Group& group, uint32_t variant) const {
+        std::vector<VkRenderingAttachmentInfoKHR> colorAttachments;
+        VkRenderingAttachmentInfoKHR depthAttachment{};
+        VkRenderingAttachmentInfoKHR stencilAttachment{};
+        for (size_t a = 0; a < group.attachments.size(); a++) {
+            const Access& access = group.attachments[a];
+            const VkAttachmentDescription& description = group.descriptions[a];
+            VkRenderingAttachmentInfoKHR attachment{};
+            attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            attachment.imageView = resources[access.resource].viewFor(variant);
+            attachment.imageLayout = access.layout;
+            attachment.loadOp = description.loadOp;
+            attachment.storeOp = description.storeOp;
+            attachment.clearValue = access.clear;
+            if (access.kind != AccessKind::DepthAttachment) {
+                colorAttachments.push_back(attachment);
+                continue;
+            }
+            depthAttachment = attachment;
+            stencilAttachment = attachment;
+            stencilAttachment.loadOp = description.stencilLoadOp;
+            stencilAttachment.storeOp = description.stencilStoreOp;
+        }
+
+        VkRenderingInfoKHR renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR;
+        renderingInfo.renderArea.offset = { 0, 0 };
+        renderingInfo.renderArea.extent = group.extent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+        renderingInfo.pColorAttachments = colorAttachments.data();
+        renderingInfo.pDepthAttachment = group.pipelineRendering.depthAttachmentFormat != VK_FORMAT_UNDEFINED ? &depthAttachment : nullptr;
+        renderingInfo.pStencilAttachment = group.pipelineRendering.stencilAttachmentFormat != VK_FORMAT_UNDEFINED ? &stencilAttachment : nullptr;
+        beginRendering(commandBuffer, &renderingInfo);
+    }
+
+    // contents have to be stored if a later group reads them or they leave the graph
+    bool isReadAfter(Resource resource, uint32_t group) const {
+        if (resources[resource].imported) {
+            return true;
+        }
+        for (uint32_t g = group + 1; g < groups.size(); g++) {
+            for (uint32_t p : groups[g].passes) {
+                for (const Access& access : passes[p].accesses) {
+                    if (access.resource == resource) {
+                        return access.reads();
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // greedy aliasing: largest images first, each goes into the first memory bucket whose images are all dead
+    // before it is first used or born after it is last used
+    void createTransientImages() {
+        struct Bucket {
+            VkMemoryRequirements requirements;
+            std::vector<Resource> members;
+        };
+        std::vector<Bucket> buckets;
+        std::vector<std::pair<VkMemoryRequirements, Resource>> images;
+
+        stats.transientBytesRequested = 0;
+        for (Resource r = 0; r < resources.size(); r++) {
+            ResourceNode& resource = resources[r];
+            if (resource.imported || !resource.isImage || resource.firstGroup == ~0u) {
+                continue;
+            }
+            VkExtent2D extent = extentOf(resource);
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = { extent.width, extent.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = resource.desc.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = resource.usage;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create transient image!");
+            }
+
+            VkMemoryRequirements requirements;
+            vkGetImageMemoryRequirements(device, resource.image, &requirements);
+            stats.transientBytesRequested += requirements.size;
+            images.push_back({ requirements, r });
+        }
+
+        std::stable_sort(images.begin(), images.end(), [](const auto& a, const auto& b) { return a.first.size > b.first.size; });
+        for (const auto& entry : images) {
+            const ResourceNode& resource = resources[entry.second];
+            Bucket* target = nullptr;
+            for (auto& bucket : buckets) {
+                bool compatible = (bucket.requirements.memoryTypeBits & entry.first.memoryTypeBits) != 0;
+                for (Resource member : bucket.members) {
+                    const ResourceNode& other = resources[member];
+                    compatible = compatible && (other.lastGroup < resource.firstGroup || resource.lastGroup < other.firstGroup);
+                }
+                if (compatible) {
+                    target = &bucket;
+                    break;
+                }
+            }
+            if (!target) {
+                buckets.push_back({ entry.first, {} });
+                target = &buckets.back();
+            }
+            target->requirements.size = std::max(target->requirements.size, entry.first.size);
+            target->requirements.alignment = std::max(target->requirements.alignment, entry.first.alignment);
+            target->requirements.memoryTypeBits &= entry.first.memoryTypeBits;
+            target->members.push_back(entry.second);
+        }
+
+        stats.transientBytesAllocated = 0;
+        for (uint32_t b = 0; b < buckets.size(); b++) {
+            MemoryAllocation memory = allocator->allocate(buckets[b].requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationKind::Optimal);
+            stats.transientBytesAllocated += buckets[b].requirements.size;
+            for (Resource member : buckets[b].members) {
+                ResourceNode& resource = resources[member];
+                resource.memoryBucket = b;
+                if (vkBindImageMemory(device, resource.image, memory.memory, memory.offset) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to bind transient image memory!");
+                }
+
+                VkImageViewCreateInfo viewInfo{};
+                viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                viewInfo.image = resource.image;
+                viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                viewInfo.format = resource.desc.format;
+                viewInfo.subresourceRange.aspectMask = aspectOf(resource.desc.format);
+                viewInfo.subresourceRange.levelCount = 1;
+                viewInfo.subresourceRange.layerCount = 1;
+                if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create transient image view!");
+                }
+            }
+            transientMemory.push_back(memory);
+        }
+    }
+
+    void createFramebuffers() {
+        for (auto& group : groups) {
+            if (group.renderPass == VK_NULL_HANDLE) {
+                continue;
+            }
+            size_t variants = 1;
+            for (const Access& access : group.attachments) {
+                variants = std::max(variants, resources[access.resource].importedViews.size());
+            }
+
+            for (uint32_t v = 0; v < variants; v++) {
+                std::vector<VkImageView> views;
+                for (const Access& access : group.attachments) {
+                    views.push_back(resources[access.resource].viewFor(v));
+                }
+
+                VkFramebufferCreateInfo framebufferInfo{};
+                framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+                framebufferInfo.renderPass = group.renderPass;
+                framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+                framebufferInfo.pAttachments = views.data();
+                framebufferInfo.width = group.extent.width;
+                framebufferInfo.height = group.extent.height;
+                framebufferInfo.layers = 1;
+
+                VkFramebuffer framebuffer;
+                if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create framebuffer!");
+                }
+                group.framebuffers.push_back(framebuffer);
+            }
+        }
+    }
+
+    // the first use of a transient image waits for the last use of every image sharing its memory, whether that was
+    // earlier in this frame or at the end of the previous one
+    void patchTransientBarriers() {
+        for (auto& group : groups) {
+            group.barriers = group.compiledBarriers;
+            for (auto& barrier : group.barriers.images) {
+                if (!barrier.transientEntry) {
+                    continue;
+                }
+                uint32_t bucket = resources[barrier.resource].memoryBucket;
+                for (const auto& other : resources) {
+                    if (!other.imported && other.isImage && other.image != VK_NULL_HANDLE && other.memoryBucket == bucket) {
+                        group.barriers.srcStages |= other.lastStages;
+                        barrier.srcAccess |= writesOf(other.lastAccess);
+                    }
+                }
+            }
+        }
+    }
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t variant) const {
+        if (batch.images.empty() && batch.memorySrc == 0 && batch.memoryDst == 0 && batch.srcStages == 0) {
+            return;
+        }
+
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        for (const ImageBarrier& entry : batch.images) {
+            const ResourceNode& resource = resources[entry.resource];
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = entry.oldLayout;
+            barrier.newLayout = entry.newLayout;
+            barrier.srcAccessMask = entry.srcAccess;
+            barrier.dstAccessMask = entry.dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = resource.imageFor(variant);
+            barrier.subresourceRange.aspectMask = aspectOf(resource.desc.format);
+            barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            barrier.subresourceRange.baseArrayLayer = resource.desc.layer == ALL_LAYERS ? 0 : resource.desc.layer;
+            barrier.subresourceRange.layerCount = resource.desc.layer == ALL_LAYERS ? VK_REMAINING_ARRAY_LAYERS : 1;
+            imageBarriers.push_back(barrier);
+        }
+
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = batch.memorySrc;
+        memoryBarrier.dstAccessMask = batch.memoryDst;
+        bool hasMemoryBarrier = batch.memorySrc != 0 || batch.memoryDst != 0;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            batch.srcStages ? batch.srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+            batch.dstStages ? batch.dstStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+            0,
+            hasMemoryBarrier ? 1 : 0, hasMemoryBarrier ? &memoryBarrier : nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+};
+
+#endif
@@ -0,0 +1,675 @@
+#pragma once
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "allocator.h"
+#include "culling.h"
+#include "threadpool.h"
+#include "upload.h"
+#include "vertexformat.h"
+
+// where a mesh lives inside the scene's shared vertex and index buffers
+struct SceneMesh {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    // bounding sphere in model space
+    glm::vec3 center;
+    float radius;
+    // VertexLayout::positionDecode of the stored positions
+    glm::vec4 positionDecode;
+    // levels of detail in the scene's LOD table, the first is the full mesh
+    uint32_t firstLod;
+    uint32_t lodCount;
+};
+
+// one level of detail of a mesh (std430), its indices are in the shared index buffer and use the mesh's vertices.
+// error is how far the level strays from the full mesh relative to the mesh's radius, so an instance's error is it
+// times the instance's radius
+struct SceneLod {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    float error;
+    uint32_t padding;
+};
+
+// a level's projected error is kept under threshold pixels, but a coarser level than the previous frame's is only
+// taken once it is under SCENE_LOD_HYSTERESIS times that, so an object at the boundary doesn't flip every frame
+const float SCENE_LOD_HYSTERESIS = 0.75f;
+
+// what picks the levels of detail of a frame. pixelScale turns an error at distance 1 into pixels: half the viewport
+// height times P11 of the projection
+struct SceneLodView {
+    glm::vec3 cameraPosition;
+    float pixelScale;
+    float threshold;
+    float nearPlane;
+};
+
+// per instance vertex stream at binding 1, the vertex shader gets one record per instance next to the mesh's own
+// attributes. The material index picks the surface of the instance
+struct SceneInstance {
+    glm::mat4 model;
+    uint32_t material;
+
+    // the per vertex attributes take the locations below this one
+    static constexpr uint32_t FIRST_LOCATION = 4;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(SceneInstance);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+
+        //a mat4 takes one location per column
+        for (uint32_t column = 0; column < 4; column++) {
+            attributeDescriptions[column].binding = 1;
+            attributeDescriptions[column].location = FIRST_LOCATION + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = static_cast<uint32_t>(offsetof(SceneInstance, model) + column * sizeof(glm::vec4));
+        }
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = FIRST_LOCATION + 4;
+        attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[4].offset = offsetof(SceneInstance, material);
+
+        return attributeDescriptions;
+    }
+};
+
+// what compute culling needs to know about an object (std430), numbered like the draw commands
+struct SceneObject {
+    // world space bounding sphere, radius in w
+    glm::vec4 sphere;
+    uint32_t batch;
+    uint32_t firstCommand;
+    // the mesh's range of the LOD table
+    uint32_t firstLod;
+    uint32_t lodCount;
+};
+
+// levels of detail a mesh can have
+const uint32_t SCENE_MAX_LODS = 8;
+
+struct SceneDrawStats {
+    uint32_t meshCount = 0;
+    uint32_t instanceCount = 0;
+    uint32_t batchCount = 0;
+    // draws of every object unculled, one per run of instances of the same mesh
+    uint32_t instancedCommandCount = 0;
+    uint32_t vertexStride = 0;
+    uint64_t vertexBytes = 0;
+    uint64_t indexBytes = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    // how the batches are submitted, see SceneDrawList::DrawPath
+    const char* drawPath = "";
+    // levels of detail of every mesh together
+    uint32_t lodCount = 0;
+    // of the last CPU cull, objects drawn at each level and the triangles they add up to
+    std::array<uint32_t, SCENE_MAX_LODS> objectsPerLod{};
+    uint64_t culledTriangles = 0;
+};
+
+// The scene as GPU data: every mesh in one vertex and index buffer, one instance record and one
+// VkDrawIndexedIndirectCommand per object, and a draw count per batch. The instance records are a vertex stream, so
+// the objects of one mesh that follow each other in a batch are also drawn as a single instanced command. A batch is the set of objects drawn with one
+// pipeline, its commands are contiguous and go out with a single indirect draw, so recording costs the same for ten
+// objects as for a hundred thousand. The counts live on the GPU too, so a compute pass can compact the commands later.
+// cull() rewrites a frame's copy of the commands with only the objects inside the view, the batches then draw those.
+// A mesh can have coarser levels of detail in the same buffers, cull() then also picks each object's level. Every
+// frame can cull the scene for several views, e.g. the camera and the shadow cascades, each with its own commands
+class SceneDrawList {
+public:
+    // preferred first, the later ones are fallbacks for missing features
+    enum class DrawPath {
+        IndirectCount,
+        Indirect,
+        Direct
+    };
+
+    // the meshes are stored in layout, pipelines drawing the scene take their vertex input from it too
+    void init(VkDevice device, DeviceMemoryAllocator* allocator, const VertexLayout& layout) {
+        this->device = device;
+        this->allocator = allocator;
+        this->layout = layout;
+    }
+
+    // indirectCount is vkCmdDrawIndexedIndirectCount(KHR) if the device has it. Without multiDrawIndirect or
+    // drawIndirectFirstInstance the draws are recorded one by one from the CPU copy of the commands
+    void setDrawPath(bool multiDrawIndirect, bool drawIndirectFirstInstance, uint32_t maxDrawIndirectCount,
+        PFN_vkCmdDrawIndexedIndirectCountKHR indirectCount) {
+        drawIndexedIndirectCount = indirectCount;
+        maxDrawCount = maxDrawIndirectCount;
+        if (!multiDrawIndirect || !drawIndirectFirstInstance) {
+            drawPath = DrawPath::Direct;
+        }
+        else {
+            drawPath = indirectCount != nullptr ? DrawPath::IndirectCount : DrawPath::Indirect;
+        }
+    }
+
+    uint32_t addMesh(const VertexSource& vertices, const std::vector<uint32_t>& indices) {
+        return addMesh(vertices, indices.data(), static_cast<uint32_t>(indices.size()));
+    }
+
+    // packs the full precision vertices into the scene's layout, the indices are relative to the mesh's first vertex
+    uint32_t addMesh(const VertexSource& vertices, const uint32_t* indices, uint32_t indexCount) {
+        SceneMesh mesh{};
+        mesh.indexCount = indexCount;
+        mesh.firstIndex = static_cast<uint32_t>(indexData.size());
+        mesh.vertexOffset = static_cast<int32_t>(vertexData.size() / layout.stride());
+
+        //sphere around the center of the bounding box, not the tightest one but cheap and close enough for culling
+        glm::vec3 minimum(std::numeric_limits<float>::max());
+        glm::vec3 maximum(std::numeric_limits<float>::lowest());
+        for (uint32_t i = 0; i < vertices.count; i++) {
+            glm::vec3 position = vertices.read(i, vertices.positionOffset);
+            minimum = glm::min(minimum, position);
+            maximum = glm::max(maximum, position);
+        }
+        if (vertices.count == 0) {
+            minimum = maximum = glm::vec3(0.f);
+        }
+        mesh.center = (minimum + maximum) * 0.5f;
+        mesh.radius = 0.f;
+        for (uint32_t i = 0; i < vertices.count; i++) {
+            mesh.radius = std::max(mesh.radius, glm::length(vertices.read(i, vertices.positionOffset) - mesh.center));
+        }
+        mesh.firstLod = static_cast<uint32_t>(lods.size());
+        mesh.lodCount = 1;
+        lods.push_back({ indexCount, mesh.firstIndex, 0.f, 0 });
+
+        //quantized over the longest side, the same scale on every axis
+        float extent = std::max({ maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z });
+        mesh.positionDecode = layout.positionDecode(minimum, extent);
+        layout.pack(vertices, minimum, extent, vertexData);
+        maxMeshVertices = std::max(maxMeshVertices, vertices.count);
+        indexData.insert(indexData.end(), indices, indices + indexCount);
+        meshes.push_back(mesh);
+        return static_cast<uint32_t>(meshes.size() - 1);
+    }
+
+    // appends a coarser level of detail to the mesh added last, error in model units. The levels must come finest
+    // first, each with an error at least the one before's
+    void addLod(uint32_t mesh, const std::vector<uint32_t>& indices, float error) {
+        SceneMesh& target = meshes[mesh];
+        if (mesh + 1 != meshes.size() || target.lodCount >= SCENE_MAX_LODS) {
+            throw std::runtime_error("failed to add level of detail: not the last mesh or too many levels!");
+        }
+        uint32_t firstIndex = static_cast<uint32_t>(indexData.size());
+        indexData.insert(indexData.end(), indices.begin(), indices.end());
+        float relative = target.radius > 0.f ? error / target.radius : 0.f;
+        lods.push_back({ static_cast<uint32_t>(indices.size()), firstIndex, std::max(relative, lods.back().error), 0 });
+        target.lodCount++;
+    }
+
+    uint32_t addBatch() {
+        batches.emplace_back();
+        return static_cast<uint32_t>(batches.size() - 1);
+    }
+
+    // instances of one mesh added one after the other share a command when they aren't culled
+    void addInstance(uint32_t batch, uint32_t mesh, const glm::mat4& model, uint32_t material = 0) {
+        batches[batch].instances.push_back({ mesh, { model, material } });
+        instanceTotal++;
+    }
+
+    const SceneMesh& getMesh(uint32_t mesh) const {
+        return meshes[mesh];
+    }
+
+    // copies everything to device local buffers through the upload batch and creates the culled command buffers of
+    // viewCount views for frameCount frames in flight
+    void upload(UploadManager& uploader, uint32_t frameCount, uint32_t viewCount = 1) {
+        std::vector<SceneInstance> instances;
+        objects.clear();
+        commands.clear();
+        instancedCommands.clear();
+        std::vector<uint32_t> counts;
+        for (uint32_t batchIndex = 0; batchIndex < batches.size(); batchIndex++) {
+            Batch& batch = batches[batchIndex];
+            batch.firstCommand = static_cast<uint32_t>(commands.size());
+            for (const auto& entry : batch.instances) {
+                const SceneMesh& mesh = meshes[entry.mesh];
+                VkDrawIndexedIndirectCommand command{};
+                command.indexCount = mesh.indexCount;
+                command.instanceCount = 1;
+                command.firstIndex = mesh.firstIndex;
+                command.vertexOffset = mesh.vertexOffset;
+                //the instance stream starts at the object's record
+                command.firstInstance = static_cast<uint32_t>(instances.size());
+                commands.push_back(command);
+                //the stored positions go back to model space through the instance's matrix
+                SceneInstance instance = entry.instance;
+                instance.model = instance.model * glm::mat4(
+                    glm::vec4(mesh.positionDecode.w, 0.f, 0.f, 0.f),
+                    glm::vec4(0.f, mesh.positionDecode.w, 0.f, 0.f),
+                    glm::vec4(0.f, 0.f, mesh.positionDecode.w, 0.f),
+                    glm::vec4(glm::vec3(mesh.positionDecode), 1.f));
+                instances.push_back(instance);
+
+                //culler objects are numbered like the commands
+                const glm::mat4& model = entry.instance.model;
+                float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+                glm::vec3 center = glm::vec3(model * glm::vec4(mesh.center, 1.f));
+                culler.add(center, mesh.radius * scale);
+                objects.push_back({ glm::vec4(center, mesh.radius * scale), batchIndex, batch.firstCommand, mesh.firstLod, mesh.lodCount });
+            }
+            batch.commandCount = static_cast<uint32_t>(batch.instances.size());
+
+            batch.firstInstanced = static_cast<uint32_t>(instancedCommands.size());
+            for (uint32_t i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; i++) {
+                if (instancedCommands.size() == batch.firstInstanced || !appendInstance(instancedCommands.back(), commands[i])) {
+                    instancedCommands.push_back(commands[i]);
+                }
+            }
+            batch.instancedCount = static_cast<uint32_t>(instancedCommands.size()) - batch.firstInstanced;
+            counts.push_back(batch.instancedCount);
+        }
+        if (vertexData.empty() || indexData.empty() || instances.empty()) {
+            throw std::runtime_error("failed to upload scene: it is empty!");
+        }
+
+        createBuffer(vertexData.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMemory);
+        uploader.uploadBuffer(vertexBuffer, vertexData.data(), vertexData.size(), 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+        //one index type for the whole buffer, 16 bit when no mesh has more vertices than they can address
+        PackedIndices packedIndices = PackedIndices::pack(indexData.data(), indexData.size(), maxMeshVertices <= 65536);
+        indexType = packedIndices.type;
+        createBuffer(packedIndices.bytes.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMemory);
+        uploader.uploadBuffer(indexBuffer, packedIndices.bytes.data(), packedIndices.bytes.size(), 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+        vertexBytes = vertexData.size();
+        indexBytes = packedIndices.bytes.size();
+
+        VkDeviceSize instanceSize = instances.size() * sizeof(SceneInstance);
+        createBuffer(instanceSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, instanceBuffer, instanceMemory);
+        uploader.uploadBuffer(instanceBuffer, instances.data(), instanceSize, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+        VkDeviceSize objectSize = objects.size() * sizeof(SceneObject);
+        createBuffer(objectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, objectBuffer, objectMemory);
+        uploader.uploadBuffer(objectBuffer, objects.data(), objectSize, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        VkDeviceSize lodSize = lods.size() * sizeof(SceneLod);
+        createBuffer(lodSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lodBuffer, lodMemory);
+        uploader.uploadBuffer(lodBuffer, lods.data(), lodSize, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        objectLods.assign(objects.size(), 0);
+
+        //sphere around the box of every object's sphere
+        glm::vec3 minimum(std::numeric_limits<float>::max());
+        glm::vec3 maximum(std::numeric_limits<float>::lowest());
+        for (const SceneObject& object : objects) {
+            minimum = glm::min(minimum, glm::vec3(object.sphere) - object.sphere.w);
+            maximum = glm::max(maximum, glm::vec3(object.sphere) + object.sphere.w);
+        }
+        boundingSphere = glm::vec4((minimum + maximum) * 0.5f, glm::length(maximum - minimum) * 0.5f);
+
+        //storage usage so compute passes can rewrite commands and counts on the GPU
+        VkDeviceSize commandSize = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+        createBuffer(commandSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, commandBuffer, commandMemory);
+        uploader.uploadBuffer(commandBuffer, commands.data(), commandSize, 0, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+        VkDeviceSize instancedSize = instancedCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+        createBuffer(instancedSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, instancedBuffer, instancedMemory);
+        uploader.uploadBuffer(instancedBuffer, instancedCommands.data(), instancedSize, 0, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+        VkDeviceSize countSize = counts.size() * sizeof(uint32_t);
+        createBuffer(countSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, countBuffer, countMemory);
+        uploader.uploadBuffer(countBuffer, counts.data(), countSize, 0, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+        //written by the CPU every frame, so host visible instead of uploaded
+        this->viewCount = viewCount;
+        frames.resize(frameCount * viewCount);
+        for (FrameCommands& frame : frames) {
+            createBuffer(commandSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, frame.buffer, frame.memory,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            frame.commands.resize(commands.size());
+            frame.counts.assign(batches.size(), 0);
+        }
+
+        //the geometry is on the GPU now, only the commands are kept for the direct path
+        vertexData.clear();
+        vertexData.shrink_to_fit();
+        indexData.clear();
+        indexData.shrink_to_fit();
+        for (Batch& batch : batches) {
+            batch.instances.clear();
+            batch.instances.shrink_to_fit();
+        }
+    }
+
+    // binds the vertices to binding 0 and the instance stream to binding 1
+    void bindGeometry(VkCommandBuffer commandBuffer) const {
+        VkBuffer buffers[] = { vertexBuffer, instanceBuffer };
+        VkDeviceSize offsets[] = { 0, 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+    }
+
+    // tests every object against the view and writes the visible ones of each batch to the front of the batch's
+    // range in this frame's commands, neighbours of the same mesh and level merged into one instanced command. With
+    // a lodView every visible object also gets its level of detail, otherwise the full meshes are drawn. Only call
+    // once the frame's fence has signaled
+    void cull(uint32_t frame, const glm::mat4& viewProj, ThreadPool* pool, const SceneLodView* lodView = nullptr, uint32_t view = 0) {
+        FrameCommands& target = frames[frame * viewCount + view];
+        culler.cull(viewProj, visible, pool);
+        culledPerLod.fill(0);
+        culledTriangles = 0;
+
+        //visible is sorted and the batches are contiguous, so each batch's survivors are one run of it
+        auto* mapped = static_cast<VkDrawIndexedIndirectCommand*>(target.memory.mapped);
+        size_t next = 0;
+        for (size_t batchIndex = 0; batchIndex < batches.size(); batchIndex++) {
+            const Batch& batch = batches[batchIndex];
+            uint32_t end = batch.firstCommand + batch.commandCount;
+            uint32_t count = 0;
+            for (; next < visible.size() && visible[next] < end; next++) {
+                VkDrawIndexedIndirectCommand command = commands[visible[next]];
+                uint32_t level = lodView != nullptr ? selectLod(visible[next], *lodView) : 0;
+                const SceneLod& lod = lods[objects[visible[next]].firstLod + level];
+                command.indexCount = lod.indexCount;
+                command.firstIndex = lod.firstIndex;
+                culledPerLod[level]++;
+                culledTriangles += lod.indexCount / 3;
+                if (count == 0 || !appendInstance(target.commands[batch.firstCommand + count - 1], command)) {
+                    target.commands[batch.firstCommand + count++] = command;
+                }
+            }
+            target.counts[batchIndex] = count;
+            if (count > 0) {
+                memcpy(mapped + batch.firstCommand, &target.commands[batch.firstCommand], count * sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
+        target.culled = true;
+    }
+
+    // draws the frame's culled commands of the view if cull() ran for it, otherwise every object of the batch with
+    // the instanced commands. The pipeline, descriptor sets and geometry have to be bound already
+    void draw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t batchIndex, uint32_t view = 0) const {
+        const Batch& batch = batches[batchIndex];
+        size_t slot = static_cast<size_t>(frame) * viewCount + view;
+        if (slot < frames.size() && frames[slot].culled) {
+            VkDeviceSize offset = batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+            //the CPU knows the count already, no count buffer needed
+            const FrameCommands& culled = frames[slot];
+            uint32_t count = culled.counts[batchIndex];
+            if (drawPath == DrawPath::Direct) {
+                drawDirect(commandBuffer, culled.commands.data() + batch.firstCommand, count);
+            }
+            else {
+                drawIndirect(commandBuffer, culled.buffer, offset, count);
+            }
+            return;
+        }
+
+        if (batch.instancedCount == 0) {
+            return;
+        }
+        VkDeviceSize offset = batch.firstInstanced * sizeof(VkDrawIndexedIndirectCommand);
+        switch (drawPath) {
+        case DrawPath::IndirectCount:
+            if (batch.instancedCount <= maxDrawCount) {
+                drawIndexedIndirectCount(commandBuffer, instancedBuffer, offset, countBuffer, batchIndex * sizeof(uint32_t), batch.instancedCount, sizeof(VkDrawIndexedIndirectCommand));
+                break;
+            }
+            //one count can't cover a batch above the device limit, split it into full indirect draws instead
+            [[fallthrough]];
+        case DrawPath::Indirect:
+            drawIndirect(commandBuffer, instancedBuffer, offset, batch.instancedCount);
+            break;
+        case DrawPath::Direct:
+            drawDirect(commandBuffer, instancedCommands.data() + batch.firstInstanced, batch.instancedCount);
+            break;
+        }
+    }
+
+    // draws a batch from commands a compute pass wrote to the batch's range of buffer. Compacted commands come with
+    // their count at countOffset in countBuffer, otherwise every object has a command and the culled ones draw no
+    // instances. The pipeline, descriptor sets and geometry have to be bound already
+    void drawCulled(VkCommandBuffer commandBuffer, uint32_t batchIndex, VkBuffer buffer, VkBuffer countBuffer, VkDeviceSize countOffset) const {
+        const Batch& batch = batches[batchIndex];
+        VkDeviceSize offset = batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+        if (supportsDrawCount()) {
+            drawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countOffset, batch.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else {
+            drawIndirect(commandBuffer, buffer, offset, batch.commandCount);
+        }
+    }
+
+    // whether the batches can be drawn from commands the GPU wrote
+    bool usesIndirectDraws() const {
+        return drawPath != DrawPath::Direct;
+    }
+
+    // whether a GPU written count can cover every batch, so compute passes may compact the commands
+    bool supportsDrawCount() const {
+        return drawPath == DrawPath::IndirectCount && std::all_of(batches.begin(), batches.end(), [this](const Batch& batch) {
+            return batch.commandCount <= maxDrawCount;
+        });
+    }
+
+    uint32_t objectCount() const {
+        return static_cast<uint32_t>(commands.size());
+    }
+
+    uint32_t batchCount() const {
+        return static_cast<uint32_t>(batches.size());
+    }
+
+    VkDescriptorBufferInfo objectBufferInfo() const {
+        return { objectBuffer, 0, objectCount() * sizeof(SceneObject) };
+    }
+
+    VkDescriptorBufferInfo lodBufferInfo() const {
+        return { lodBuffer, 0, lods.size() * sizeof(SceneLod) };
+    }
+
+    VkDescriptorBufferInfo commandBufferInfo() const {
+        return { commandBuffer, 0, objectCount() * sizeof(VkDrawIndexedIndirectCommand) };
+    }
+
+    // world space sphere around every object, radius in w
+    glm::vec4 getBoundingSphere() const {
+        return boundingSphere;
+    }
+
+    const FrustumCullStats& getCullStats() const {
+        return culler.getStats();
+    }
+
+    SceneDrawStats getStats() const {
+        SceneDrawStats stats;
+        stats.meshCount = static_cast<uint32_t>(meshes.size());
+        stats.instanceCount = instanceTotal;
+        stats.batchCount = static_cast<uint32_t>(batches.size());
+        stats.instancedCommandCount = static_cast<uint32_t>(instancedCommands.size());
+        stats.vertexStride = layout.stride();
+        stats.vertexBytes = vertexBytes;
+        stats.indexBytes = indexBytes;
+        stats.indexType = indexType;
+        stats.drawPath = drawPath == DrawPath::IndirectCount ? "indirect count" : drawPath == DrawPath::Indirect ? "indirect" : "direct";
+        stats.lodCount = static_cast<uint32_t>(lods.size());
+        stats.objectsPerLod = culledPerLod;
+        stats.culledTriangles = culledTriangles;
+        return stats;
+    }
+
+    void destroy() {
+        VkBuffer* buffers[] = { &vertexBuffer, &indexBuffer, &instanceBuffer, &objectBuffer, &lodBuffer, &commandBuffer, &instancedBuffer, &countBuffer };
+        MemoryAllocation* memories[] = { &vertexMemory, &indexMemory, &instanceMemory, &objectMemory, &lodMemory, &commandMemory, &instancedMemory, &countMemory };
+        for (size_t i = 0; i < 8; i++) {
+            if (*buffers[i] != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, *buffers[i], nullptr);
+                allocator->free(*memories[i]);
+                *buffers[i] = VK_NULL_HANDLE;
+            }
+        }
+        for (FrameCommands& frame : frames) {
+            vkDestroyBuffer(device, frame.buffer, nullptr);
+            allocator->free(frame.memory);
+        }
+        frames.clear();
+    }
+
+private:
+    struct Batch {
+        // only until upload
+        struct Entry {
+            uint32_t mesh;
+            SceneInstance instance;
+        };
+        std::vector<Entry> instances;
+        uint32_t firstCommand = 0;
+        uint32_t commandCount = 0;
+        // range in instancedCommands
+        uint32_t firstInstanced = 0;
+        uint32_t instancedCount = 0;
+    };
+
+    // one frame in flight's view of the scene after culling
+    struct FrameCommands {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        // CPU copy for the direct path, the mapped buffer is write combined and slow to read back
+        std::vector<VkDrawIndexedIndirectCommand> commands;
+        std::vector<uint32_t> counts;
+        bool culled = false;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    VertexLayout layout;
+    uint32_t maxMeshVertices = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint64_t vertexBytes = 0;
+    uint64_t indexBytes = 0;
+    DrawPath drawPath = DrawPath::Direct;
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+    uint32_t maxDrawCount = 1;
+
+    std::vector<uint8_t> vertexData;
+    std::vector<uint32_t> indexData;
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneLod> lods;
+    std::vector<Batch> batches;
+    std::vector<SceneObject> objects;
+    // level each object was drawn at last, for the hysteresis
+    std::vector<uint8_t> objectLods;
+    std::array<uint32_t, SCENE_MAX_LODS> culledPerLod{};
+    uint64_t culledTriangles = 0;
+    std::vector<VkDrawIndexedIndirectCommand> commands;
+    std::vector<VkDrawIndexedIndirectCommand> instancedCommands;
+    uint32_t instanceTotal = 0;
+
+    glm::vec4 boundingSphere = glm::vec4(0.f);
+
+    FrustumCuller culler;
+    std::vector<uint32_t> visible;
+    // viewCount per frame in flight, the views of a frame next to each other
+    std::vector<FrameCommands> frames;
+    uint32_t viewCount = 1;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation vertexMemory;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation indexMemory;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    MemoryAllocation instanceMemory;
+    VkBuffer objectBuffer = VK_NULL_HANDLE;
+    MemoryAllocation objectMemory;
+    VkBuffer lodBuffer = VK_NULL_HANDLE;
+    MemoryAllocation lodMemory;
+    VkBuffer commandBuffer = VK_NULL_HANDLE;
+    MemoryAllocation commandMemory;
+    VkBuffer instancedBuffer = VK_NULL_HANDLE;
+    MemoryAllocation instancedMemory;
+    VkBuffer countBuffer = VK_NULL_HANDLE;
+    MemoryAllocation countMemory;
+
+    // adds command's instances to last when both draw the same mesh and the instance records follow each other
+    static bool appendInstance(VkDrawIndexedIndirectCommand& last, const VkDrawIndexedIndirectCommand& command) {
+        if (last.indexCount != command.indexCount || last.firstIndex != command.firstIndex || last.vertexOffset != command.vertexOffset
+            || last.firstInstance + last.instanceCount != command.firstInstance) {
+            return false;
+        }
+        last.instanceCount += command.instanceCount;
+        return true;
+    }
+
+    // the coarsest level whose error projects to at most the threshold in pixels, measured from the sphere's nearest
+    // point. Matches selectLod in cull.comp
+    uint32_t selectLod(uint32_t object, const SceneLodView& view) {
+        const SceneObject& info = objects[object];
+        if (info.lodCount <= 1) {
+            return 0;
+        }
+        float radius = info.sphere.w;
+        float distance = std::max(glm::length(glm::vec3(info.sphere) - view.cameraPosition) - radius, view.nearPlane);
+        float scale = radius / distance * view.pixelScale;
+        uint32_t lod = 0;
+        for (uint32_t level = info.lodCount - 1; level > 0; level--) {
+            if (lods[info.firstLod + level].error * scale <= view.threshold) {
+                lod = level;
+                break;
+            }
+        }
+        uint32_t previous = objectLods[object];
+        while (lod > previous && lods[info.firstLod + lod].error * scale > view.threshold * SCENE_LOD_HYSTERESIS) {
+            lod--;
+        }
+        objectLods[object] = static_cast<uint8_t>(lod);
+        return lod;
+    }
+
+    void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t count) const {
+        for (uint32_t first = 0; first < count; first += maxDrawCount) {
+            vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset + first * sizeof(VkDrawIndexedIndirectCommand),
+                std::min(count - first, maxDrawCount), sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    static void drawDirect(VkCommandBuffer commandBuffer, const VkDrawIndexedIndirectCommand* commands, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            const VkDrawIndexedIndirectCommand& command = commands[i];
+            vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+        }
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, MemoryAllocation& memory,
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create scene buffer!");
+        }
+        memory = allocator->allocateBuffer(buffer, properties);
+    }
+};
+
+#endif
@@ -0,0 +1,339 @@
+#pragma once
+#ifndef SHADOWCASCADES_H
+#define SHADOWCASCADES_H
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "allocator.h"
+
+// cascades the shaders have room for
+const uint32_t MAX_SHADOW_CASCADES = 4;
+
+struct ShadowSettings {
+    uint32_t cascadeCount = 4;
+    // width and height of every cascade's layer
+    uint32_t resolution = 2048;
+    // how far from the camera shadows are drawn, a lot less than the far plane so the texels go to what is close
+    float distance = 40.f;
+    // blend of the practical split scheme, 0 splits the distance evenly and 1 logarithmically
+    float splitLambda = 0.75f;
+    // keep each cascade's static casters from earlier frames until its projection or the casters change
+    bool cache = true;
+};
+
+// what the scene shaders need to look a fragment up, laid out like the end of their uniform block (std140)
+struct ShadowCascadeUniforms {
+    glm::mat4 viewProj[MAX_SHADOW_CASCADES];
+    // view space distance each cascade ends at
+    glm::vec4 splits;
+    // world space size of a texel of each cascade, the lookups move along the normal by about that much
+    glm::vec4 texelSizes;
+    // xyz points towards the light, w is the cascade count
+    glm::vec4 light;
+};
+
+// Cascaded shadow maps of a directional light in one layered depth image, one layer per cascade, at a resolution of
+// their own. update() splits the camera's view between the near plane and the shadow distance with the practical
+// split scheme (Zhang et al., "Parallel-Split Shadow Maps") and fits an orthographic projection around the bounding
+// sphere of each slice. The sphere doesn't change size as the camera turns and its center is snapped to whole texels
+// in light space, so the shadow edges stay put while the camera moves. Each projection's depth range reaches back to
+// the edge of the scene towards the light, so frustum culling with viewProj keeps every caster of the slice.
+// With caching a cascade is dirty only when its projection changed, which the snapping makes rare, or invalidate()
+// was called. Static casters are drawn only into dirty cascades; with a dynamic layer they go into a second image
+// instead, which is copied into the sampled one every frame before the moving casters are drawn on top
+class CascadedShadowMap {
+public:
+    void init(VkDevice device, DeviceMemoryAllocator* allocator, VkFormat format, const ShadowSettings& settings, bool dynamicLayer = false) {
+        this->device = device;
+        this->allocator = allocator;
+        this->format = format;
+        this->settings = settings;
+        this->settings.cascadeCount = std::clamp(settings.cascadeCount, 1u, MAX_SHADOW_CASCADES);
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { settings.resolution, settings.resolution, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = this->settings.cascadeCount;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (dynamicLayer ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow map!");
+        }
+        memory = allocator->allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL);
+
+        arrayView = createView(image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, this->settings.cascadeCount);
+        for (uint32_t cascade = 0; cascade < this->settings.cascadeCount; cascade++) {
+            layerViews.push_back(createView(image, VK_IMAGE_VIEW_TYPE_2D, cascade, 1));
+        }
+
+        //the static casters of every cascade, only ever copied from
+        if (dynamicLayer) {
+            imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            if (vkCreateImage(device, &imageInfo, nullptr, &staticImage) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create static shadow map!");
+            }
+            staticMemory = allocator->allocateImage(staticImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL);
+            for (uint32_t cascade = 0; cascade < this->settings.cascadeCount; cascade++) {
+                staticLayerViews.push_back(createView(staticImage, VK_IMAGE_VIEW_TYPE_2D, cascade, 1));
+            }
+        }
+        invalidate();
+    }
+
+    // hardware comparison, the bilinear filter then blends four depth tests. Outside the map is lit
+    static VkSamplerCreateInfo samplerInfo() {
+        VkSamplerCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        info.magFilter = VK_FILTER_LINEAR;
+        info.minFilter = VK_FILTER_LINEAR;
+        info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        info.compareEnable = VK_TRUE;
+        info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        info.maxAnisotropy = 1.f;
+        info.maxLod = 0.f;
+        return info;
+    }
+
+    // moves the images from their undefined initial layout to the ones they rest in between frames: the sampled one
+    // readable by fragment shaders, the static one ready to be copied from
+    void recordInitialLayouts(VkCommandBuffer commandBuffer) const {
+        std::vector<VkImageMemoryBarrier> barriers;
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, settings.cascadeCount };
+        barrier.image = image;
+        barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        barriers.push_back(barrier);
+        if (staticImage != VK_NULL_HANDLE) {
+            barrier.image = staticImage;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barriers.push_back(barrier);
+        }
+        //the stages the first frame's barriers wait for
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    // fits the cascades to a camera with a [0, 1] depth perspective of the given vertical field of view (radians)
+    // and aspect, for a light shining along -towardsLight. The scene's bounding sphere gives the depth range
+    void update(const glm::mat4& view, float fovY, float aspect, float zNear, float zFar, const glm::vec3& towardsLight,
+        const glm::vec3& sceneCenter, float sceneRadius) {
+        uint32_t count = settings.cascadeCount;
+        float distance = std::min(settings.distance, zFar);
+        std::array<float, MAX_SHADOW_CASCADES + 1> splits{};
+        splits[0] = zNear;
+        for (uint32_t i = 1; i <= count; i++) {
+            float fraction = static_cast<float>(i) / count;
+            float logarithmic = zNear * std::pow(distance / zNear, fraction);
+            float uniform = zNear + (distance - zNear) * fraction;
+            splits[i] = settings.splitLambda * logarithmic + (1.f - settings.splitLambda) * uniform;
+        }
+
+        //light space with a fixed orientation, only the projection follows the camera
+        glm::vec3 direction = glm::normalize(towardsLight);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.f), -direction, up);
+        glm::vec3 sceneLight = glm::vec3(lightView * glm::vec4(sceneCenter, 1.f));
+
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+        uniforms = ShadowCascadeUniforms{};
+        for (uint32_t cascade = 0; cascade < count; cascade++) {
+            //the slice's corners in view space, the camera looks down -z
+            std::array<glm::vec3, 8> corners;
+            for (uint32_t corner = 0; corner < 8; corner++) {
+                float depth = splits[cascade + (corner >> 2)];
+                corners[corner] = glm::vec3((corner & 1 ? 1.f : -1.f) * tanX * depth, (corner & 2 ? 1.f : -1.f) * tanY * depth, -depth);
+            }
+            glm::vec3 center(0.f);
+            for (const glm::vec3& corner : corners) {
+                center += corner;
+            }
+            center /= 8.f;
+            float radius = 0.f;
+            for (const glm::vec3& corner : corners) {
+                radius = std::max(radius, glm::length(corner - center));
+            }
+            //rounded up so tiny changes in the math don't resize the texels
+            radius = std::ceil(radius * 16.f) / 16.f;
+
+            //depth is snapped as well so small camera moves leave the whole projection alone and the cache valid
+            glm::vec3 lightCenter = glm::vec3(lightView * cameraToWorld * glm::vec4(center, 1.f));
+            float texelSize = 2.f * radius / settings.resolution;
+            lightCenter = glm::floor(lightCenter / texelSize) * texelSize;
+
+            //the light looks down -z. Towards the light the range reaches the edge of the scene for the casters,
+            //nothing behind the slice can shadow it. The snapping moved the center by up to a texel. The depth range is
+            //Vulkan's [0, 1] whatever glm defaults to
+            float nearest = std::max(lightCenter.z + radius + texelSize, sceneLight.z + sceneRadius);
+            float farthest = lightCenter.z - radius - texelSize;
+            glm::mat4 projection = glm::orthoRH_ZO(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+                -nearest, -farthest);
+
+            uniforms.viewProj[cascade] = projection * lightView;
+            uniforms.splits[cascade] = splits[cascade + 1];
+            uniforms.texelSizes[cascade] = texelSize;
+        }
+        uniforms.light = glm::vec4(direction, static_cast<float>(count));
+
+        //a different light direction changes every projection too
+        for (uint32_t cascade = 0; cascade < count; cascade++) {
+            dirty[cascade] = !settings.cache || !cached[cascade] || cachedViewProj[cascade] != uniforms.viewProj[cascade];
+            cached[cascade] = true;
+            cachedViewProj[cascade] = uniforms.viewProj[cascade];
+        }
+    }
+
+    // the static casters moved or changed, every cascade is drawn again by the next update()
+    void invalidate() {
+        cached.fill(false);
+    }
+
+    // whether the static casters have to be drawn into the cascade this frame, as of the last update()
+    bool isDirty(uint32_t cascade) const {
+        return dirty[cascade];
+    }
+
+    uint32_t dirtyCount() const {
+        return static_cast<uint32_t>(std::count(dirty.begin(), dirty.begin() + settings.cascadeCount, true));
+    }
+
+    bool hasDynamicLayer() const {
+        return staticImage != VK_NULL_HANDLE;
+    }
+
+    // dynamic layer only: copies the cascade's static casters into the sampled image, which has to be in
+    // TRANSFER_DST_OPTIMAL and the static one in TRANSFER_SRC_OPTIMAL
+    void recordCopy(VkCommandBuffer commandBuffer, uint32_t cascade) const {
+        VkImageCopy region{};
+        region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+        region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+        region.extent = { settings.resolution, settings.resolution, 1 };
+        vkCmdCopyImage(commandBuffer, staticImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+
+    const ShadowCascadeUniforms& getUniforms() const {
+        return uniforms;
+    }
+
+    uint32_t cascadeCount() const {
+        return settings.cascadeCount;
+    }
+
+    uint32_t resolution() const {
+        return settings.resolution;
+    }
+
+    VkFormat getFormat() const {
+        return format;
+    }
+
+    VkImage getImage() const {
+        return image;
+    }
+
+    // one cascade, for rendering into it
+    VkImageView layerView(uint32_t cascade) const {
+        return layerViews[cascade];
+    }
+
+    VkImage getStaticImage() const {
+        return staticImage;
+    }
+
+    // dynamic layer only: one cascade of the static casters
+    VkImageView staticLayerView(uint32_t cascade) const {
+        return staticLayerViews[cascade];
+    }
+
+    // every cascade, for sampling with a sampler made from samplerInfo()
+    VkImageView getArrayView() const {
+        return arrayView;
+    }
+
+    void destroy() {
+        if (image == VK_NULL_HANDLE) {
+            return;
+        }
+        for (VkImageView view : layerViews) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        layerViews.clear();
+        vkDestroyImageView(device, arrayView, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(memory);
+        image = VK_NULL_HANDLE;
+        if (staticImage != VK_NULL_HANDLE) {
+            for (VkImageView view : staticLayerViews) {
+                vkDestroyImageView(device, view, nullptr);
+            }
+            staticLayerViews.clear();
+            vkDestroyImage(device, staticImage, nullptr);
+            allocator->free(staticMemory);
+            staticImage = VK_NULL_HANDLE;
+        }
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    VkFormat format = VK_FORMAT_D16_UNORM;
+    ShadowSettings settings;
+    ShadowCascadeUniforms uniforms{};
+    // the projections the cascades were last drawn with
+    std::array<glm::mat4, MAX_SHADOW_CASCADES> cachedViewProj{};
+    std::array<bool, MAX_SHADOW_CASCADES> cached{};
+    std::array<bool, MAX_SHADOW_CASCADES> dirty{};
+
+    VkImage image = VK_NULL_HANDLE;
+    MemoryAllocation memory;
+    VkImageView arrayView = VK_NULL_HANDLE;
+    std::vector<VkImageView> layerViews;
+
+    VkImage staticImage = VK_NULL_HANDLE;
+    MemoryAllocation staticMemory;
+    std::vector<VkImageView> staticLayerViews;
+
+    VkImageView createView(VkImage image, VkImageViewType type, uint32_t baseLayer, uint32_t layerCount) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = type;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = baseLayer;
+        viewInfo.subresourceRange.layerCount = layerCount;
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow map view!");
+        }
+        return view;
+    }
+};
+
+#endif
@@ -0,0 +1,397 @@
+#pragma once
+#ifndef TEXTURECOMPRESS_H
+#define TEXTURECOMPRESS_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "threadpool.h"
+
+// CPU side of the texture pipeline: mip chain generation and block compression into the formats the texture
+// container stores. The encoders favour speed over quality (one principal axis fit per block, no partition search)
+// since they run at most once per source image; the results are cached on disk
+
+// 8 bit RGBA pixels of one mip level
+struct RgbaImage {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+namespace texturecompress {
+
+inline float srgbToLinear(float value) {
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+inline uint8_t toByte(float value) {
+    return static_cast<uint8_t>(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+// copies the 4x4 block at (blockX, blockY), repeating the last row/column where the image is smaller than a block
+inline void fetchBlock(const RgbaImage& image, uint32_t blockX, uint32_t blockY, uint8_t block[64]) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sourceY = std::min(blockY * 4 + y, image.height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sourceX = std::min(blockX * 4 + x, image.width - 1);
+            memcpy(block + (y * 4 + x) * 4, &image.pixels[(static_cast<size_t>(sourceY) * image.width + sourceX) * 4], 4);
+        }
+    }
+}
+
+// endpoints of the block along its principal axis, over the first channelCount channels
+inline void fitAxis(const uint8_t block[64], int channelCount, float low[4], float high[4]) {
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channelCount; c++) {
+            mean[c] += block[i * 4 + c] / 16.0f;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int a = 0; a < channelCount; a++) {
+            for (int b = 0; b < channelCount; b++) {
+                covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+            }
+        }
+    }
+
+    // power iteration, starting from the box diagonal
+    float axis[4] = {};
+    for (int c = 0; c < channelCount; c++) {
+        uint8_t minValue = 255, maxValue = 0;
+        for (int i = 0; i < 16; i++) {
+            minValue = std::min(minValue, block[i * 4 + c]);
+            maxValue = std::max(maxValue, block[i * 4 + c]);
+        }
+        axis[c] = static_cast<float>(maxValue - minValue);
+    }
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channelCount; a++) {
+            for (int b = 0; b < channelCount; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < channelCount; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float projection = 0.0f;
+        for (int c = 0; c < channelCount; c++) {
+            projection += (block[i * 4 + c] - mean[c]) * axis[c];
+        }
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+
+    float axisLengthSquared = 0.0f;
+    for (int c = 0; c < channelCount; c++) {
+        axisLengthSquared += axis[c] * axis[c];
+    }
+    axisLengthSquared = std::max(axisLengthSquared, 1e-12f);
+    for (int c = 0; c < channelCount; c++) {
+        low[c] = std::clamp(mean[c] + axis[c] * minProjection / axisLengthSquared, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxProjection / axisLengthSquared, 0.0f, 255.0f);
+    }
+}
+
+inline uint16_t packRgb565(const float color[3]) {
+    uint16_t r = static_cast<uint16_t>(std::clamp(color[0] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+    uint16_t g = static_cast<uint16_t>(std::clamp(color[1] * 63.0f / 255.0f + 0.5f, 0.0f, 63.0f));
+    uint16_t b = static_cast<uint16_t>(std::clamp(color[2] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRgb565(uint16_t packed, int color[3]) {
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// BC1 in four color mode, alpha is ignored
+inline void compressBC1Block(const uint8_t block[64], uint8_t out[8]) {
+    float low[4], high[4];
+    fitAxis(block, 3, low, high);
+    uint16_t color0 = packRgb565(high);
+    uint16_t color1 = packRgb565(low);
+    // four color mode needs color0 > color1, swapping the endpoints mirrors the indices
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    int difference = block[i * 4 + c] - palette[p][c];
+                    error += difference * difference;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+// one channel of the block, in eight value mode (red0 > red1)
+inline void compressBC4Block(const uint8_t block[64], int channel, uint8_t out[8]) {
+    uint8_t minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; i++) {
+        minValue = std::min(minValue, block[i * 4 + channel]);
+        maxValue = std::max(maxValue, block[i * 4 + channel]);
+    }
+
+    uint64_t bits = static_cast<uint64_t>(maxValue) | (static_cast<uint64_t>(minValue) << 8);
+    if (maxValue != minValue) {
+        int palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (int p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p) * maxValue + p * minValue) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int error = std::abs(block[i * 4 + channel] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            bits |= static_cast<uint64_t>(best) << (16 + i * 3);
+        }
+    }
+    memcpy(out, &bits, 8);
+}
+
+// two channel data such as tangent space normals: red and green each get a BC4 block
+inline void compressBC5Block(const uint8_t block[64], uint8_t out[16]) {
+    compressBC4Block(block, 0, out);
+    compressBC4Block(block, 1, out + 8);
+}
+
+// appends count bits of value to a little endian 128 bit block
+struct BlockWriter {
+    uint8_t* out;
+    uint32_t position = 0;
+
+    void write(uint32_t value, uint32_t count) {
+        for (uint32_t bit = 0; bit < count; bit++, position++) {
+            out[position >> 3] |= static_cast<uint8_t>(((value >> bit) & 1) << (position & 7));
+        }
+    }
+};
+
+// BC7 mode 6: one subset, 7.7.7.7 RGBA endpoints with a p-bit each and 4 bit indices. It handles alpha and smooth
+// gradients well, which covers what the scene's textures need
+inline void compressBC7Block(const uint8_t block[64], uint8_t out[16]) {
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float low[4], high[4];
+    fitAxis(block, 4, low, high);
+
+    // quantize every endpoint with the p-bit that lands closest to the fitted value
+    int endpoints[2][4];
+    int pBits[2];
+    const float* fitted[2] = { low, high };
+    for (int e = 0; e < 2; e++) {
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; p++) {
+            int quantized[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                quantized[c] = std::clamp(static_cast<int>(std::lround((fitted[e][c] - p) / 2.0f)), 0, 127);
+                float difference = static_cast<float>((quantized[c] << 1) | p) - fitted[e][c];
+                error += difference * difference;
+            }
+            if (error < bestError) {
+                bestError = error;
+                pBits[e] = p;
+                memcpy(endpoints[e], quantized, sizeof(quantized));
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; w++) {
+        for (int c = 0; c < 4; c++) {
+            int e0 = (endpoints[0][c] << 1) | pBits[0];
+            int e1 = (endpoints[1][c] << 1) | pBits[1];
+            palette[w][c] = ((64 - weights[w]) * e0 + weights[w] * e1 + 32) >> 6;
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestError = 1 << 30;
+        for (int w = 0; w < 16; w++) {
+            int error = 0;
+            for (int c = 0; c < 4; c++) {
+                int difference = block[i * 4 + c] - palette[w][c];
+                error += difference * difference;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the first index is stored without its top bit, so it must be below 8. The weights are symmetric, swapping
+    // the endpoints and mirroring every index describes the same block
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(pBits[0], pBits[1]);
+        for (int i = 0; i < 16; i++) {
+            indices[i] = 15 - indices[i];
+        }
+    }
+
+    memset(out, 0, 16);
+    BlockWriter writer{ out };
+    writer.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(static_cast<uint32_t>(endpoints[0][c]), 7);
+        writer.write(static_cast<uint32_t>(endpoints[1][c]), 7);
+    }
+    writer.write(static_cast<uint32_t>(pBits[0]), 1);
+    writer.write(static_cast<uint32_t>(pBits[1]), 1);
+    writer.write(static_cast<uint32_t>(indices[0]), 3);
+    for (int i = 1; i < 16; i++) {
+        writer.write(static_cast<uint32_t>(indices[i]), 4);
+    }
+}
+
+}
+
+// whether compressImage can produce the format
+inline bool canCompressTo(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// full mip chain down to 1x1. Every level is a 2x2 box filter of the previous one (odd sizes drop the last row or
+// column); sRGB data is averaged in linear space so mips don't darken
+inline std::vector<RgbaImage> buildMipChain(RgbaImage base, bool srgb) {
+    std::vector<RgbaImage> levels;
+    levels.push_back(std::move(base));
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const RgbaImage& source = levels.back();
+        RgbaImage level;
+        level.width = std::max(source.width / 2, 1u);
+        level.height = std::max(source.height / 2, 1u);
+        level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+        for (uint32_t y = 0; y < level.height; y++) {
+            for (uint32_t x = 0; x < level.width; x++) {
+                for (int c = 0; c < 4; c++) {
+                    bool linearize = srgb && c < 3;
+                    float sum = 0.0f;
+                    for (uint32_t dy = 0; dy < 2; dy++) {
+                        for (uint32_t dx = 0; dx < 2; dx++) {
+                            uint32_t sourceX = std::min(x * 2 + dx, source.width - 1);
+                            uint32_t sourceY = std::min(y * 2 + dy, source.height - 1);
+                            float value = source.pixels[(static_cast<size_t>(sourceY) * source.width + sourceX) * 4 + c] / 255.0f;
+                            sum += linearize ? texturecompress::srgbToLinear(value) : value;
+                        }
+                    }
+                    float average = sum / 4.0f;
+                    level.pixels[(static_cast<size_t>(y) * level.width + x) * 4 + c] =
+                        texturecompress::toByte(linearize ? texturecompress::linearToSrgb(average) : average);
+                }
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+inline size_t compressedBlockBytes(VkFormat format) {
+    return format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? 8 : 16;
+}
+
+inline size_t compressedImageSize(const RgbaImage& image, VkFormat format) {
+    return compressedBlockBytes(format) * ((image.width + 3) / 4) * ((image.height + 3) / 4);
+}
+
+// encodes the block rows [firstRow, lastRow) of one level into out, which holds the whole compressed level.
+// sRGB and UNORM variants share the encoder, the format only tells the sampler how to decode
+inline void compressBlockRows(const RgbaImage& image, VkFormat format, uint32_t firstRow, uint32_t lastRow, uint8_t* out) {
+    bool bc1 = format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    bool bc5 = format == VK_FORMAT_BC5_UNORM_BLOCK;
+    size_t blockBytes = compressedBlockBytes(format);
+    uint32_t blocksX = (image.width + 3) / 4;
+
+    uint8_t block[64];
+    for (uint32_t blockY = firstRow; blockY < lastRow; blockY++) {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+            texturecompress::fetchBlock(image, blockX, blockY, block);
+            uint8_t* blockOut = out + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes;
+            if (bc1) {
+                texturecompress::compressBC1Block(block, blockOut);
+            }
+            else if (bc5) {
+                texturecompress::compressBC5Block(block, blockOut);
+            }
+            else {
+                texturecompress::compressBC7Block(block, blockOut);
+            }
+        }
+    }
+}
+
+// encodes one level into a format canCompressTo accepts, block rows are spread over the pool
+inline std::vector<uint8_t> compressImage(const RgbaImage& image, VkFormat format, ThreadPool& pool) {
+    std::vector<uint8_t> data(compressedImageSize(image, format));
+    pool.parallelFor((image.height + 3) / 4, 4, [&](size_t begin, size_t end, size_t) {
+        compressBlockRows(image, format, static_cast<uint32_t>(begin), static_cast<uint32_t>(end), data.data());
+    });
+    return data;
+}
+
+#endif
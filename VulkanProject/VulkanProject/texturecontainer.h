@@ -0,0 +1,308 @@
+#pragma once
+#ifndef TEXTURECONTAINER_H
+#define TEXTURECONTAINER_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "meshcache.h"
+
+// block layout of a compressed format the texture container can hold
+struct TextureFormatInfo {
+    VkFormat format;
+    uint32_t blockWidth;
+    uint32_t blockHeight;
+    uint32_t blockBytes;
+    bool srgb;
+    // file name suffix of containers in this format, e.g. viking_room.bc7.ktx2
+    const char* tag;
+    // Khronos data format descriptor color model and channel ids of the samples
+    uint32_t colorModel;
+    uint32_t channels[2];
+    uint32_t sampleCount;
+};
+
+inline const TextureFormatInfo* findTextureFormat(VkFormat format) {
+    static const TextureFormatInfo formats[] = {
+        { VK_FORMAT_BC1_RGB_UNORM_BLOCK, 4, 4, 8, false, "bc1", 128, { 0, 0 }, 1 },
+        { VK_FORMAT_BC1_RGB_SRGB_BLOCK, 4, 4, 8, true, "bc1", 128, { 0, 0 }, 1 },
+        { VK_FORMAT_BC5_UNORM_BLOCK, 4, 4, 16, false, "bc5", 132, { 0, 1 }, 2 },
+        { VK_FORMAT_BC7_UNORM_BLOCK, 4, 4, 16, false, "bc7", 134, { 0, 0 }, 1 },
+        { VK_FORMAT_BC7_SRGB_BLOCK, 4, 4, 16, true, "bc7", 134, { 0, 0 }, 1 },
+        { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 4, 4, 16, false, "astc", 162, { 0, 0 }, 1 },
+        { VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 4, 4, 16, true, "astc", 162, { 0, 0 }, 1 },
+    };
+    for (const auto& info : formats) {
+        if (info.format == format) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+// bytes of one mip level, partial blocks at the edges count as whole blocks
+inline uint64_t textureLevelSize(const TextureFormatInfo& info, uint32_t width, uint32_t height) {
+    uint64_t blocksX = (width + info.blockWidth - 1) / info.blockWidth;
+    uint64_t blocksY = (height + info.blockHeight - 1) / info.blockHeight;
+    return blocksX * blocksY * info.blockBytes;
+}
+
+// where a container for source in the given format lives: texture/viking_room.png -> texture/viking_room.bc7.ktx2
+inline std::string textureContainerPath(const std::string& source, VkFormat format) {
+    std::filesystem::path path(source);
+    path.replace_extension(std::string(".") + findTextureFormat(format)->tag + ".ktx2");
+    return path.string();
+}
+
+// Subset of KTX 2.0: one 2D image with a full set of pre-built mip levels, no array layers, cube faces or
+// supercompression. Files from other KTX 2.0 writers load as long as they stay inside that subset. The hash of the
+// source image is kept as key/value data so a container can be checked against its source like the mesh cache.
+// The file is memory mapped and level data is handed out as pointers into the mapping, ready to be staged as is
+class TextureContainer {
+public:
+    struct Level {
+        const uint8_t* data;
+        uint64_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // sourceHash 0 accepts the container whatever it was built from, e.g. when only the container was shipped
+    bool open(const std::string& path, uint64_t sourceHash) {
+        close();
+        if (!file.open(path) || file.fileSize() < sizeof(Ktx2Header)) {
+            file.close();
+            return false;
+        }
+        memcpy(&header, file.bytes(), sizeof(header));
+        info = findTextureFormat(static_cast<VkFormat>(header.vkFormat));
+
+        bool valid = memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0
+            && info != nullptr
+            && header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelDepth == 0
+            && header.layerCount <= 1 && header.faceCount == 1
+            && header.supercompressionScheme == 0
+            && header.levelCount > 0 && header.levelCount <= 32
+            && sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2LevelIndex) <= file.fileSize();
+
+        for (uint32_t i = 0; valid && i < header.levelCount; i++) {
+            Ktx2LevelIndex index;
+            memcpy(&index, file.bytes() + sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex), sizeof(index));
+            Level level{ file.bytes() + index.byteOffset, index.byteLength,
+                std::max(header.pixelWidth >> i, 1u), std::max(header.pixelHeight >> i, 1u) };
+            valid = index.byteOffset + index.byteLength <= file.fileSize()
+                && index.byteLength == textureLevelSize(*info, level.width, level.height);
+            levels.push_back(level);
+        }
+
+        valid = valid && (sourceHash == 0 || readSourceHash() == sourceHash);
+        if (!valid) {
+            close();
+        }
+        return valid;
+    }
+
+    void close() {
+        file.close();
+        levels.clear();
+        header = Ktx2Header{};
+        info = nullptr;
+    }
+
+    VkFormat format() const {
+        return static_cast<VkFormat>(header.vkFormat);
+    }
+
+    uint32_t width() const {
+        return header.pixelWidth;
+    }
+
+    uint32_t height() const {
+        return header.pixelHeight;
+    }
+
+    const std::vector<Level>& mipLevels() const {
+        return levels;
+    }
+
+    size_t fileSize() const {
+        return file.fileSize();
+    }
+
+    // levels[0] is the full size image. Written to a temporary file first and renamed, like the mesh cache
+    static void write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, uint64_t sourceHash,
+        const std::vector<std::vector<uint8_t>>& levels) {
+        const TextureFormatInfo* info = findTextureFormat(format);
+        if (!info) {
+            throw std::runtime_error("texture container does not support this format!");
+        }
+
+        Ktx2Header header{};
+        memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+        header.vkFormat = format;
+        header.typeSize = 1;
+        header.pixelWidth = width;
+        header.pixelHeight = height;
+        header.faceCount = 1;
+        header.levelCount = static_cast<uint32_t>(levels.size());
+
+        std::vector<uint32_t> dfd = dataFormatDescriptor(*info);
+        std::vector<uint8_t> kvd;
+        appendKeyValue(kvd, "KTXwriter", "VulkanProject");
+        char hashText[17];
+        snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(sourceHash));
+        appendKeyValue(kvd, SOURCE_HASH_KEY, hashText);
+
+        uint64_t offset = sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2LevelIndex);
+        header.dfdByteOffset = static_cast<uint32_t>(offset);
+        header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+        offset += header.dfdByteLength;
+        header.kvdByteOffset = static_cast<uint32_t>(offset);
+        header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+        offset += kvd.size();
+
+        // KTX 2.0 stores the smallest level first, each aligned to the block size and to 4 bytes
+        uint64_t alignment = info->blockBytes % 4 == 0 ? info->blockBytes : info->blockBytes * 4;
+        std::vector<Ktx2LevelIndex> indices(levels.size());
+        for (size_t i = levels.size(); i-- > 0;) {
+            offset = alignUp(offset, alignment);
+            indices[i] = { offset, levels[i].size(), levels[i].size() };
+            offset += levels[i].size();
+        }
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                throw std::runtime_error("failed to open texture container for writing!");
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(Ktx2LevelIndex));
+            out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+            out.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+            uint64_t position = header.kvdByteOffset + kvd.size();
+            std::vector<char> padding(static_cast<size_t>(alignment), 0);
+            for (size_t i = levels.size(); i-- > 0;) {
+                out.write(padding.data(), indices[i].byteOffset - position);
+                out.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+                position = indices[i].byteOffset + levels[i].size();
+            }
+            if (!out) {
+                throw std::runtime_error("failed to write texture container!");
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            throw std::runtime_error("failed to replace texture container!");
+        }
+    }
+
+private:
+    struct Ktx2Header {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct Ktx2LevelIndex {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    static constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    static constexpr const char* SOURCE_HASH_KEY = "VulkanProject.sourceHash";
+
+    MappedFile file;
+    Ktx2Header header{};
+    const TextureFormatInfo* info = nullptr;
+    std::vector<Level> levels;
+
+    static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // basic descriptor block: one sample covering the whole block for BC1/BC7/ASTC, red and green halves for BC5
+    static std::vector<uint32_t> dataFormatDescriptor(const TextureFormatInfo& info) {
+        uint32_t blockSize = 24 + 16 * info.sampleCount;
+
+        std::vector<uint32_t> words;
+        words.push_back(4 + blockSize);
+        words.push_back(0);
+        words.push_back(2 | (blockSize << 16));
+        // color model, BT.709 primaries, transfer function (1 linear, 2 sRGB)
+        words.push_back(info.colorModel | (1u << 8) | ((info.srgb ? 2u : 1u) << 16));
+        words.push_back((info.blockWidth - 1) | ((info.blockHeight - 1) << 8));
+        words.push_back(info.blockBytes);
+        words.push_back(0);
+        for (uint32_t s = 0; s < info.sampleCount; s++) {
+            uint32_t bitLength = info.blockBytes * 8 / info.sampleCount;
+            words.push_back((s * bitLength) | ((bitLength - 1) << 16) | (info.channels[s] << 24));
+            words.push_back(0);
+            words.push_back(0);
+            words.push_back(0xFFFFFFFFu);
+        }
+        return words;
+    }
+
+    static void appendKeyValue(std::vector<uint8_t>& kvd, const std::string& key, const std::string& value) {
+        uint32_t length = static_cast<uint32_t>(key.size() + 1 + value.size() + 1);
+        const uint8_t* lengthBytes = reinterpret_cast<const uint8_t*>(&length);
+        kvd.insert(kvd.end(), lengthBytes, lengthBytes + 4);
+        kvd.insert(kvd.end(), key.begin(), key.end());
+        kvd.push_back(0);
+        kvd.insert(kvd.end(), value.begin(), value.end());
+        kvd.push_back(0);
+        kvd.resize(alignUp(kvd.size(), 4), 0);
+    }
+
+    uint64_t readSourceHash() const {
+        uint64_t end = static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength;
+        if (end > file.fileSize()) {
+            return 0;
+        }
+        const uint8_t* bytes = file.bytes();
+        uint64_t position = header.kvdByteOffset;
+        while (position + 4 <= end) {
+            uint32_t length;
+            memcpy(&length, bytes + position, 4);
+            if (position + 4 + length > end) {
+                break;
+            }
+            std::string entry(reinterpret_cast<const char*>(bytes + position + 4), length);
+            size_t separator = entry.find('\0');
+            if (separator != std::string::npos && entry.compare(0, separator, SOURCE_HASH_KEY) == 0) {
+                return std::strtoull(entry.c_str() + separator + 1, nullptr, 16);
+            }
+            position = alignUp(position + 4 + length, 4);
+        }
+        return 0;
+    }
+};
+
+#endif
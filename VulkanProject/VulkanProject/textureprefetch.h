@@ -0,0 +1,223 @@
+#pragma once
+#ifndef TEXTUREPREFETCH_H
+#define TEXTUREPREFETCH_H
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "meshcache.h"
+#include "texturecompress.h"
+#include "texturecontainer.h"
+#include "threadpool.h"
+
+inline bool loadRgbaImage(const std::string& path, RgbaImage& image) {
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        return false;
+    }
+    image.width = static_cast<uint32_t>(texWidth);
+    image.height = static_cast<uint32_t>(texHeight);
+    image.pixels.assign(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+// everything about one texture that can be prepared without a device
+struct PrefetchedTexture {
+    std::string path;
+    bool hasSource = false;
+    uint64_t sourceHash = 0;
+    // containers matching the current source (or any container if there is no source), in preference order
+    std::vector<std::unique_ptr<TextureContainer>> containers;
+    // decoded source with its full mip chain, only filled when the most preferred encodable format had no container
+    std::vector<RgbaImage> mips;
+    // the mips compressed to that format, VK_FORMAT_UNDEFINED when nothing was compressed
+    VkFormat compressedFormat = VK_FORMAT_UNDEFINED;
+    std::vector<std::vector<uint8_t>> compressedLevels;
+
+    const TextureContainer* container(VkFormat format) const {
+        for (const auto& candidate : containers) {
+            if (candidate->format() == format) {
+                return candidate.get();
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Reads, decodes and compresses textures on the thread pool from the moment the process starts, so the work runs
+// while the instance, device and pipelines are created. Which compressed format the device samples is only known
+// later; the prefetcher compresses speculatively for the most preferred format it can encode, which is what desktop
+// devices end up using. No job waits on another, the chunks of a texture are only collected by take()
+class TexturePrefetcher {
+public:
+    // block rows of a level compressed by one job
+    static const uint32_t ROWS_PER_JOB = 16;
+
+    ~TexturePrefetcher() {
+        // textures that were never taken still have jobs referring to this object
+        for (auto& entry : entries) {
+            entry->prepared.wait();
+            for (auto& chunk : entry->chunks) {
+                chunk.wait();
+            }
+        }
+    }
+
+    void start(ThreadPool& pool, const std::vector<std::string>& paths, const std::vector<VkFormat>& preferredFormats) {
+        this->pool = &pool;
+        startTime = Clock::now();
+        for (const std::string& path : paths) {
+            auto entry = std::make_shared<Entry>();
+            entry->texture.path = path;
+            entry->prepared = pool.submit([this, entry, preferredFormats] {
+                prepare(*entry, preferredFormats);
+            });
+            entries.push_back(entry);
+        }
+    }
+
+    // blocks until the CPU work for path is done and hands it over. Rethrows what the jobs threw
+    PrefetchedTexture take(const std::string& path) {
+        auto entry = std::find_if(entries.begin(), entries.end(), [&](const std::shared_ptr<Entry>& candidate) {
+            return candidate->texture.path == path;
+        });
+        if (entry == entries.end()) {
+            throw std::runtime_error("texture was not prefetched: " + path);
+        }
+        Entry& found = **entry;
+
+        auto waitStart = Clock::now();
+        found.prepared.get();
+        for (auto& chunk : found.chunks) {
+            chunk.get();
+        }
+        stats.waitMs += milliseconds(Clock::now() - waitStart);
+
+        Clock::time_point finished = found.preparedEnd;
+        stats.cpuMs += found.prepareMs;
+        for (size_t i = 0; i < found.chunkEnd.size(); i++) {
+            finished = std::max(finished, found.chunkEnd[i]);
+            stats.cpuMs += found.chunkMs[i];
+        }
+        stats.finishedMs = std::max(stats.finishedMs, milliseconds(finished - startTime));
+        stats.textureCount++;
+
+        PrefetchedTexture texture = std::move(found.texture);
+        entries.erase(entry);
+        return texture;
+    }
+
+    // how much of the prefetch ran while the caller was busy with something else
+    void report(std::ostream& out) const {
+        out << "texture prefetch: " << stats.textureCount << " textures, " << stats.cpuMs << " ms of CPU work done "
+            << stats.finishedMs << " ms after start, waited " << stats.waitMs << " ms for it, "
+            << std::max(stats.finishedMs - stats.waitMs, 0.0) << " ms overlapped with device initialization" << std::endl;
+    }
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Entry {
+        PrefetchedTexture texture;
+        std::future<void> prepared;
+        Clock::time_point preparedEnd;
+        double prepareMs = 0.0;
+        // written by the compression jobs, read once their futures are collected
+        std::vector<std::future<void>> chunks;
+        std::vector<double> chunkMs;
+        std::vector<Clock::time_point> chunkEnd;
+    };
+
+    struct Stats {
+        uint32_t textureCount = 0;
+        double cpuMs = 0.0;
+        double finishedMs = 0.0;
+        double waitMs = 0.0;
+    };
+
+    ThreadPool* pool = nullptr;
+    Clock::time_point startTime;
+    std::vector<std::shared_ptr<Entry>> entries;
+    Stats stats;
+
+    static double milliseconds(Clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    void prepare(Entry& entry, const std::vector<VkFormat>& preferredFormats) {
+        auto prepareStart = Clock::now();
+        PrefetchedTexture& texture = entry.texture;
+        texture.hasSource = hashFile(texture.path, texture.sourceHash);
+
+        for (VkFormat format : preferredFormats) {
+            auto container = std::make_unique<TextureContainer>();
+            if (container->open(textureContainerPath(texture.path, format), texture.hasSource ? texture.sourceHash : 0)
+                && container->format() == format) {
+                texture.containers.push_back(std::move(container));
+            }
+        }
+
+        auto target = std::find_if(preferredFormats.begin(), preferredFormats.end(), canCompressTo);
+        if (texture.hasSource && target != preferredFormats.end() && !texture.container(*target)) {
+            RgbaImage base;
+            if (!loadRgbaImage(texture.path, base)) {
+                throw std::runtime_error("failed to load texture image!");
+            }
+            texture.mips = buildMipChain(std::move(base), findTextureFormat(*target)->srgb);
+            texture.compressedFormat = *target;
+            texture.compressedLevels.resize(texture.mips.size());
+            for (size_t level = 0; level < texture.mips.size(); level++) {
+                texture.compressedLevels[level].resize(compressedImageSize(texture.mips[level], *target));
+            }
+            submitChunks(entry);
+        }
+
+        entry.preparedEnd = Clock::now();
+        entry.prepareMs = milliseconds(entry.preparedEnd - prepareStart);
+    }
+
+    // one job per ROWS_PER_JOB block rows of every level; the mips and outputs are sized before any job starts
+    void submitChunks(Entry& entry) {
+        PrefetchedTexture& texture = entry.texture;
+        struct Chunk {
+            size_t level;
+            uint32_t firstRow;
+            uint32_t lastRow;
+        };
+        std::vector<Chunk> chunks;
+        for (size_t level = 0; level < texture.mips.size(); level++) {
+            uint32_t blockRows = (texture.mips[level].height + 3) / 4;
+            for (uint32_t row = 0; row < blockRows; row += ROWS_PER_JOB) {
+                chunks.push_back({ level, row, std::min(row + ROWS_PER_JOB, blockRows) });
+            }
+        }
+
+        entry.chunkMs.resize(chunks.size());
+        entry.chunkEnd.resize(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++) {
+            Chunk chunk = chunks[i];
+            entry.chunks.push_back(pool->submit([&entry, chunk, i] {
+                auto chunkStart = Clock::now();
+                PrefetchedTexture& texture = entry.texture;
+                compressBlockRows(texture.mips[chunk.level], texture.compressedFormat, chunk.firstRow, chunk.lastRow,
+                    texture.compressedLevels[chunk.level].data());
+                entry.chunkEnd[i] = Clock::now();
+                entry.chunkMs[i] = milliseconds(entry.chunkEnd[i] - chunkStart);
+            }));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads fed from one job queue. Jobs must not block on other jobs of the same pool
+class ThreadPool {
+public:
+    // one thread is left for the caller, which takes part in parallelFor itself
+    static size_t defaultThreadCount() {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    explicit ThreadPool(size_t threadCount = defaultThreadCount()) {
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    template<typename F>
+    auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    // splits [0, count) into contiguous ranges of at least minRangeSize and calls fn(begin, end, rangeIndex) for each.
+    // Returns once all ranges are done, rethrowing the first exception. The ranges only depend on count, minRangeSize
+    // and the pool size, so per-range results can be merged in rangeIndex order for deterministic output
+    template<typename F>
+    void parallelFor(size_t count, size_t minRangeSize, F&& fn) {
+        size_t rangeCount = rangesFor(count, minRangeSize);
+        if (rangeCount == 0) {
+            return;
+        }
+
+        std::vector<std::future<void>> pending;
+        pending.reserve(rangeCount - 1);
+        for (size_t range = 1; range < rangeCount; range++) {
+            pending.push_back(submit([&fn, range, rangeCount, count] {
+                fn(range * count / rangeCount, (range + 1) * count / rangeCount, range);
+            }));
+        }
+
+        // the caller works on the first range instead of idling
+        std::exception_ptr error;
+        try {
+            fn(0, count / rangeCount, 0);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        for (auto& job : pending) {
+            try {
+                job.get();
+            }
+            catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // number of ranges parallelFor will use, for sizing per-range output up front
+    size_t rangesFor(size_t count, size_t minRangeSize) const {
+        if (count == 0) {
+            return 0;
+        }
+        size_t byWork = (count + std::max<size_t>(minRangeSize, 1) - 1) / std::max<size_t>(minRangeSize, 1);
+        return std::max<size_t>(1, std::min(byWork, size() + 1));
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+#endif
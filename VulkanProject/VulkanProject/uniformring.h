@@ -0,0 +1,108 @@
+#pragma once
+#ifndef UNIFORMRING_H
+#define UNIFORMRING_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "allocator.h"
+
+// One persistently mapped uniform buffer split into a segment per frame in flight. Per-frame and per-draw constants
+// are appended to the current frame's segment at minUniformBufferOffsetAlignment and bound through
+// UNIFORM_BUFFER_DYNAMIC descriptors, so the descriptor sets never change and every draw only needs a new offset
+class UniformRing {
+public:
+    static const VkDeviceSize DEFAULT_FRAME_SIZE = 1ull << 20;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t frameCount, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE) {
+        this->device = device;
+        this->allocator = allocator;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        alignment = properties.limits.minUniformBufferOffsetAlignment;
+        maxRange = properties.limits.maxUniformBufferRange;
+
+        // segments start aligned so offsets stay aligned in every frame
+        segmentSize = alignUp(frameSize, alignment);
+        segmentHeads.assign(frameCount, 0);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = segmentSize * frameCount;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &ringBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create uniform ring buffer!");
+        }
+        memory = allocator->allocateBuffer(ringBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    // starts writing into a frame's segment again. Only call once that frame's fence has signaled
+    void beginFrame(uint32_t frame) {
+        currentFrame = frame;
+        segmentHeads[frame] = 0;
+    }
+
+    // reserves size bytes in the current frame and returns the dynamic offset to bind them with
+    uint32_t allocate(VkDeviceSize size, void** mapped) {
+        VkDeviceSize& head = segmentHeads[currentFrame];
+        if (size > maxRange || head + size > segmentSize) {
+            throw std::runtime_error("uniform ring is out of space for this frame!");
+        }
+
+        VkDeviceSize offset = currentFrame * segmentSize + head;
+        head = alignUp(head + size, alignment);
+
+        *mapped = static_cast<char*>(memory.mapped) + offset;
+        return static_cast<uint32_t>(offset);
+    }
+
+    template<typename T>
+    uint32_t push(const T& value) {
+        void* mapped;
+        uint32_t offset = allocate(sizeof(T), &mapped);
+        memcpy(mapped, &value, sizeof(T));
+        return offset;
+    }
+
+    VkBuffer buffer() const {
+        return ringBuffer;
+    }
+
+    // descriptors point at offset 0 with the size of one block, the real offset comes with vkCmdBindDescriptorSets
+    VkDescriptorBufferInfo descriptorInfo(VkDeviceSize range) const {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = ringBuffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = range;
+        return bufferInfo;
+    }
+
+    void destroy() {
+        vkDestroyBuffer(device, ringBuffer, nullptr);
+        allocator->free(memory);
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    MemoryAllocation memory;
+    VkDeviceSize alignment = 256;
+    VkDeviceSize maxRange = 16384;
+    VkDeviceSize segmentSize = 0;
+    std::vector<VkDeviceSize> segmentHeads;
+    uint32_t currentFrame = 0;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif
@@ -0,0 +1,558 @@
+#pragma once
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "allocator.h"
+
+// Identifies one submitted batch. Tickets grow monotonically, so "everything up to ticket N" is well defined
+typedef uint64_t UploadTicket;
+
+// Batches buffer and image uploads into as few submissions as possible instead of one vkQueueWaitIdle per copy.
+// Data is copied into a persistently mapped staging ring, copies are recorded on the transfer queue when the device
+// has a dedicated one and everything that needs a graphics queue (queue ownership acquire, mip blits, layout
+// transitions) goes into a second command buffer that waits on the transfer part with a semaphore. Compute work on
+// uploaded data (mip generation) can go to an async compute queue in between, chained with a second semaphore.
+// Completion is tracked per batch with a fence, so uploads can also be issued between frames without stalling
+class UploadManager {
+public:
+    static const VkDeviceSize DEFAULT_STAGING_SIZE = 32ull << 20;
+
+    void init(VkDevice device, DeviceMemoryAllocator* allocator, uint32_t graphicsFamily, VkQueue graphicsQueue,
+        uint32_t transferFamily, VkQueue transferQueue, uint32_t computeFamily, VkQueue computeQueue, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE) {
+        this->device = device;
+        this->allocator = allocator;
+        this->graphicsFamily = graphicsFamily;
+        this->graphicsQueue = graphicsQueue;
+        this->transferFamily = transferFamily;
+        this->transferQueue = transferQueue;
+        this->computeFamily = computeFamily;
+        this->computeQueue = computeQueue;
+        separateTransfer = transferFamily != graphicsFamily;
+        separateCompute = computeFamily != graphicsFamily;
+
+        graphicsPool = createCommandPool(graphicsFamily);
+        transferPool = separateTransfer ? createCommandPool(transferFamily) : VK_NULL_HANDLE;
+        computePool = separateCompute ? createCommandPool(computeFamily) : VK_NULL_HANDLE;
+
+        stagingCapacity = stagingSize;
+        createStagingBuffer(stagingSize, stagingBuffer, stagingMemory);
+        stagingHead = 0;
+        stagingUsed = 0;
+    }
+
+    bool usesTransferQueue() const {
+        return separateTransfer;
+    }
+
+    bool usesComputeQueue() const {
+        return separateCompute;
+    }
+
+    uint32_t graphicsQueueFamily() const {
+        return graphicsFamily;
+    }
+
+    uint32_t computeQueueFamily() const {
+        return computeFamily;
+    }
+
+    // command buffer for copies. Resources written here are released to the graphics family on submit
+    VkCommandBuffer transferCommands() {
+        Batch& batch = currentBatch();
+        batch.hasTransferWork = true;
+        return separateTransfer ? batch.transferCommandBuffer : batch.graphicsCommandBuffer;
+    }
+
+    // command buffer that executes on the graphics queue after this batch's copies
+    VkCommandBuffer graphicsCommands() {
+        return currentBatch().graphicsCommandBuffer;
+    }
+
+    // command buffer that executes on the compute queue after this batch's copies and before its graphics part. Without
+    // an async compute queue this is the graphics command buffer, the recorded barriers then need no ownership transfer
+    VkCommandBuffer computeCommands() {
+        Batch& batch = currentBatch();
+        batch.hasComputeWork = true;
+        return separateCompute ? batch.computeCommandBuffer : batch.graphicsCommandBuffer;
+    }
+
+    // copies size bytes into the staging ring and returns the buffer/offset to copy from
+    void stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer& srcBuffer, VkDeviceSize& srcOffset) {
+        if (size > stagingCapacity) {
+            // too big for the ring, give it its own staging buffer that lives as long as the batch
+            Batch& batch = currentBatch();
+            batch.oversizedStaging.push_back({});
+            auto& staging = batch.oversizedStaging.back();
+            createStagingBuffer(size, staging.first, staging.second);
+            memcpy(staging.second.mapped, data, static_cast<size_t>(size));
+            srcBuffer = staging.first;
+            srcOffset = 0;
+            return;
+        }
+
+        VkDeviceSize consumed;
+        while (!reserveRing(size, alignment, srcOffset, consumed)) {
+            // wait for the oldest batch to retire its part of the ring, submitting the open one first if it holds everything
+            if (inFlight.empty() || (openBatch && currentBatch().stagingBytes == stagingUsed)) {
+                submit();
+            }
+            retireOldest();
+        }
+
+        memcpy(static_cast<char*>(stagingMemory.mapped) + srcOffset, data, static_cast<size_t>(size));
+        currentBatch().stagingBytes += consumed;
+        srcBuffer = stagingBuffer;
+    }
+
+    // dstStage/dstAccess describe the first use on the graphics queue, e.g. vertex input
+    void uploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset,
+        VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkBuffer srcBuffer;
+        VkDeviceSize srcOffset;
+        stage(data, size, 16, srcBuffer, srcOffset);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(transferCommands(), srcBuffer, dstBuffer, 1, &copyRegion);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.srcQueueFamilyIndex = separateTransfer ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = separateTransfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = dstBuffer;
+        barrier.offset = dstOffset;
+        barrier.size = size;
+
+        if (separateTransfer) {
+            // release on the transfer queue, the matching acquire below makes the data visible to dstStage
+            VkBufferMemoryBarrier release = barrier;
+            release.dstAccessMask = 0;
+            vkCmdPipelineBarrier(transferCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 1, &release, 0, nullptr);
+
+            barrier.srcAccessMask = 0;
+            vkCmdPipelineBarrier(graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+                0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        else {
+            vkCmdPipelineBarrier(graphicsCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+                0, nullptr, 1, &barrier, 0, nullptr);
+        }
+    }
+
+    // uploads mip 0 of a color image. Every mip level is left in TRANSFER_DST_OPTIMAL and owned by the graphics
+    // family, ready for mip generation or a transition recorded into graphicsCommands(). With forCompute the image
+    // goes to the compute family instead, for work recorded into computeCommands()
+    void uploadImage(VkImage image, const void* data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t mipLevels,
+        VkDeviceSize texelSize = 4, bool forCompute = false) {
+        ImageLevel level{ data, size, width, height };
+        uploadImageLevels(image, &level, 1, mipLevels, texelSize, forCompute);
+    }
+
+    // one mip level of ready made image data, e.g. a block compressed level from a texture container
+    struct ImageLevel {
+        const void* data;
+        VkDeviceSize size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // uploads levels 0..levelCount-1 as they are, texelSize is the size of a texel or compressed block. Leaves the
+    // image in the same state as uploadImage
+    void uploadImageLevels(VkImage image, const ImageLevel* levels, uint32_t levelCount, uint32_t mipLevels, VkDeviceSize texelSize,
+        bool forCompute = false) {
+        bool toCompute = forCompute && separateCompute;
+        uint32_t consumerFamily = toCompute ? computeFamily : graphicsFamily;
+        // the graphics part runs after the compute part, so without a transfer queue the compute queue does the copies
+        VkCommandBuffer commandBuffer = toCompute && !separateTransfer ? computeCommands() : transferCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        for (uint32_t level = 0; level < levelCount; level++) {
+            VkBuffer srcBuffer;
+            VkDeviceSize srcOffset;
+            // bufferOffset of a buffer to image copy has to be a multiple of 4 and of the texel size
+            stage(levels[level].data, levels[level].size, texelSize % 4 == 0 ? texelSize : texelSize * 4, srcBuffer, srcOffset);
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = srcOffset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { levels[level].width, levels[level].height, 1 };
+
+            vkCmdCopyBufferToImage(commandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+
+        if (separateTransfer) {
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = consumerFamily;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(toCompute ? computeCommands() : graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+        }
+    }
+
+    // submits everything recorded since the last submit. Returns the ticket to wait on, or the last ticket if there was nothing to do
+    UploadTicket submit() {
+        if (!openBatch) {
+            return lastSubmitted;
+        }
+        Batch batch = std::move(*openBatch);
+        openBatch.reset();
+
+        bool transferSubmit = separateTransfer && batch.hasTransferWork;
+        if (separateTransfer) {
+            vkEndCommandBuffer(batch.transferCommandBuffer);
+        }
+        if (transferSubmit) {
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &batch.transferDone;
+
+            if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+        }
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        // the semaphore the next part of the chain waits on, transfer -> compute -> graphics
+        VkSemaphore previousDone = transferSubmit ? batch.transferDone : VK_NULL_HANDLE;
+
+        bool computeSubmit = separateCompute && batch.hasComputeWork;
+        if (separateCompute) {
+            vkEndCommandBuffer(batch.computeCommandBuffer);
+        }
+        if (computeSubmit) {
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &batch.computeCommandBuffer;
+            if (previousDone != VK_NULL_HANDLE) {
+                submitInfo.waitSemaphoreCount = 1;
+                submitInfo.pWaitSemaphores = &previousDone;
+                submitInfo.pWaitDstStageMask = &waitStage;
+            }
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &batch.computeDone;
+
+            if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+            previousDone = batch.computeDone;
+        }
+
+        vkEndCommandBuffer(batch.graphicsCommandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &batch.graphicsCommandBuffer;
+        if (previousDone != VK_NULL_HANDLE) {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &previousDone;
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+
+        lastSubmitted = batch.ticket;
+        inFlight.push_back(std::move(batch));
+        return lastSubmitted;
+    }
+
+    bool isComplete(UploadTicket ticket) {
+        collect();
+        return ticket <= lastRetired;
+    }
+
+    void wait(UploadTicket ticket) {
+        if (openBatch && ticket >= openBatch->ticket) {
+            submit();
+        }
+        while (lastRetired < ticket && !inFlight.empty()) {
+            retireOldest();
+        }
+    }
+
+    // submits pending work and blocks until all of it has finished, still a single round trip for the whole batch
+    void flush() {
+        wait(submit());
+    }
+
+    // non-blocking, recycles every batch whose fence has already signaled. Call once per frame
+    void collect() {
+        while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS) {
+            retireOldest();
+        }
+    }
+
+    void destroy() {
+        flush();
+        for (auto& batch : freeBatches) {
+            destroyBatch(batch);
+        }
+        freeBatches.clear();
+
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        allocator->free(stagingMemory);
+
+        vkDestroyCommandPool(device, graphicsPool, nullptr);
+        if (transferPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, transferPool, nullptr);
+        }
+        if (computePool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, computePool, nullptr);
+        }
+    }
+
+private:
+    struct Batch {
+        UploadTicket ticket = 0;
+        VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore transferDone = VK_NULL_HANDLE;
+        VkSemaphore computeDone = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        // ring bytes (including alignment and wrap padding) to give back once the fence signals
+        VkDeviceSize stagingBytes = 0;
+        std::vector<std::pair<VkBuffer, MemoryAllocation>> oversizedStaging;
+        bool hasTransferWork = false;
+        bool hasComputeWork = false;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    uint32_t graphicsFamily = 0;
+    uint32_t transferFamily = 0;
+    uint32_t computeFamily = 0;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkQueue computeQueue = VK_NULL_HANDLE;
+    bool separateTransfer = false;
+    bool separateCompute = false;
+    VkCommandPool graphicsPool = VK_NULL_HANDLE;
+    VkCommandPool transferPool = VK_NULL_HANDLE;
+    VkCommandPool computePool = VK_NULL_HANDLE;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    MemoryAllocation stagingMemory;
+    VkDeviceSize stagingCapacity = 0;
+    VkDeviceSize stagingHead = 0;
+    VkDeviceSize stagingUsed = 0;
+
+    std::optional<Batch> openBatch;
+    std::deque<Batch> inFlight;
+    std::vector<Batch> freeBatches;
+    UploadTicket nextTicket = 1;
+    UploadTicket lastSubmitted = 0;
+    UploadTicket lastRetired = 0;
+
+    VkCommandPool createCommandPool(uint32_t queueFamily) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+        return pool;
+    }
+
+    void createStagingBuffer(VkDeviceSize size, VkBuffer& buffer, MemoryAllocation& memory) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create staging buffer!");
+        }
+        memory = allocator->allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    static VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool pool) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    VkSemaphore createSemaphore() {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload semaphore!");
+        }
+        return semaphore;
+    }
+
+    Batch createBatch() {
+        Batch batch;
+        batch.graphicsCommandBuffer = allocateCommandBuffer(device, graphicsPool);
+        if (separateTransfer) {
+            batch.transferCommandBuffer = allocateCommandBuffer(device, transferPool);
+            batch.transferDone = createSemaphore();
+        }
+        if (separateCompute) {
+            batch.computeCommandBuffer = allocateCommandBuffer(device, computePool);
+            batch.computeDone = createSemaphore();
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+        return batch;
+    }
+
+    void destroyBatch(Batch& batch) {
+        vkFreeCommandBuffers(device, graphicsPool, 1, &batch.graphicsCommandBuffer);
+        if (batch.transferCommandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device, transferPool, 1, &batch.transferCommandBuffer);
+            vkDestroySemaphore(device, batch.transferDone, nullptr);
+        }
+        if (batch.computeCommandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device, computePool, 1, &batch.computeCommandBuffer);
+            vkDestroySemaphore(device, batch.computeDone, nullptr);
+        }
+        vkDestroyFence(device, batch.fence, nullptr);
+    }
+
+    Batch& currentBatch() {
+        if (openBatch) {
+            return *openBatch;
+        }
+
+        if (freeBatches.empty()) {
+            openBatch = createBatch();
+        }
+        else {
+            openBatch = std::move(freeBatches.back());
+            freeBatches.pop_back();
+        }
+        openBatch->ticket = nextTicket++;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(openBatch->graphicsCommandBuffer, &beginInfo);
+        if (separateTransfer) {
+            vkBeginCommandBuffer(openBatch->transferCommandBuffer, &beginInfo);
+        }
+        if (separateCompute) {
+            vkBeginCommandBuffer(openBatch->computeCommandBuffer, &beginInfo);
+        }
+        return *openBatch;
+    }
+
+    // finds room for size bytes after the ring head, wrapping to the start when the tail end is too short
+    bool reserveRing(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, VkDeviceSize& consumed) {
+        VkDeviceSize freeBytes = stagingCapacity - stagingUsed;
+        VkDeviceSize aligned = (stagingHead + alignment - 1) / alignment * alignment;
+
+        if (aligned + size <= stagingCapacity) {
+            consumed = aligned + size - stagingHead;
+            offset = aligned;
+        }
+        else {
+            consumed = stagingCapacity - stagingHead + size;
+            offset = 0;
+        }
+
+        if (consumed > freeBytes) {
+            return false;
+        }
+
+        stagingHead = (offset + size) % stagingCapacity;
+        stagingUsed += consumed;
+        return true;
+    }
+
+    void retireOldest() {
+        Batch& batch = inFlight.front();
+        vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &batch.fence);
+
+        stagingUsed -= batch.stagingBytes;
+        if (stagingUsed == 0) {
+            stagingHead = 0;
+        }
+        for (auto& staging : batch.oversizedStaging) {
+            vkDestroyBuffer(device, staging.first, nullptr);
+            allocator->free(staging.second);
+        }
+        batch.oversizedStaging.clear();
+        batch.stagingBytes = 0;
+        batch.hasTransferWork = false;
+        batch.hasComputeWork = false;
+
+        // command buffers come from pools with the reset flag, vkBeginCommandBuffer resets them implicitly
+        lastRetired = batch.ticket;
+        freeBatches.push_back(std::move(batch));
+        inFlight.pop_front();
+    }
+};
+
+#endif
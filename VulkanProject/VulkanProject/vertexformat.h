@@ -0,0 +1,268 @@
+#pragma once
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// shader locations of the attributes, fixed whichever encoding the layout picks
+const uint32_t VERTEX_POSITION_LOCATION = 0;
+const uint32_t VERTEX_COLOR_LOCATION = 1;
+const uint32_t VERTEX_TEXCOORD_LOCATION = 2;
+const uint32_t VERTEX_NORMAL_LOCATION = 3;
+
+// Unorm16 positions are relative to the mesh bounds, VertexLayout::positionDecode gives the transform back to model
+// space. It scales all axes alike so it can be folded into a model matrix without bending the normals
+enum class PositionEncoding {
+    Float3,
+    Unorm16
+};
+
+// octahedral folds the unit sphere onto a square, the shader unfolds it
+enum class NormalEncoding {
+    Float3,
+    Octahedral16
+};
+
+enum class TexCoordEncoding {
+    Float2,
+    Half2
+};
+
+// where the full precision attributes of one vertex sit in the caller's vertex struct
+struct VertexSource {
+    const void* data;
+    uint32_t count;
+    uint32_t stride;
+    uint32_t positionOffset;
+    uint32_t colorOffset;
+    uint32_t texCoordOffset;
+    uint32_t normalOffset;
+
+    glm::vec3 read(uint32_t index, uint32_t offset) const {
+        glm::vec3 value;
+        memcpy(&value, static_cast<const uint8_t*>(data) + static_cast<size_t>(index) * stride + offset, sizeof(glm::vec3));
+        return value;
+    }
+
+    glm::vec2 readTexCoord(uint32_t index) const {
+        glm::vec2 value;
+        memcpy(&value, static_cast<const uint8_t*>(data) + static_cast<size_t>(index) * stride + texCoordOffset, sizeof(glm::vec2));
+        return value;
+    }
+};
+
+// A vertex as it is stored on the GPU. Each attribute has an encoding, a color that is the same for every vertex
+// is left out and the shader uses white. The binding and attribute descriptions are generated from the encodings,
+// every attribute is 4 byte aligned
+struct VertexLayout {
+    PositionEncoding position = PositionEncoding::Float3;
+    NormalEncoding normal = NormalEncoding::Float3;
+    TexCoordEncoding texCoord = TexCoordEncoding::Float2;
+    bool color = false;
+
+    // 44 bytes, the layout the vertices had before packing
+    static VertexLayout full() {
+        VertexLayout layout;
+        layout.color = true;
+        return layout;
+    }
+
+    // 16 bytes
+    static VertexLayout packed() {
+        VertexLayout layout;
+        layout.position = PositionEncoding::Unorm16;
+        layout.normal = NormalEncoding::Octahedral16;
+        layout.texCoord = TexCoordEncoding::Half2;
+        return layout;
+    }
+
+    // full, float or packed, the names --vertex-format takes
+    static VertexLayout fromName(const std::string& name) {
+        if (name == "full") {
+            return full();
+        }
+        if (name == "float") {
+            return VertexLayout();
+        }
+        if (name == "packed") {
+            return packed();
+        }
+        throw std::runtime_error("unknown vertex format: " + name);
+    }
+
+    uint32_t stride() const {
+        return colorOffset() + (color ? 12 : 0) + texCoordSize() + normalSize();
+    }
+
+    bool octahedralNormals() const {
+        return normal != NormalEncoding::Float3;
+    }
+
+    VkVertexInputBindingDescription getBindingDescription(uint32_t binding = 0) const {
+        VkVertexInputBindingDescription bindingDescription{};
+
+        bindingDescription.binding = binding;
+        bindingDescription.stride = stride();
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(uint32_t binding = 0) const {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+
+        //the formats widen to floats on the way into the shader, so it declares the same inputs for every encoding
+        attributeDescriptions.push_back({ VERTEX_POSITION_LOCATION, binding,
+            position == PositionEncoding::Float3 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R16G16B16A16_UNORM, 0 });
+        if (color) {
+            attributeDescriptions.push_back({ VERTEX_COLOR_LOCATION, binding, VK_FORMAT_R32G32B32_SFLOAT, colorOffset() });
+        }
+        attributeDescriptions.push_back({ VERTEX_TEXCOORD_LOCATION, binding,
+            texCoord == TexCoordEncoding::Float2 ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R16G16_SFLOAT, texCoordOffset() });
+        attributeDescriptions.push_back({ VERTEX_NORMAL_LOCATION, binding,
+            normal == NormalEncoding::Float3 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R16G16_SNORM, normalOffset() });
+
+        return attributeDescriptions;
+    }
+
+    // encodes the source vertices into out, Unorm16 positions relative to the given bounds
+    void pack(const VertexSource& source, const glm::vec3& boundsMin, float boundsExtent, std::vector<uint8_t>& out) const {
+        size_t first = out.size();
+        out.resize(first + static_cast<size_t>(source.count) * stride());
+        float inverseExtent = boundsExtent > 0.f ? 1.f / boundsExtent : 0.f;
+        for (uint32_t i = 0; i < source.count; i++) {
+            uint8_t* vertex = out.data() + first + static_cast<size_t>(i) * stride();
+
+            glm::vec3 pos = source.read(i, source.positionOffset);
+            if (position == PositionEncoding::Float3) {
+                memcpy(vertex, &pos, sizeof(pos));
+            }
+            else {
+                glm::vec3 unit = glm::clamp((pos - boundsMin) * inverseExtent, 0.f, 1.f);
+                uint16_t quantized[4] = { quantizeUnorm16(unit.x), quantizeUnorm16(unit.y), quantizeUnorm16(unit.z), 0 };
+                memcpy(vertex, quantized, sizeof(quantized));
+            }
+
+            if (color) {
+                glm::vec3 value = source.read(i, source.colorOffset);
+                memcpy(vertex + colorOffset(), &value, sizeof(value));
+            }
+
+            glm::vec2 uv = source.readTexCoord(i);
+            if (texCoord == TexCoordEncoding::Float2) {
+                memcpy(vertex + texCoordOffset(), &uv, sizeof(uv));
+            }
+            else {
+                uint32_t half = glm::packHalf2x16(uv);
+                memcpy(vertex + texCoordOffset(), &half, sizeof(half));
+            }
+
+            glm::vec3 n = source.read(i, source.normalOffset);
+            if (normal == NormalEncoding::Float3) {
+                memcpy(vertex + normalOffset(), &n, sizeof(n));
+            }
+            else {
+                glm::vec2 folded = octahedralEncode(n);
+                int16_t encoded[2] = { quantizeSnorm16(folded.x), quantizeSnorm16(folded.y) };
+                memcpy(vertex + normalOffset(), encoded, sizeof(encoded));
+            }
+        }
+    }
+
+    // xyz is the offset and w the scale that take a stored position back to model space
+    glm::vec4 positionDecode(const glm::vec3& boundsMin, float boundsExtent) const {
+        if (position == PositionEncoding::Float3) {
+            return glm::vec4(0.f, 0.f, 0.f, 1.f);
+        }
+        return glm::vec4(boundsMin, boundsExtent);
+    }
+
+    static glm::vec2 octahedralEncode(glm::vec3 n) {
+        float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (length == 0.f) {
+            return glm::vec2(0.f);
+        }
+        n /= length;
+        glm::vec2 folded(n.x, n.y);
+        if (n.z < 0.f) {
+            folded = (1.f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+        }
+        return folded;
+    }
+
+private:
+    uint32_t colorOffset() const {
+        return position == PositionEncoding::Float3 ? 12 : 8;
+    }
+
+    uint32_t texCoordOffset() const {
+        return colorOffset() + (color ? 12 : 0);
+    }
+
+    uint32_t texCoordSize() const {
+        return texCoord == TexCoordEncoding::Float2 ? 8 : 4;
+    }
+
+    uint32_t normalOffset() const {
+        return texCoordOffset() + texCoordSize();
+    }
+
+    uint32_t normalSize() const {
+        return normal == NormalEncoding::Float3 ? 12 : 4;
+    }
+
+    static uint16_t quantizeUnorm16(float value) {
+        return static_cast<uint16_t>(std::lround(value * 65535.f));
+    }
+
+    static int16_t quantizeSnorm16(float value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+    }
+};
+
+// indices of one mesh, 16 bit whenever every index fits
+struct PackedIndices {
+    std::vector<uint8_t> bytes;
+    VkIndexType type = VK_INDEX_TYPE_UINT32;
+
+    static PackedIndices pack(const uint32_t* indices, size_t count, bool allow16Bit = true) {
+        PackedIndices packed;
+        bool fits = allow16Bit && std::all_of(indices, indices + count, [](uint32_t index) {
+            return index <= std::numeric_limits<uint16_t>::max();
+        });
+        packed.type = fits ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        packed.bytes.resize(count * indexSize(packed.type));
+        if (fits) {
+            uint16_t* narrow = reinterpret_cast<uint16_t*>(packed.bytes.data());
+            for (size_t i = 0; i < count; i++) {
+                narrow[i] = static_cast<uint16_t>(indices[i]);
+            }
+        }
+        else if (count > 0) {
+            memcpy(packed.bytes.data(), indices, count * sizeof(uint32_t));
+        }
+        return packed;
+    }
+
+    static PackedIndices pack(const std::vector<uint32_t>& indices) {
+        return pack(indices.data(), indices.size());
+    }
+
+    static uint32_t indexSize(VkIndexType type) {
+        return type == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+    }
+};
+
+#endif